@@ -0,0 +1,286 @@
+#include "archive.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "blkMmap.h"
+#include "blockIndexLink.h"
+#include "clientversion.h"
+#include "common.h"
+#include "hash.h"
+#include "logging.h"
+#include "shutdown.h"
+#include "streams.h"
+#include "time.h"
+#include "tinyformat.h"
+
+namespace
+{
+//! magic, version, record count and tip hash
+static const size_t ARCHIVE_INDEX_HEADER_SIZE = 4 + 4 + 4 + 32;
+//! magic and size in front of every record of a blk / rev file
+static const size_t RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+
+/** Appends magic / size framed records to the blk or rev files of an archive. */
+class CArchiveFileWriter
+{
+private:
+    const std::string m_dir;
+    const char* const m_prefix;
+    const CMessageHeader::MessageStartChars& m_message_start;
+    FILE* m_file;
+    int m_nFile;
+    uint32_t m_nSize;
+
+public:
+    CArchiveFileWriter(const std::string& dir, const char* prefix, const CMessageHeader::MessageStartChars& message_start)
+        : m_dir(dir), m_prefix(prefix), m_message_start(message_start), m_file(nullptr), m_nFile(-1), m_nSize(0)
+    {
+    }
+
+    ~CArchiveFileWriter() { Close(); }
+
+    int GetFile() const { return m_nFile; }
+    uint32_t GetSize() const { return m_nSize; }
+
+    bool Close()
+    {
+        const bool ok = !m_file || fclose(m_file) == 0;
+        m_file = nullptr;
+        return ok;
+    }
+
+    /**
+     * Append record, followed by trailer (not counted in the size field), to file nFile,
+     * which is created when it is not the current one. nPos receives the position of record.
+     */
+    bool Write(int nFile, Span<const unsigned char> record, Span<const unsigned char> trailer, uint32_t& nPos)
+    {
+        if (nFile != m_nFile)
+        {
+            const std::string path = GetBlockFilePath(m_dir, m_prefix, nFile);
+            if (!Close() || !(m_file = fopen(path.c_str(), "wb")))
+            {
+                LogError("%s: 无法创建归档文件 %s\n", __func__, path.data());
+                return false;
+            }
+            m_nFile = nFile;
+            m_nSize = 0;
+        }
+        unsigned char vHeader[RECORD_HEADER_SIZE];
+        memcpy(vHeader, m_message_start, CMessageHeader::MESSAGE_START_SIZE);
+        WriteLE32(vHeader + CMessageHeader::MESSAGE_START_SIZE, record.size());
+        if (fwrite(vHeader, 1, sizeof(vHeader), m_file) != sizeof(vHeader) ||
+            fwrite(record.data(), 1, record.size(), m_file) != (size_t)record.size() ||
+            fwrite(trailer.data(), 1, trailer.size(), m_file) != (size_t)trailer.size())
+        {
+            LogError("%s: 写入归档文件失败 %s\n", __func__, GetBlockFilePath(m_dir, m_prefix, nFile).data());
+            return false;
+        }
+        nPos = m_nSize + sizeof(vHeader);
+        m_nSize += sizeof(vHeader) + record.size() + trailer.size();
+        return true;
+    }
+};
+
+bool IsSameDirectory(const std::string& a, const std::string& b)
+{
+    struct stat sta, stb;
+    return stat(a.c_str(), &sta) == 0 && stat(b.c_str(), &stb) == 0 && sta.st_dev == stb.st_dev && sta.st_ino == stb.st_ino;
+}
+} // namespace
+
+bool ExportArchive(BlockManager& blockman, const CChain& chain, const std::string& archive_dir, const ArchiveOptions& options)
+{
+    const std::string index_path = archive_dir + "/" + ARCHIVE_INDEX_NAME;
+    struct stat st;
+    if (stat(archive_dir.c_str(), &st) != 0 && mkdir(archive_dir.c_str(), 0755) != 0)
+    {
+        LogError("%s: 无法创建归档目录 %s\n", __func__, archive_dir.data());
+        return false;
+    }
+    // hzx 下面会删除目录中的 blk/rev 文件, 不能是区块目录本身, 也不能是其他带 index 数据库的区块目录
+    if (IsSameDirectory(archive_dir, blockman.GetBlocksDir()) || stat((archive_dir + "/index").c_str(), &st) == 0)
+    {
+        LogError("%s: %s 是区块目录, 不能作为归档目录\n", __func__, archive_dir.data());
+        return false;
+    }
+    if (chain.Height() < 0)
+        return false;
+
+    // 旧归档先失效并删除, 导出中断时目录中不会留下可用但不完整的归档
+    remove(index_path.c_str());
+    for (const char* prefix : {"blk", "rev"})
+        for (int nFile = 0; remove(GetBlockFilePath(archive_dir, prefix, nFile).c_str()) == 0; nFile++)
+            ;
+    const std::string tmp_path = index_path + ".new";
+    FILE* index_file = fopen(tmp_path.c_str(), "wb");
+    if (!index_file)
+    {
+        LogError("%s: 无法创建归档索引 %s\n", __func__, tmp_path.data());
+        return false;
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << ARCHIVE_INDEX_MAGIC << ARCHIVE_INDEX_VERSION << (uint32_t)(chain.Height() + 1) << chain.Tip()->GetBlockHash();
+
+    const std::chrono::milliseconds export_start_time = GetTimeMillis();
+    CArchiveFileWriter blocks(archive_dir, "blk", Params().MessageStart());
+    CArchiveFileWriter undo(archive_dir, "rev", Params().MessageStart());
+    uint64_t nBytes = 0;
+    int nUndo = 0;
+    bool ok = true;
+    for (int nHeight = 0; ok && nHeight <= chain.Height(); nHeight++)
+    {
+        if (ShutdownRequested())
+        {
+            ok = false;
+            break;
+        }
+        const CBlockIndex* pindex = chain[nHeight];
+        std::shared_ptr<const CMappedFile> file;
+        Span<const unsigned char> record;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !blockman.LocateBlock(pindex, file, record) || record.size() < 80)
+        {
+            LogError("%s: 无法读取区块, 高度: %d\n", __func__, nHeight);
+            ok = false;
+            break;
+        }
+        CArchiveIndexRecord entry;
+        try
+        {
+            SpanReader header(SER_DISK, CLIENT_VERSION, record.first(80));
+            header >> entry.header;
+        }
+        catch (const std::exception&)
+        {
+            ok = false;
+            break;
+        }
+        entry.hash = entry.header.GetHash();
+        if (entry.hash != pindex->GetBlockHash())
+        {
+            LogError("%s: 区块哈希与索引不一致, 高度: %d, 文件: %d, 偏移位置: %u\n", __func__, nHeight, pindex->nFile, pindex->nDataPos);
+            ok = false;
+            break;
+        }
+
+        // 文件写满时换下一个文件, 区块与其 undo 数据使用相同的文件编号
+        int nFile = std::max(blocks.GetFile(), 0);
+        if (blocks.GetSize() > 0 && blocks.GetSize() + RECORD_HEADER_SIZE + record.size() > options.nMaxFileSize)
+            nFile++;
+        entry.nFile = nFile;
+        entry.nSize = record.size();
+        entry.nTx = pindex->nTx;
+        entry.nUndoPos = 0;
+        if (!blocks.Write(nFile, record, Span<const unsigned char>(), entry.nDataPos))
+        {
+            ok = false;
+            break;
+        }
+        nBytes += RECORD_HEADER_SIZE + record.size();
+        file.reset();
+
+        if (options.fUndo && pindex->pprev && (pindex->nStatus & BLOCK_HAVE_UNDO))
+        {
+            // 校验和覆盖上一区块哈希与 undo 记录, 两者都不变, 原样复制
+            if (!blockman.LocateUndo(pindex, file, record) ||
+                !undo.Write(nFile, record, Span<const unsigned char>(record.end(), CHash256::OUTPUT_SIZE), entry.nUndoPos))
+            {
+                ok = false;
+                break;
+            }
+            nBytes += RECORD_HEADER_SIZE + record.size() + CHash256::OUTPUT_SIZE;
+            nUndo++;
+        }
+        ss << entry;
+        // 分段写入索引, 内存占用与链长度无关
+        if (ss.size() >= (1 << 20))
+        {
+            ok = fwrite(ss.data(), 1, ss.size(), index_file) == ss.size();
+            ss.clear();
+        }
+    }
+    ok = ok && fwrite(ss.data(), 1, ss.size(), index_file) == ss.size();
+    ok = (fclose(index_file) == 0) && blocks.Close() && undo.Close() && ok;
+    if (!ok || rename(tmp_path.c_str(), index_path.c_str()) != 0)
+    {
+        LogError("%s: 导出归档失败 %s\n", __func__, archive_dir.data());
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    const int nLastFile = blocks.GetFile();
+    LogInfo("%s: 导出 %d 个区块(%d 个含 undo 数据)到 %s, %d 个文件, %lu MiB, 耗时 %ld ms\n", __func__, chain.Height() + 1, nUndo,
+           archive_dir.data(), nLastFile + 1, (unsigned long)(nBytes >> 20), (long)(GetTimeMillis() - export_start_time).count());
+    return true;
+}
+
+bool LoadArchiveIndex(const std::string& archive_dir, const CChainParams& chainparams, CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight)
+{
+    const std::string index_path = archive_dir + "/" + ARCHIVE_INDEX_NAME;
+    CMappedFile file(index_path);
+    if (file.IsNull())
+    {
+        LogError("%s: 无法打开归档索引 %s\n", __func__, index_path.data());
+        return false;
+    }
+    file.Prefetch(0, file.size());
+
+    vSortedByHeight.clear();
+    try
+    {
+        SpanReader ss(SER_DISK, CLIENT_VERSION, file.GetSpan());
+        uint32_t nMagic, nVersion, nRecords;
+        uint256 hashTip;
+        ss >> nMagic >> nVersion >> nRecords >> hashTip;
+        if (nMagic != ARCHIVE_INDEX_MAGIC || nVersion != ARCHIVE_INDEX_VERSION)
+            throw std::ios_base::failure("unknown format or version");
+        if (nRecords == 0 || file.size() != ARCHIVE_INDEX_HEADER_SIZE + (size_t)nRecords * CArchiveIndexRecord::SIZE)
+            throw std::ios_base::failure("bad size");
+
+        mapBlockIndex.Reserve(nRecords);
+        vSortedByHeight.reserve(nRecords);
+        CArchiveIndexRecord record;
+        CBlockIndex* pprev = nullptr;
+        for (uint32_t nHeight = 0; nHeight < nRecords; nHeight++)
+        {
+            ss >> record;
+            // hzx 高度由记录的位置决定, 每个区块头必须指向上一高度的区块
+            if (nHeight == 0 ? record.hash != chainparams.GetConsensus().hashGenesisBlock : record.header.hashPrevBlock != pprev->GetBlockHash())
+                throw std::ios_base::failure(strprintf("block at height %u does not link to the previous height", nHeight));
+            bool fInserted = false;
+            CBlockIndex* pindex = mapBlockIndex.Insert(record.hash, &fInserted);
+            if (!fInserted)
+                throw std::ios_base::failure("duplicate block hash");
+            pindex->nVersion = record.header.nVersion;
+            pindex->hashMerkleRoot = record.header.hashMerkleRoot;
+            pindex->nTime = record.header.nTime;
+            pindex->nBits = record.header.nBits;
+            pindex->nNonce = record.header.nNonce;
+            pindex->pprev = pprev;
+            pindex->nHeight = nHeight;
+            pindex->nFile = record.nFile;
+            pindex->nDataPos = record.nDataPos;
+            pindex->nUndoPos = record.nUndoPos;
+            pindex->nTx = record.nTx;
+            pindex->nStatus = BLOCK_HAVE_DATA;
+            if (record.nUndoPos)
+                pindex->nStatus |= BLOCK_HAVE_UNDO;
+            pindex->RaiseValidity(nHeight == 0 || record.nUndoPos ? BLOCK_VALID_SCRIPTS : BLOCK_VALID_TRANSACTIONS);
+            vSortedByHeight.push_back(pindex);
+            pprev = pindex;
+        }
+        if (pprev->GetBlockHash() != hashTip)
+            throw std::ios_base::failure("tip hash mismatch");
+        LinkBlockIndex(MakeSpan(vSortedByHeight));
+    }
+    catch (const std::exception& e)
+    {
+        LogError("%s: 读取归档索引失败 - %s, %s\n", __func__, e.what(), index_path.data());
+        mapBlockIndex.Clear();
+        vSortedByHeight.clear();
+        return false;
+    }
+    LogInfo("%s: 从归档索引载入 %lu 个区块\n", __func__, (unsigned long)vSortedByHeight.size());
+    return true;
+}
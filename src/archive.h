@@ -0,0 +1,80 @@
+#ifndef BLOCKCHAIN_ARCHIVE_H
+#define BLOCKCHAIN_ARCHIVE_H
+#include <string>
+#include <vector>
+#include "block.h"
+#include "blockIndexMap.h"
+#include "blockMan.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "serialize.h"
+
+static const uint32_t ARCHIVE_INDEX_MAGIC = 0x63726168; // "harc"
+static const uint32_t ARCHIVE_INDEX_VERSION = 1;
+//! Name of the sidecar index inside an archive directory
+static const char* const ARCHIVE_INDEX_NAME = "archive.idx";
+//! Archive files are cut at this size, so a scan still spreads over as many workers as blk files would
+static const unsigned int DEFAULT_ARCHIVE_FILE_SIZE = 0x8000000; // 128 MiB
+
+/**
+ * The entry of one height in archive.idx. Every field is fixed width, so the entry of
+ * height h lives at a known offset. nDataPos / nUndoPos point behind the magic and size of
+ * the record, like CBlockIndex; nUndoPos is 0 if the block has no undo data.
+ */
+struct CArchiveIndexRecord
+{
+    static const size_t SIZE = 132;
+
+    uint256 hash;
+    CBlockHeader header;
+    int32_t nFile;
+    uint32_t nDataPos;
+    uint32_t nSize;
+    uint32_t nUndoPos;
+    uint32_t nTx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hash);
+        READWRITE(header);
+        READWRITE(nFile);
+        READWRITE(nDataPos);
+        READWRITE(nSize);
+        READWRITE(nUndoPos);
+        READWRITE(nTx);
+    }
+};
+
+struct ArchiveOptions
+{
+    //! see DEFAULT_ARCHIVE_FILE_SIZE
+    unsigned int nMaxFileSize = DEFAULT_ARCHIVE_FILE_SIZE;
+    //! also copy the undo record (and checksum) of every block that has one into rev?????.dat
+    bool fUndo = true;
+};
+
+/**
+ * Write the blocks of chain to archive_dir in strict height order: blk?????.dat files with
+ * the usual magic / size / block records, rev?????.dat files with the undo records of the
+ * same blocks, and ARCHIVE_INDEX_NAME, which maps every height to (file, offset, size).
+ * Every block header is checked against the index entry while it is copied. The sidecar is
+ * written last and renamed into place, so an interrupted export leaves no usable archive.
+ * archive_dir must not be a blocks dir (one holding an index database): its blk / rev files
+ * are deleted first.
+ */
+bool ExportArchive(BlockManager& blockman, const CChain& chain, const std::string& archive_dir, const ArchiveOptions& options = ArchiveOptions());
+
+/**
+ * Build the block index of an archive from its sidecar alone, without LevelDB: every height
+ * gets a CBlockIndex in the (empty) mapBlockIndex whose nFile / nDataPos / nUndoPos point
+ * into the archive files, so a BlockManager on archive_dir reads them like a blocks dir.
+ * The computed fields (nChainWork, nTimeMax, nChainTx, pskip) are filled in, every header
+ * must link to the previous height and height 0 must be the genesis block of chainparams.
+ * vSortedByHeight receives the entries, vSortedByHeight[h] being height h.
+ */
+bool LoadArchiveIndex(const std::string& archive_dir, const CChainParams& chainparams, CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight);
+
+#endif
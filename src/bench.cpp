@@ -0,0 +1,538 @@
+// hzx 基准测试程序, 与 main.cpp 一样由 VS Code 的 Build 任务编译(打开本文件编译, 生成 bench.out),
+// 或使用 "Bench" 任务以 -O2 编译.
+//
+// 所有输入都由固定种子生成, 每个测试每轮执行固定次数的操作, 结果以 JSON 写出, 便于在不同版本之间对比.
+//
+// 参数:
+//   -filter=<子串>   只运行名字包含该子串的测试
+//   -runs=<n>        每个测试计时的轮数, 默认 5
+//   -output=<文件>   JSON 输出文件, 默认 bench.json; "-" 表示标准输出
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "arith_uint256.h"
+#include "block.h"
+#include "blockIndexMap.h"
+#include "blockIndexLink.h"
+#include "blockView.h"
+#include "chain.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "merkle.h"
+#include "params.h"
+#include "sha256.h"
+#include "streams.h"
+#include "txdb.h"
+
+using namespace std;
+
+namespace
+{
+
+//! 防止编译器把被测代码优化掉
+volatile uint64_t g_sink = 0;
+
+void Consume(const uint256 &hash) { g_sink += ReadLE64(hash.begin()); }
+
+struct BenchResult
+{
+    string name;
+    uint64_t nOpsPerRun;
+    uint64_t nBytesPerOp;
+    vector<double> vNsPerOp;
+};
+
+class CBenchRunner
+{
+private:
+    string m_filter;
+    int m_runs;
+    vector<BenchResult> m_results;
+
+public:
+    CBenchRunner(const string &filter, int runs) : m_filter(filter), m_runs(runs) {}
+
+    bool Enabled(const string &name) const { return m_filter.empty() || name.find(m_filter) != string::npos; }
+
+    /**
+     * 运行 fn m_runs 轮并计时, fn 每次调用执行 nOps 次被测操作. 计时前先运行一轮预热.
+     * nBytesPerOp 非零时结果中额外给出吞吐量.
+     */
+    void Run(const string &name, uint64_t nOps, const function<void()> &fn, uint64_t nBytesPerOp = 0)
+    {
+        if (!Enabled(name))
+            return;
+        BenchResult result{name, nOps, nBytesPerOp, {}};
+        fn();
+        for (int i = 0; i < m_runs; i++)
+        {
+            const auto start = chrono::steady_clock::now();
+            fn();
+            const auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+            result.vNsPerOp.push_back(double(elapsed.count()) / nOps);
+        }
+        sort(result.vNsPerOp.begin(), result.vNsPerOp.end());
+        fprintf(stderr, "%-48s %14.1f ns/op\n", name.data(), result.vNsPerOp[result.vNsPerOp.size() / 2]);
+        m_results.push_back(std::move(result));
+    }
+
+    string ToJSON(const string &sha256_impl) const
+    {
+        string ret = "{\n";
+        ret += "  \"sha256\": \"" + sha256_impl + "\",\n";
+        ret += "  \"runs\": " + to_string(m_runs) + ",\n";
+        ret += "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            const BenchResult &r = m_results[i];
+            const double median = r.vNsPerOp[r.vNsPerOp.size() / 2];
+            char buf[512];
+            snprintf(buf, sizeof(buf), "    {\"name\": \"%s\", \"ops_per_run\": %lu, \"ns_per_op_min\": %.2f, \"ns_per_op_median\": %.2f, \"ns_per_op_max\": %.2f",
+                     r.name.data(), (unsigned long)r.nOpsPerRun, r.vNsPerOp.front(), median, r.vNsPerOp.back());
+            ret += buf;
+            if (r.nBytesPerOp)
+            {
+                snprintf(buf, sizeof(buf), ", \"mb_per_s\": %.2f", r.nBytesPerOp * 1e3 / median);
+                ret += buf;
+            }
+            ret += i + 1 < m_results.size() ? "},\n" : "}\n";
+        }
+        ret += "  ]\n}\n";
+        return ret;
+    }
+};
+
+vector<unsigned char> RandomBytes(mt19937_64 &rng, size_t n)
+{
+    vector<unsigned char> ret(n);
+    for (unsigned char &c : ret)
+        c = rng();
+    return ret;
+}
+
+uint256 RandomHash(mt19937_64 &rng)
+{
+    uint256 ret;
+    for (unsigned char *p = ret.begin(); p != ret.end(); p++)
+        *p = rng();
+    return ret;
+}
+
+/** 分别在每一种可用的 SHA256 实现上测试 CSHA256, SHA256D64 与 SHA256DBatch */
+void BenchSHA256(CBenchRunner &runner, mt19937_64 &rng)
+{
+    const vector<unsigned char> data = RandomBytes(rng, 1 << 20);
+    vector<unsigned char> out(32 * 1024);
+    vector<const unsigned char *> vInput(1024);
+    vector<size_t> vLen(1024, 250);
+    for (size_t i = 0; i < vInput.size(); i++)
+        vInput[i] = data.data() + 250 * i;
+
+    static const sha256_implementation::UseImplementation implementations[] = {
+        sha256_implementation::STANDARD,
+        sha256_implementation::USE_SSE4,
+        sha256_implementation::USE_SSE4_AND_AVX2,
+        sha256_implementation::USE_SSE4_AND_SHANI,
+    };
+    vector<string> vSeen;
+    for (sha256_implementation::UseImplementation impl : implementations)
+    {
+        const string name = SHA256AutoDetect(impl);
+        if (find(vSeen.begin(), vSeen.end(), name) != vSeen.end())
+            continue;
+        vSeen.push_back(name);
+
+        runner.Run("SHA256_1MiB[" + name + "]", 16, [&] {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            for (int i = 0; i < 16; i++)
+            {
+                CSHA256().Write(data.data(), data.size()).Finalize(hash);
+                g_sink += hash[0];
+            } }, data.size());
+        runner.Run("SHA256D64_1024[" + name + "]", 256, [&] {
+            for (int i = 0; i < 256; i++)
+            {
+                SHA256D64(out.data(), data.data() + 64 * 1024 * (i & 7), 1024);
+                g_sink += out[0];
+            } }, 64 * 1024);
+        runner.Run("SHA256DBatch_1024x250[" + name + "]", 64, [&] {
+            for (int i = 0; i < 64; i++)
+            {
+                SHA256DBatch(out.data(), vInput.data(), vLen.data(), vInput.size());
+                g_sink += out[0];
+            } }, 250 * 1024);
+    }
+    SHA256AutoDetect();
+}
+
+void BenchMerkle(CBenchRunner &runner, mt19937_64 &rng)
+{
+    for (size_t nLeaves : {1, 100, 2000, 10000})
+    {
+        vector<uint256> leaves(nLeaves);
+        for (uint256 &leaf : leaves)
+            leaf = RandomHash(rng);
+        // 每轮大约处理 20 万个叶子
+        const uint64_t nOps = max<size_t>(1, 200000 / nLeaves);
+        runner.Run("ComputeMerkleRoot_" + to_string(nLeaves), nOps, [&] {
+            for (uint64_t i = 0; i < nOps; i++)
+            {
+                bool mutated = false;
+                Consume(ComputeMerkleRoot(leaves, &mutated));
+            } });
+    }
+}
+
+/** 约 1MB 的合成区块: 2000 笔交易, 每三笔中有一笔带见证数据 */
+CBlock MakeSyntheticBlock(mt19937_64 &rng)
+{
+    CBlock block;
+    block.nVersion = 0x20000000;
+    block.hashPrevBlock = RandomHash(rng);
+    block.nTime = 1600000000;
+    block.nBits = 0x207fffff;
+    for (int t = 0; t < 2000; t++)
+    {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        const int nIn = 1 + rng() % 3, nOut = 1 + rng() % 3;
+        for (int i = 0; i < nIn; i++)
+        {
+            CTxIn in(RandomHash(rng), rng() % 4);
+            if (t % 3 == 0)
+            {
+                in.scriptWitness.stack.push_back(RandomBytes(rng, 72));
+                in.scriptWitness.stack.push_back(RandomBytes(rng, 33));
+            }
+            else
+            {
+                in.scriptSig = CScript() << RandomBytes(rng, 72) << RandomBytes(rng, 33);
+            }
+            mtx.vin.push_back(in);
+        }
+        for (int i = 0; i < nOut; i++)
+            mtx.vout.emplace_back(rng() % 100000000, CScript() << OP_DUP << OP_HASH160 << RandomBytes(rng, 20) << OP_EQUALVERIFY << OP_CHECKSIG);
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+void BenchDeserializeBlock(CBenchRunner &runner, mt19937_64 &rng)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << MakeSyntheticBlock(rng);
+    const vector<unsigned char> data(ssBlock.begin(), ssBlock.end());
+
+    runner.Run("CBlockDeserialize", 20, [&] {
+        CDataStream stream(data, SER_DISK, CLIENT_VERSION);
+        char a = '\0';
+        stream.write(&a, 1); // Prevent compaction
+        for (int i = 0; i < 20; i++)
+        {
+            CBlock block;
+            stream >> block;
+            Consume(block.vtx.back()->GetHash());
+            stream.Rewind(data.size());
+        } }, data.size());
+    runner.Run("CBlockDeserializeBatchHash", 20, [&] {
+        for (int i = 0; i < 20; i++)
+        {
+            CBlock block;
+            SpanReader reader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(data.data(), data.size()));
+            UnserializeBlockBatchHash(reader, block);
+            Consume(block.vtx.back()->GetHash());
+        } }, data.size());
+
+    // 只建立偏移表, 视图在各轮之间复用
+    CBlockView view;
+    runner.Run("CBlockViewParse", 200, [&] {
+        for (int i = 0; i < 200; i++)
+        {
+            view.Parse(Span<const unsigned char>(data.data(), data.size()));
+            g_sink += view.GetTx(view.GetTxCount() - 1).GetOutput(0).GetValue();
+        } }, data.size());
+    vector<uint256> vHash;
+    runner.Run("CBlockViewParseBatchHash", 20, [&] {
+        for (int i = 0; i < 20; i++)
+        {
+            view.Parse(Span<const unsigned char>(data.data(), data.size()));
+            view.GetTxHashes(vHash);
+            Consume(vHash.back());
+        } }, data.size());
+}
+
+/** 在 memenv LevelDB 中写入 nBlocks 个区块索引(一条链, 区块头满足 0x207fffff 的难度) */
+void FillSyntheticBlockTree(CBlockTreeDB &db, int nBlocks, mt19937_64 &rng)
+{
+    CDBBatch batch(db);
+    arith_uint256 target;
+    target.SetCompact(0x207fffff);
+    uint256 hashPrev;
+    for (int nHeight = 0; nHeight < nBlocks; nHeight++)
+    {
+        CBlockIndex index;
+        index.nHeight = nHeight;
+        index.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA;
+        index.nTx = 1 + rng() % 3000;
+        index.nFile = nHeight / 1000;
+        index.nDataPos = 8 + (nHeight % 1000) * 1000;
+        index.nVersion = 0x20000000;
+        index.hashMerkleRoot = RandomHash(rng);
+        index.nTime = 1600000000 + 600 * nHeight;
+        index.nBits = 0x207fffff;
+        CDiskBlockIndex diskindex(&index);
+        diskindex.hashPrev = hashPrev;
+        uint256 hash;
+        for (index.nNonce = 0;; index.nNonce++)
+        {
+            diskindex.nNonce = index.nNonce;
+            hash = diskindex.GetBlockHash();
+            if (UintToArith256(hash) <= target)
+                break;
+        }
+        batch.Write(make_pair(DB_BLOCK_INDEX, hash), diskindex);
+        if (batch.SizeEstimate() > (1 << 24))
+        {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+        hashPrev = hash;
+    }
+    db.WriteBatch(batch);
+}
+
+void BenchLoadBlockIndex(CBenchRunner &runner, mt19937_64 &rng)
+{
+    static const int N_BLOCKS = 100000;
+    if (!runner.Enabled("LoadBlockIndexGuts"))
+        return;
+    Consensus::Params consensus;
+    consensus.powLimit = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    CBlockTreeDB db("bench_block_index", 64 << 20, true, false);
+    FillSyntheticBlockTree(db, N_BLOCKS, rng);
+
+    vector<int> vThreads{1};
+    if (thread::hardware_concurrency() > 1)
+        vThreads.push_back(thread::hardware_concurrency());
+    for (int nThreads : vThreads)
+    {
+        runner.Run("LoadBlockIndexGuts_100k_" + to_string(nThreads) + "thread", N_BLOCKS, [&] {
+            CBlockIndexMap mapBlockIndex;
+            auto insert = [&](const uint256 &hash) -> CBlockIndex * {
+                return hash.IsNull() ? nullptr : mapBlockIndex.Insert(hash);
+            };
+            if (!db.LoadBlockIndexGuts(consensus, insert, nThreads) || mapBlockIndex.size() != (size_t)N_BLOCKS)
+                fprintf(stderr, "LoadBlockIndexGuts failed\n");
+            g_sink += mapBlockIndex.size();
+        });
+    }
+}
+
+void BenchGetAncestor(CBenchRunner &runner, mt19937_64 &rng)
+{
+    static const int N_BLOCKS = 1000000;
+    static const int N_QUERIES = 1000000;
+    if (!runner.Enabled("GetAncestor"))
+        return;
+    vector<CBlockIndex> vChain(N_BLOCKS);
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        vChain[i].nHeight = i;
+        vChain[i].pprev = i ? &vChain[i - 1] : nullptr;
+        vChain[i].BuildSkip();
+    }
+    vector<pair<int, int>> vQueries(N_QUERIES);
+    for (pair<int, int> &query : vQueries)
+    {
+        query.first = rng() % N_BLOCKS;
+        query.second = rng() % (query.first + 1);
+    }
+    runner.Run("GetAncestor_1M_chain", N_QUERIES, [&] {
+        for (const pair<int, int> &query : vQueries)
+            g_sink += vChain[query.first].GetAncestor(query.second)->nHeight;
+    });
+}
+
+void BenchLinkBlockIndex(CBenchRunner &runner, mt19937_64 &rng)
+{
+    static const int N_BLOCKS = 1000000;
+    if (!runner.Enabled("LinkBlockIndex"))
+        return;
+    // 一条主链, 约每 100 个区块有一个长度为 1 的分叉, 难度每 2016 个区块变化一次
+    CBlockIndexMap mapBlockIndex;
+    mapBlockIndex.Reserve(N_BLOCKS);
+    CBlockIndex *pindexTip = nullptr;
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        uint256 hash;
+        for (int j = 0; j < 4; j++)
+            WriteLE64(hash.begin() + 8 * j, rng());
+        CBlockIndex *pindex = mapBlockIndex.Insert(hash);
+        const bool fFork = pindexTip && pindexTip->pprev && rng() % 100 == 0;
+        pindex->pprev = fFork ? pindexTip->pprev : pindexTip;
+        pindex->nHeight = pindex->pprev ? pindex->pprev->nHeight + 1 : 0;
+        pindex->nBits = 0x1d00ffff - (pindex->nHeight / 2016) % 64;
+        pindex->nTime = 1600000000 + 600 * pindex->nHeight;
+        pindex->nTx = 1 + rng() % 3000;
+        if (!fFork)
+            pindexTip = pindex;
+    }
+
+    // 原来的做法: 按 (高度, 指针) 排序后逐个由 pprev 推出
+    runner.Run("LinkBlockIndex_1M_serial", N_BLOCKS, [&] {
+        vector<pair<int, CBlockIndex *>> vSortedByHeight;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for (CBlockIndex *pindex : mapBlockIndex)
+            vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        for (const pair<int, CBlockIndex *> &item : vSortedByHeight)
+        {
+            CBlockIndex *pindex = item.second;
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+            pindex->nTimeMax = (pindex->pprev ? max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            if (pindex->pprev)
+                pindex->BuildSkip();
+        }
+        g_sink += pindexTip->nChainTx;
+    });
+    vector<int> vThreads{1};
+    if (thread::hardware_concurrency() > 1)
+        vThreads.push_back(thread::hardware_concurrency());
+    for (int nThreads : vThreads)
+    {
+        runner.Run("LinkBlockIndex_1M_" + to_string(nThreads) + "thread", N_BLOCKS, [&] {
+            vector<CBlockIndex *> vSortedByHeight;
+            SortBlockIndexByHeight(mapBlockIndex, vSortedByHeight);
+            LinkBlockIndex(MakeSpan(vSortedByHeight), nThreads);
+            g_sink += pindexTip->nChainTx;
+        });
+    }
+}
+
+void BenchBlockHashLookup(CBenchRunner &runner, mt19937_64 &rng)
+{
+    static const int N_BLOCKS = 1000000;
+    static const int N_QUERIES = 1000000;
+    if (!runner.Enabled("Lookup"))
+        return;
+    CBlockIndexMap mapBlockIndex;
+    mapBlockIndex.Reserve(N_BLOCKS);
+    vector<uint256> vHashes(N_BLOCKS);
+    for (uint256 &hash : vHashes)
+    {
+        for (int i = 0; i < 4; i++)
+            WriteLE64(hash.begin() + 8 * i, rng());
+        mapBlockIndex.Insert(hash);
+    }
+    // 一半查询命中, 一半是不存在的哈希
+    vector<uint256> vQueries(N_QUERIES);
+    for (size_t i = 0; i < vQueries.size(); i++)
+    {
+        if (i % 2)
+            vQueries[i] = vHashes[rng() % N_BLOCKS];
+        else
+            for (int j = 0; j < 4; j++)
+                WriteLE64(vQueries[i].begin() + 8 * j, rng());
+    }
+    runner.Run("BlockIndexMapLookup_1M", N_QUERIES, [&] {
+        for (const uint256 &hash : vQueries)
+            g_sink += (uintptr_t)mapBlockIndex.Find(hash);
+    });
+    const CFrozenBlockIndex frozen(mapBlockIndex);
+    runner.Run("FrozenBlockIndexLookup_1M", N_QUERIES, [&] {
+        for (const uint256 &hash : vQueries)
+            g_sink += (uintptr_t)frozen.Find(hash);
+    });
+    vector<CBlockIndex *> vResult;
+    runner.Run("FrozenBlockIndexLookupMany_1M", N_QUERIES, [&] {
+        frozen.FindMany(MakeSpan(vQueries), vResult);
+        g_sink += (uintptr_t)vResult.back();
+    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    string filter, output = "bench.json";
+    int runs = 5;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        if (arg.compare(0, 8, "-filter=") == 0)
+            filter = arg.substr(8);
+        else if (arg.compare(0, 6, "-runs=") == 0)
+            runs = max(1, atoi(arg.substr(6).c_str()));
+        else if (arg.compare(0, 8, "-output=") == 0)
+            output = arg.substr(8);
+        else
+        {
+            fprintf(stderr, "usage: %s [-filter=<substring>] [-runs=<n>] [-output=<file>|-]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 其他模块的诊断信息经 BCLog::Logger 的写线程输出到 stdout, 测试期间把 stdout 重定向到 /dev/null 丢弃, 结果只写到 JSON 与 stderr
+    FILE *json_out = output == "-" ? fdopen(dup(fileno(stdout)), "w") : fopen(output.data(), "w");
+    if (!json_out)
+    {
+        fprintf(stderr, "无法写入 %s\n", output.data());
+        return 1;
+    }
+    fflush(stdout);
+    if (!freopen("/dev/null", "w", stdout))
+        fprintf(stderr, "无法重定向标准输出\n");
+
+    const string sha256_impl = SHA256AutoDetect();
+    CBenchRunner runner(filter, runs);
+    // 每个测试使用独立的固定种子, 单独运行某个测试时输入不变
+    {
+        mt19937_64 rng(1);
+        BenchSHA256(runner, rng);
+    }
+    {
+        mt19937_64 rng(2);
+        BenchMerkle(runner, rng);
+    }
+    {
+        mt19937_64 rng(3);
+        BenchDeserializeBlock(runner, rng);
+    }
+    {
+        mt19937_64 rng(4);
+        BenchLoadBlockIndex(runner, rng);
+    }
+    {
+        mt19937_64 rng(5);
+        BenchGetAncestor(runner, rng);
+    }
+    {
+        mt19937_64 rng(6);
+        BenchBlockHashLookup(runner, rng);
+    }
+    {
+        mt19937_64 rng(7);
+        BenchLinkBlockIndex(runner, rng);
+    }
+
+    const string json = runner.ToJSON(sha256_impl);
+    const bool ok = fputs(json.data(), json_out) >= 0;
+    if (fclose(json_out) != 0 || !ok)
+    {
+        fprintf(stderr, "无法写入 %s\n", output.data());
+        return 1;
+    }
+    if (output != "-")
+        fprintf(stderr, "结果已写入 %s\n", output.data());
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "blkMmap.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.h"
+#include "logging.h"
+#include "serialize.h"
+#include "trace.h"
+
+std::string GetBlockFilePath(const std::string& dir, const char* prefix, int nFile)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%s%05u.dat", prefix, nFile);
+    return dir + name;
+}
+
+CMappedFile::CMappedFile(const std::string& path) : m_data(nullptr), m_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        // hzx 调用方会报告自己的错误; 快照等可选文件不存在是正常情况
+        LogDebug(BCLog::IO, "%s: 文件打开失败 %s \n", __func__, path.data());
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            m_data = static_cast<unsigned char*>(p);
+            m_size = st.st_size;
+        }
+        else
+        {
+            LogError("%s: mmap 失败 %s: %s\n", __func__, path.data(), strerror(errno));
+        }
+    }
+    // hzx 映射建立之后即可关闭文件描述符, 映射本身保持有效
+    close(fd);
+}
+
+CMappedFile::~CMappedFile()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool CMappedFile::GetRecord(unsigned int nPos, const CMessageHeader::MessageStartChars& messageStart, Span<const unsigned char>& record) const
+{
+    const size_t header_size = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (m_data == nullptr || nPos < header_size || nPos > m_size)
+        return false;
+    const unsigned char* header = m_data + nPos - header_size;
+    if (memcmp(header, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+        return false;
+    uint32_t nSize = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (nSize > MAX_SIZE || nSize > m_size - nPos)
+        return false;
+    record = Span<const unsigned char>(m_data + nPos, nSize);
+    return true;
+}
+
+void CMappedFile::Prefetch(size_t nPos, size_t nLen) const
+{
+    if (m_data == nullptr || nPos >= m_size || nLen == 0)
+        return;
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t nBegin = nPos - nPos % page_size;
+    size_t nEnd = std::min(nPos + nLen, m_size);
+    madvise(m_data + nBegin, nEnd - nBegin, MADV_WILLNEED);
+}
+
+CMappedFileCache::CMappedFileCache(const std::string& dir, const std::string& prefix, size_t max_files)
+    : m_dir(dir), m_prefix(prefix), m_max_files(std::max<size_t>(max_files, 1))
+{
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(int nFile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(nFile);
+    if (it != m_files.end())
+    {
+        // 命中, 移到 LRU 队首
+        m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+        return it->second.first;
+    }
+
+    TRACE_SPAN("MapFile", -1, nFile);
+    std::shared_ptr<const CMappedFile> file = std::make_shared<const CMappedFile>(GetBlockFilePath(m_dir, m_prefix.c_str(), nFile));
+    if (file->IsNull())
+        return nullptr;
+
+    while (m_files.size() >= m_max_files)
+    {
+        m_files.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+    m_lru.push_front(nFile);
+    m_files.emplace(nFile, Entry(file, m_lru.begin()));
+    return file;
+}
+
+void CMappedFileCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_files.clear();
+    m_lru.clear();
+}
+
+size_t CMappedFileCache::MappedBytes()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t nBytes = 0;
+    for (const auto& item : m_files)
+        nBytes += item.second.first->size();
+    return nBytes;
+}
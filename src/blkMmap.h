@@ -0,0 +1,87 @@
+#ifndef BLOCKCHAIN_BLKMMAP_H
+#define BLOCKCHAIN_BLKMMAP_H
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "protocol.h"
+#include "span.h"
+
+//! Default number of blk?????.dat files kept mapped at the same time
+static const size_t DEFAULT_MAX_MAPPED_FILES = 64;
+
+/** Build the path of a block storage file, e.g. <dir>/blk00042.dat or <dir>/rev00042.dat. */
+std::string GetBlockFilePath(const std::string& dir, const char* prefix, int nFile);
+
+/** Read-only memory mapping of one whole block storage file.
+ *
+ *  The mapping is created once and released when the last reference goes away,
+ *  so callers holding a shared_ptr may keep using spans into it even after the
+ *  cache has evicted the file.
+ */
+class CMappedFile
+{
+private:
+    unsigned char* m_data;
+    size_t m_size;
+
+public:
+    explicit CMappedFile(const std::string& path);
+    ~CMappedFile();
+
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    bool IsNull() const { return m_data == nullptr; }
+
+    size_t size() const { return m_size; }
+
+    Span<const unsigned char> GetSpan() const { return Span<const unsigned char>(m_data, m_size); }
+
+    /**
+     * Locate the record stored at nPos, which is preceded on disk by the network
+     * magic and a 4-byte little-endian length (the layout used by blk/rev files).
+     * Returns false if the magic does not match or the record runs past the end of the file.
+     */
+    bool GetRecord(unsigned int nPos, const CMessageHeader::MessageStartChars& messageStart, Span<const unsigned char>& record) const;
+
+    /** Hint the kernel that [nPos, nPos + nLen) will be read soon. */
+    void Prefetch(size_t nPos, size_t nLen) const;
+};
+
+/** LRU cache of mapped block storage files, addressed by file number (CBlockIndex::nFile). */
+class CMappedFileCache
+{
+private:
+    typedef std::list<int> LruList;
+    typedef std::pair<std::shared_ptr<const CMappedFile>, LruList::iterator> Entry;
+
+    const std::string m_dir;
+    const std::string m_prefix;
+    const size_t m_max_files;
+
+    std::mutex m_mutex;
+    //! most recently used file number at the front
+    LruList m_lru;
+    std::unordered_map<int, Entry> m_files;
+
+public:
+    CMappedFileCache(const std::string& dir, const std::string& prefix = "blk", size_t max_files = DEFAULT_MAX_MAPPED_FILES);
+
+    CMappedFileCache(const CMappedFileCache&) = delete;
+    CMappedFileCache& operator=(const CMappedFileCache&) = delete;
+
+    /** Return the mapping of file nFile, mapping it on first use. Returns nullptr if the file cannot be mapped. */
+    std::shared_ptr<const CMappedFile> Get(int nFile);
+
+    /** Drop every cached mapping (mappings still referenced by callers stay alive). */
+    void Clear();
+
+    //! bytes of address space held by the cached mappings (resident only as far as the pages were read)
+    size_t MappedBytes();
+
+    const std::string& GetDir() const { return m_dir; }
+};
+
+#endif
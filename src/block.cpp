@@ -8,6 +8,8 @@
 
 #include "common.h"
 #include "hash.h"
+#include "sha256.h"
+#include "streams.h"
 #include "tinyformat.h"
 
 uint256 CBlockHeader::GetHash() const
@@ -30,3 +32,91 @@ std::string CBlock::ToString() const
     }
     return s.str();
 }
+
+void UnserializeBlockBatchHash(SpanReader& s, CBlock& block)
+{
+    block.SetNull();
+    s >> *static_cast<CBlockHeader*>(&block);
+    const uint64_t nTx = ReadCompactSize(s);
+
+    struct RawTx
+    {
+        const unsigned char* begin;
+        size_t nLen;
+        size_t nStrippedPos; // 去见证后的字节在 stripped 中的偏移, 无见证时不用
+        size_t nStrippedLen;
+    };
+    // 每笔交易至少 60 字节, 防止错误的数量导致过量分配
+    const size_t nReserve = std::min<uint64_t>(nTx, s.size() / 60 + 1);
+    std::vector<CMutableTransaction> vMutable;
+    std::vector<RawTx> vRaw;
+    vMutable.reserve(nReserve);
+    vRaw.reserve(nReserve);
+    std::vector<unsigned char> stripped;
+
+    // hzx 先只反序列化并记录每笔交易的原始字节. 无见证交易的原始字节就是 txid 的原像;
+    // 有见证交易去掉 marker/flag 与见证数据后才是 txid 的原像, 完整字节是 wtxid 的原像
+    for (uint64_t i = 0; i < nTx; i++)
+    {
+        const unsigned char* begin = s.data();
+        vMutable.emplace_back();
+        CMutableTransaction& mtx = vMutable.back();
+        UnserializeTransaction(mtx, s);
+        RawTx raw{begin, size_t(s.data() - begin), 0, 0};
+        if (mtx.HasWitness())
+        {
+            // nVersion | 00 01 | vin vout | witness | nLockTime
+            raw.nStrippedPos = stripped.size();
+            raw.nStrippedLen = GetSerializeSize(mtx, s.GetVersion() | SERIALIZE_TRANSACTION_NO_WITNESS);
+            stripped.insert(stripped.end(), begin, begin + 4);
+            stripped.insert(stripped.end(), begin + 6, begin + 6 + (raw.nStrippedLen - 8));
+            stripped.insert(stripped.end(), begin + raw.nLen - 4, begin + raw.nLen);
+        }
+        vRaw.push_back(raw);
+    }
+
+    // 前 nTx 个消息是 txid, 之后是有见证交易的 wtxid
+    std::vector<const unsigned char*> vInput;
+    std::vector<size_t> vLen;
+    vInput.reserve(nTx);
+    vLen.reserve(nTx);
+    for (const RawTx& raw : vRaw)
+    {
+        vInput.push_back(raw.nStrippedLen ? stripped.data() + raw.nStrippedPos : raw.begin);
+        vLen.push_back(raw.nStrippedLen ? raw.nStrippedLen : raw.nLen);
+    }
+    for (const RawTx& raw : vRaw)
+    {
+        if (raw.nStrippedLen)
+        {
+            vInput.push_back(raw.begin);
+            vLen.push_back(raw.nLen);
+        }
+    }
+    std::vector<uint256> vHash(vInput.size());
+    SHA256DBatch(vHash.empty() ? nullptr : vHash[0].begin(), vInput.data(), vLen.data(), vInput.size());
+
+    block.vtx.reserve(nTx);
+    size_t nWitness = nTx;
+    for (uint64_t i = 0; i < nTx; i++)
+    {
+        const uint256& hash = vHash[i];
+        const uint256& witnessHash = vRaw[i].nStrippedLen ? vHash[nWitness++] : hash;
+        block.vtx.push_back(std::make_shared<const CTransaction>(std::move(vMutable[i]), hash, witnessHash));
+    }
+}
+
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes)
+{
+    static const size_t HEADER_SIZE = 80;
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss.reserve(headers.size() * HEADER_SIZE);
+    for (const CBlockHeader& header : headers)
+        ss << header;
+    std::vector<const unsigned char*> vInput(headers.size());
+    std::vector<size_t> vLen(headers.size(), HEADER_SIZE);
+    for (size_t i = 0; i < headers.size(); i++)
+        vInput[i] = (const unsigned char*)ss.data() + i * HEADER_SIZE;
+    hashes.resize(headers.size());
+    SHA256DBatch(hashes.empty() ? nullptr : hashes[0].begin(), vInput.data(), vLen.data(), headers.size());
+}
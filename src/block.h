@@ -121,6 +121,17 @@ public:
     std::string ToString() const;
 };
 
+class SpanReader;
+
+/**
+ * Same result as s >> block, but the txids and wtxids of all transactions are
+ * computed together with SHA256DBatch instead of one hash per transaction.
+ */
+void UnserializeBlockBatchHash(SpanReader& s, CBlock& block);
+
+/** Set hashes[i] to headers[i].GetHash(), hashing the headers in lanes. */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -0,0 +1,308 @@
+#include "blockIO.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "logging.h"
+
+namespace
+{
+/**
+ * io_uring without liburing: the submission and completion rings are mapped from the ring fd
+ * and driven with io_uring_enter. One batch runs at a time; up to the ring size reads are in
+ * flight and a short read is resubmitted for its remainder.
+ */
+class CUringBackend : public CBlockIOBackend
+{
+private:
+    int m_fd = -1;
+    void* m_sq_ring = MAP_FAILED;
+    void* m_cq_ring = MAP_FAILED;
+    size_t m_sq_ring_size = 0, m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t m_sqes_size = 0;
+
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned* m_sq_array;
+    unsigned m_sq_entries;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    io_uring_cqe* m_cqes;
+
+    std::mutex m_mutex;
+
+    static int Setup(unsigned entries, io_uring_params* p) { return syscall(__NR_io_uring_setup, entries, p); }
+    int Enter(unsigned to_submit, unsigned min_complete)
+    {
+        return syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+
+public:
+    ~CUringBackend()
+    {
+        if (m_sqes != MAP_FAILED)
+            munmap(m_sqes, m_sqes_size);
+        if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+            munmap(m_cq_ring, m_cq_ring_size);
+        if (m_sq_ring != MAP_FAILED)
+            munmap(m_sq_ring, m_sq_ring_size);
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool Init(unsigned nDepth)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        m_fd = Setup(nDepth, &p);
+        if (m_fd < 0)
+        {
+            LogWarning("%s: io_uring_setup 失败: %s\n", __func__, strerror(errno));
+            return false;
+        }
+        m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        // hzx 5.4 之后的内核两个环共用一次映射
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ring == MAP_FAILED)
+            return false;
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            m_cq_ring = m_sq_ring;
+        else if ((m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+            return false;
+        m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED)
+            return false;
+
+        unsigned char* sq = (unsigned char*)m_sq_ring;
+        unsigned char* cq = (unsigned char*)m_cq_ring;
+        m_sq_head = (unsigned*)(sq + p.sq_off.head);
+        m_sq_tail = (unsigned*)(sq + p.sq_off.tail);
+        m_sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+        m_sq_array = (unsigned*)(sq + p.sq_off.array);
+        m_sq_entries = p.sq_entries;
+        m_cq_head = (unsigned*)(cq + p.cq_off.head);
+        m_cq_tail = (unsigned*)(cq + p.cq_off.tail);
+        m_cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    bool Read(Span<BlockIORequest> vRequests) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const size_t nCount = vRequests.size();
+        // 每个请求已读取的字节数; 读取不足时从这里继续提交剩余部分
+        std::vector<uint32_t> vDone(nCount, 0);
+        std::vector<iovec> vIov(nCount);
+        size_t nNext = 0, nInFlight = 0;
+        std::vector<size_t> vRetry;
+        while (nNext < nCount || !vRetry.empty() || nInFlight)
+        {
+            // 填满提交队列
+            unsigned tail = *m_sq_tail;
+            unsigned nQueued = 0;
+            while (nInFlight + nQueued < m_sq_entries && (!vRetry.empty() || nNext < nCount))
+            {
+                size_t i;
+                if (!vRetry.empty())
+                {
+                    i = vRetry.back();
+                    vRetry.pop_back();
+                }
+                else
+                    i = nNext++;
+                BlockIORequest& req = vRequests[i];
+                vIov[i].iov_base = req.pBuffer + vDone[i];
+                vIov[i].iov_len = req.nLen - vDone[i];
+                const unsigned idx = tail & m_sq_mask;
+                io_uring_sqe& sqe = m_sqes[idx];
+                memset(&sqe, 0, sizeof(sqe));
+                // READV 自 5.1 起可用, READ 要 5.6
+                sqe.opcode = IORING_OP_READV;
+                sqe.fd = req.fd;
+                sqe.off = req.nOffset + vDone[i];
+                sqe.addr = (uint64_t)(uintptr_t)&vIov[i];
+                sqe.len = 1;
+                sqe.user_data = i;
+                m_sq_array[idx] = idx;
+                tail++;
+                nQueued++;
+            }
+            if (nQueued)
+                __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+            nInFlight += nQueued;
+
+            // 内核上次可能只接受了一部分提交, 剩下的仍在 sq_head 与 tail 之间, 一起提交
+            const int ret = Enter(tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE), 1);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                LogError("%s: io_uring_enter 失败: %s\n", __func__, strerror(errno));
+                return false;
+            }
+
+            unsigned head = *m_cq_head;
+            while (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+            {
+                const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+                const size_t i = cqe.user_data;
+                head++;
+                nInFlight--;
+                BlockIORequest& req = vRequests[i];
+                if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+                    vRetry.push_back(i);
+                else if (cqe.res < 0)
+                    req.nResult = cqe.res;
+                else if (cqe.res > 0 && vDone[i] + cqe.res < req.nLen)
+                {
+                    vDone[i] += cqe.res;
+                    vRetry.push_back(i);
+                }
+                else
+                    req.nResult = vDone[i] + cqe.res;
+            }
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    const char* GetName() const override { return "io_uring"; }
+};
+
+/** Fallback: a fixed pool of threads, each doing one blocking pread at a time. */
+class CPreadBackend : public CBlockIOBackend
+{
+private:
+    std::vector<std::thread> m_threads;
+    //! serializes batches
+    std::mutex m_batch_mutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond_work;
+    std::condition_variable m_cond_done;
+    Span<BlockIORequest> m_requests;
+    std::atomic<size_t> m_next{0};
+    size_t m_done = 0;
+    //! workers inside Work(); a batch is only started and finished with none, so no worker sees a stale one
+    int m_active = 0;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    static void ReadOne(BlockIORequest& req)
+    {
+        uint32_t nDone = 0;
+        while (nDone < req.nLen)
+        {
+            const ssize_t n = pread(req.fd, req.pBuffer + nDone, req.nLen - nDone, req.nOffset + nDone);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                req.nResult = -errno;
+                return;
+            }
+            if (n == 0)
+                break;
+            nDone += n;
+        }
+        req.nResult = nDone;
+    }
+
+    //! take requests of the current batch until none are left; returns how many were done
+    size_t Work(Span<BlockIORequest> vRequests)
+    {
+        const size_t nCount = vRequests.size();
+        size_t nDone = 0;
+        for (size_t i = m_next++; i < nCount; i = m_next++, nDone++)
+            ReadOne(vRequests[i]);
+        return nDone;
+    }
+
+    void ThreadMain()
+    {
+        uint64_t nGeneration = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_cond_work.wait(lock, [&] { return m_stop || m_generation != nGeneration; });
+            if (m_stop)
+                return;
+            nGeneration = m_generation;
+            Span<BlockIORequest> vRequests = m_requests;
+            m_active++;
+            lock.unlock();
+            const size_t nDone = Work(vRequests);
+            lock.lock();
+            m_active--;
+            m_done += nDone;
+            if (m_active == 0)
+                m_cond_done.notify_all();
+        }
+    }
+
+public:
+    explicit CPreadBackend(unsigned int nThreads)
+    {
+        for (unsigned int i = 0; i < nThreads; i++)
+            m_threads.emplace_back(&CPreadBackend::ThreadMain, this);
+    }
+
+    ~CPreadBackend()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond_work.notify_all();
+        for (std::thread& t : m_threads)
+            t.join();
+    }
+
+    bool Read(Span<BlockIORequest> vRequests) override
+    {
+        std::lock_guard<std::mutex> batch_lock(m_batch_mutex);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond_done.wait(lock, [&] { return m_active == 0; });
+        m_requests = vRequests;
+        m_next = 0;
+        m_done = 0;
+        m_generation++;
+        m_cond_work.notify_all();
+        const size_t nCount = vRequests.size();
+        m_cond_done.wait(lock, [&] { return m_done == nCount && m_active == 0; });
+        return true;
+    }
+
+    const char* GetName() const override { return "pread"; }
+};
+} // namespace
+
+std::unique_ptr<CBlockIOBackend> MakeBlockIOBackend(unsigned int nDepth, bool fAllowUring)
+{
+    nDepth = std::max(nDepth, 1u);
+    if (fAllowUring)
+    {
+        std::unique_ptr<CUringBackend> uring(new CUringBackend());
+        if (uring->Init(nDepth))
+            return uring;
+        LogWarning("%s: io_uring 不可用, 改用 pread 线程池\n", __func__);
+    }
+    return std::unique_ptr<CBlockIOBackend>(new CPreadBackend(std::min(nDepth, MAX_BLOCK_IO_THREADS)));
+}
@@ -0,0 +1,49 @@
+#ifndef BLOCKCHAIN_BLOCKIO_H
+#define BLOCKCHAIN_BLOCKIO_H
+#include <memory>
+#include <stdint.h>
+#include "span.h"
+
+//! Reads a CBlockIOBackend keeps in flight at once (io_uring entries / pread threads)
+static const unsigned int DEFAULT_BLOCK_IO_DEPTH = 64;
+//! Upper bound of the pread fallback's thread pool
+static const unsigned int MAX_BLOCK_IO_THREADS = 32;
+
+/** One positioned read of nLen bytes at nOffset of fd into pBuffer. */
+struct BlockIORequest
+{
+    int fd;
+    uint64_t nOffset;
+    uint32_t nLen;
+    unsigned char* pBuffer;
+    //! bytes read (less than nLen only at end of file) or -errno
+    int64_t nResult;
+};
+
+/**
+ * Performs a batch of positioned reads with many of them outstanding at once, so random
+ * block lookups on a cold page cache use the queue depth of the device instead of waiting
+ * for one read at a time. Read may be called from several threads; batches are serialized.
+ */
+class CBlockIOBackend
+{
+public:
+    virtual ~CBlockIOBackend() {}
+
+    /**
+     * Perform every request of vRequests, continuing short reads. Per-request errors are
+     * reported in nResult; returns false only if the backend itself failed.
+     */
+    virtual bool Read(Span<BlockIORequest> vRequests) = 0;
+
+    virtual const char* GetName() const = 0;
+};
+
+/**
+ * Create the backend for nDepth outstanding reads: io_uring, driven through the raw
+ * io_uring_setup / io_uring_enter syscalls (no liburing), if the kernel provides it and
+ * fAllowUring is set, otherwise a pool of threads issuing pread.
+ */
+std::unique_ptr<CBlockIOBackend> MakeBlockIOBackend(unsigned int nDepth = DEFAULT_BLOCK_IO_DEPTH, bool fAllowUring = true);
+
+#endif
@@ -0,0 +1,237 @@
+#include "blockIndexLink.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include "arith_uint256.h"
+#include "scheduler.h"
+#include "trace.h"
+
+namespace
+{
+/** Final values of an entry at the highest height of a range, the base of the next range. */
+struct CResolvedEntry
+{
+    const CBlockIndex* pindex;
+    arith_uint256 nChainWork;
+    unsigned int nTimeMax;
+    unsigned int nChainTx;
+};
+
+/** The entries [nBegin, nEnd) of vSortedByHeight, covering whole heights; the highest one starts at nLastLevel. */
+struct CLinkRange
+{
+    size_t nBegin, nEnd, nLastLevel;
+    std::vector<CResolvedEntry> vLastLevel;
+    CBlockIndex* pindexBest = nullptr;
+    //! entries not on the chain with the most work, in height order
+    std::vector<CBlockIndex*> vOffMain;
+};
+
+// 第一遍: 计算 [nBegin, nEnd) 中每个区块相对于"基"的值, 基是该区块在本段之下最近的祖先(段内最低高度区块的 pprev),
+// 暂存在 pskip 中. 只有一段时基总是 nullptr, 算出的就是最终值. pprev 的高度不连续时返回 false
+bool LinkLocal(Span<CBlockIndex* const> vSorted, size_t nBegin, size_t nEnd)
+{
+    const int nFirstHeight = vSorted[nBegin]->nHeight;
+    bool fRegular = true;
+    bool fHaveProof = false;
+    uint32_t nBits = 0;
+    arith_uint256 proof;
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        CBlockIndex* pindex = vSorted[i];
+        CBlockIndex* pprev = pindex->pprev;
+        if (pprev && pprev->nHeight + 1 != pindex->nHeight)
+            fRegular = false;
+        // hzx 难度每 2016 个区块才调整一次, 相同 nBits 的工作量不必重复做 256 位除法
+        if (!fHaveProof || pindex->nBits != nBits)
+        {
+            proof = GetBlockProof(*pindex);
+            nBits = pindex->nBits;
+            fHaveProof = true;
+        }
+        const bool fInRange = pprev && pprev->nHeight >= nFirstHeight;
+        pindex->pskip = fInRange ? pprev->pskip : pprev;
+        pindex->nChainWork = (fInRange ? pprev->nChainWork : 0) + proof;
+        pindex->nTimeMax = fInRange ? std::max(pprev->nTimeMax, pindex->nTime) : pindex->nTime;
+        // We can link the chain of blocks for which we've received transactions at some point.
+        if (pindex->nTx == 0)
+            pindex->nChainTx = 0;
+        else if (fInRange)
+            pindex->nChainTx = pprev->nChainTx ? pprev->nChainTx + pindex->nTx : 0;
+        else
+            pindex->nChainTx = pindex->nTx;
+    }
+    return fRegular;
+}
+
+// 把 pindex 相对于基的值接到基的最终值之后; pbase 为 nullptr 时 pindex 的值已是最终值
+CResolvedEntry Resolve(const CBlockIndex* pindex, const CResolvedEntry* pbase)
+{
+    CResolvedEntry entry{pindex, pindex->nChainWork, pindex->nTimeMax, pindex->nChainTx};
+    if (pbase)
+    {
+        entry.nChainWork += pbase->nChainWork;
+        entry.nTimeMax = std::max(entry.nTimeMax, pbase->nTimeMax);
+        entry.nChainTx = entry.nChainTx && pbase->nChainTx ? entry.nChainTx + pbase->nChainTx : 0;
+    }
+    return entry;
+}
+
+// 在上一段最高高度的区块中找到基; 每个高度通常只有一两个区块
+const CResolvedEntry* FindBase(const std::vector<CResolvedEntry>& vLastLevel, const CBlockIndex* pbase)
+{
+    if (!pbase)
+        return nullptr;
+    for (const CResolvedEntry& entry : vLastLevel)
+        if (entry.pindex == pbase)
+            return &entry;
+    assert(!"base of a range is not at the highest height of the previous range");
+    return nullptr;
+}
+
+void LinkSerial(Span<CBlockIndex* const> vSorted)
+{
+    TRACE_SPAN("LinkSerial");
+    if (vSorted.size() == 0)
+        return;
+    LinkLocal(vSorted, 0, vSorted.size());
+    for (CBlockIndex* pindex : vSorted)
+    {
+        pindex->pskip = nullptr;
+        pindex->BuildSkip();
+    }
+}
+} // namespace
+
+void SortBlockIndexByHeight(const CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight)
+{
+    TRACE_SPAN("SortBlockIndexByHeight");
+    vSortedByHeight.clear();
+    int nMaxHeight = -1;
+    for (const CBlockIndex* pindex : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, pindex->nHeight);
+    // hzx vStart[h] 先是高度 h 的区块数, 前缀和之后是高度 h 的第一个位置
+    std::vector<size_t> vStart(nMaxHeight + 2, 0);
+    for (const CBlockIndex* pindex : mapBlockIndex)
+        vStart[pindex->nHeight + 1]++;
+    for (size_t h = 1; h < vStart.size(); h++)
+        vStart[h] += vStart[h - 1];
+    vSortedByHeight.resize(mapBlockIndex.size());
+    for (CBlockIndex* pindex : mapBlockIndex)
+        vSortedByHeight[vStart[pindex->nHeight]++] = pindex;
+}
+
+void LinkBlockIndex(Span<CBlockIndex* const> vSorted, int nThreads)
+{
+    TRACE_SPAN("LinkBlockIndex");
+    if (nThreads <= 0)
+        nThreads = GetScheduler().GetConcurrency();
+    const size_t nSize = vSorted.size();
+    const size_t nRanges = std::min((size_t)nThreads * 4, nSize / LINK_BLOCK_INDEX_MIN_CHUNK);
+    if (nRanges <= 1)
+        return LinkSerial(vSorted);
+
+    // 按位置等分, 再把每个分界推到高度变化处, 使每段包含完整的高度
+    std::vector<CLinkRange> vRanges;
+    size_t nBegin = 0;
+    for (size_t r = 1; r <= nRanges && nBegin < nSize; r++)
+    {
+        size_t nEnd = std::max(nBegin + 1, nSize * r / nRanges);
+        while (nEnd < nSize && vSorted[nEnd]->nHeight == vSorted[nEnd - 1]->nHeight)
+            nEnd++;
+        size_t nLastLevel = nEnd - 1;
+        while (nLastLevel > nBegin && vSorted[nLastLevel - 1]->nHeight == vSorted[nEnd - 1]->nHeight)
+            nLastLevel--;
+        vRanges.emplace_back();
+        vRanges.back().nBegin = nBegin;
+        vRanges.back().nEnd = nEnd;
+        vRanges.back().nLastLevel = nLastLevel;
+        nBegin = nEnd;
+    }
+
+    // 1. 各段并行计算相对值
+    std::atomic<bool> fRegular{true};
+    ParallelFor(vRanges.size(), nThreads, [&](size_t r) {
+        TRACE_SPAN("LinkLocal", vSorted[vRanges[r].nBegin]->nHeight);
+        if (!LinkLocal(vSorted, vRanges[r].nBegin, vRanges[r].nEnd))
+            fRegular = false;
+    });
+    // hzx pprev 的高度不是自己减一(索引数据不完整)时基不在上一段的最高高度, 退回逐个计算
+    if (!fRegular)
+        return LinkSerial(vSorted);
+
+    // 2. 依次求出每段最高高度区块的最终值, 它们是下一段的基
+    for (size_t r = 0; r < vRanges.size(); r++)
+    {
+        TRACE_SPAN("ResolveLastLevel", vSorted[vRanges[r].nLastLevel]->nHeight);
+        const std::vector<CResolvedEntry>* pvBase = r ? &vRanges[r - 1].vLastLevel : nullptr;
+        for (size_t i = vRanges[r].nLastLevel; i < vRanges[r].nEnd; i++)
+            vRanges[r].vLastLevel.push_back(Resolve(vSorted[i], pvBase ? FindBase(*pvBase, vSorted[i]->pskip) : nullptr));
+    }
+
+    // 3. 各段并行加上基的值, 同时找出工作量最大的区块
+    ParallelFor(vRanges.size(), nThreads, [&](size_t r) {
+        TRACE_SPAN("ResolveRange", vSorted[vRanges[r].nBegin]->nHeight);
+        CLinkRange& range = vRanges[r];
+        for (size_t i = range.nBegin; i < range.nEnd; i++)
+        {
+            CBlockIndex* pindex = vSorted[i];
+            if (r > 0 && pindex->pskip)
+            {
+                const CResolvedEntry entry = Resolve(pindex, FindBase(vRanges[r - 1].vLastLevel, pindex->pskip));
+                pindex->nChainWork = entry.nChainWork;
+                pindex->nTimeMax = entry.nTimeMax;
+                pindex->nChainTx = entry.nChainTx;
+            }
+            if (!range.pindexBest || pindex->nChainWork > range.pindexBest->nChainWork)
+                range.pindexBest = pindex;
+        }
+    });
+    CBlockIndex* pindexBest = nullptr;
+    for (const CLinkRange& range : vRanges)
+        if (!pindexBest || range.pindexBest->nChainWork > pindexBest->nChainWork)
+            pindexBest = range.pindexBest;
+
+    // 4. 按高度排列工作量最大的链: 只有一个区块的高度必然在这条链上, 其余高度从上方沿 pprev 补齐
+    const int nBestHeight = pindexBest->nHeight;
+    std::vector<CBlockIndex*> vMain(nBestHeight + 1, nullptr);
+    ParallelFor(vRanges.size(), nThreads, [&](size_t r) {
+        TRACE_SPAN("FindMainChain", vSorted[vRanges[r].nBegin]->nHeight);
+        for (size_t i = vRanges[r].nBegin; i < vRanges[r].nEnd;)
+        {
+            size_t j = i + 1;
+            while (j < vRanges[r].nEnd && vSorted[j]->nHeight == vSorted[i]->nHeight)
+                j++;
+            if (j == i + 1 && vSorted[i]->nHeight <= nBestHeight)
+                vMain[vSorted[i]->nHeight] = vSorted[i];
+            i = j;
+        }
+    });
+    vMain[nBestHeight] = pindexBest;
+    for (int h = nBestHeight - 1; h >= 0; h--)
+        if (!vMain[h])
+            vMain[h] = vMain[h + 1]->pprev;
+
+    // 5. 链上区块的 pskip 直接按高度取; 分叉上的区块最后按高度顺序 BuildSkip, 此时祖先的 pskip 都已就绪
+    ParallelFor(vRanges.size(), nThreads, [&](size_t r) {
+        TRACE_SPAN("LinkSkip", vSorted[vRanges[r].nBegin]->nHeight);
+        for (size_t i = vRanges[r].nBegin; i < vRanges[r].nEnd; i++)
+        {
+            CBlockIndex* pindex = vSorted[i];
+            if (pindex->nHeight <= nBestHeight && vMain[pindex->nHeight] == pindex)
+                pindex->pskip = pindex->pprev ? vMain[GetSkipHeight(pindex->nHeight)] : nullptr;
+            else
+                vRanges[r].vOffMain.push_back(pindex);
+        }
+    });
+    TRACE_SPAN("BuildSkipOffMain");
+    for (const CLinkRange& range : vRanges)
+    {
+        for (CBlockIndex* pindex : range.vOffMain)
+        {
+            pindex->pskip = nullptr;
+            pindex->BuildSkip();
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef BLOCKCHAIN_BLOCKINDEXLINK_H
+#define BLOCKCHAIN_BLOCKINDEXLINK_H
+#include <vector>
+#include "blockIndexMap.h"
+#include "chain.h"
+#include "span.h"
+
+//! Fewest entries per height range handed to one thread; smaller indexes are linked serially
+static const size_t LINK_BLOCK_INDEX_MIN_CHUNK = 16384;
+
+/**
+ * Order the entries of mapBlockIndex by height with a counting sort: one pass counts the
+ * entries of every height, a second one places them, O(N + max height). The order of
+ * entries of the same height is unspecified.
+ */
+void SortBlockIndexByHeight(const CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight);
+
+/**
+ * Compute nChainWork, nTimeMax, nChainTx and pskip of every entry of vSortedByHeight, which
+ * must hold every ancestor of its entries in height order; the result equals visiting the
+ * entries in order and deriving each from its pprev. nChainTx is 0 for an entry without
+ * transactions and for every descendant of one.
+ *
+ * The work is a parallel prefix scan over height ranges: every thread first computes the
+ * values of its range relative to the entry just below it, the last height of each range is
+ * then resolved in order, and finally every range adds the resolved values of its base. Skip
+ * pointers of the chain with the most work are read from a height-indexed array of that
+ * chain; only the entries off it use BuildSkip. The ranges run as tasks on GetScheduler();
+ * nThreads limits how many run at once, 0 for the scheduler's concurrency.
+ */
+void LinkBlockIndex(Span<CBlockIndex* const> vSortedByHeight, int nThreads = 0);
+
+#endif
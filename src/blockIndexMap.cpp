@@ -0,0 +1,134 @@
+#include "blockIndexMap.h"
+
+CBlockIndex* CBlockIndexArena::Allocate(const uint256& hash)
+{
+    if ((m_size >> CHUNK_SHIFT) == m_chunks.size())
+    {
+        m_chunks.emplace_back(new Entry[CHUNK_SIZE]);
+        MemoryAccount(MemoryTag::BLOCK_INDEX).Allocated(CHUNK_SIZE * sizeof(Entry));
+    }
+    Entry& entry = m_chunks[m_size >> CHUNK_SHIFT][m_size & (CHUNK_SIZE - 1)];
+    m_size++;
+    entry.hash = hash;
+    entry.index.phashBlock = &entry.hash;
+    return &entry.index;
+}
+
+void CBlockIndexArena::Clear()
+{
+    MemoryAccount(MemoryTag::BLOCK_INDEX).Freed(MemoryUsage());
+    m_chunks.clear();
+    m_size = 0;
+}
+
+void CBlockIndexMap::Rehash(size_t nBuckets)
+{
+    TrackedVector<Bucket, MemoryTag::BLOCK_INDEX> buckets(nBuckets, Bucket{0, nullptr});
+    const size_t mask = nBuckets - 1;
+    for (const Bucket& bucket : m_buckets)
+    {
+        if (!bucket.pindex)
+            continue;
+        size_t i = bucket.nCheapHash & mask;
+        while (buckets[i].pindex)
+            i = (i + 1) & mask;
+        buckets[i] = bucket;
+    }
+    m_buckets.swap(buckets);
+    m_mask = mask;
+}
+
+CBlockIndex* CBlockIndexMap::Find(const uint256& hash) const
+{
+    if (m_buckets.empty())
+        return nullptr;
+    const uint64_t nCheapHash = BlockHasher()(hash);
+    for (size_t i = nCheapHash & m_mask;; i = (i + 1) & m_mask)
+    {
+        const Bucket& bucket = m_buckets[i];
+        if (!bucket.pindex)
+            return nullptr;
+        if (bucket.nCheapHash == nCheapHash && *bucket.pindex->phashBlock == hash)
+            return bucket.pindex;
+    }
+}
+
+CBlockIndex* CBlockIndexMap::Insert(const uint256& hash, bool* pfInserted)
+{
+    // hzx 装载因子保持在 0.7 以下, 线性探测的平均探测长度很短
+    if ((m_arena.size() + 1) * 10 > m_buckets.size() * 7)
+        Rehash(m_buckets.empty() ? 1024 : m_buckets.size() * 2);
+    const uint64_t nCheapHash = BlockHasher()(hash);
+    size_t i = nCheapHash & m_mask;
+    for (;; i = (i + 1) & m_mask)
+    {
+        const Bucket& bucket = m_buckets[i];
+        if (!bucket.pindex)
+            break;
+        if (bucket.nCheapHash == nCheapHash && *bucket.pindex->phashBlock == hash)
+        {
+            if (pfInserted)
+                *pfInserted = false;
+            return bucket.pindex;
+        }
+    }
+    CBlockIndex* pindexNew = m_arena.Allocate(hash);
+    m_buckets[i] = Bucket{nCheapHash, pindexNew};
+    if (pfInserted)
+        *pfInserted = true;
+    return pindexNew;
+}
+
+void CBlockIndexMap::Reserve(size_t n)
+{
+    size_t nBuckets = 1024;
+    while (n * 10 > nBuckets * 7)
+        nBuckets *= 2;
+    if (nBuckets > m_buckets.size())
+        Rehash(nBuckets);
+}
+
+void CBlockIndexMap::Clear()
+{
+    m_buckets.clear();
+    m_mask = 0;
+    m_arena.Clear();
+}
+
+void CFrozenBlockIndex::Build(const CBlockIndexMap& mapBlockIndex)
+{
+    // hzx 平均每组最多用 6 个槽位, 溢出到下一组的情况很少
+    size_t nGroups = 1;
+    while (nGroups * 6 < mapBlockIndex.size())
+        nGroups *= 2;
+    m_groups.assign(nGroups, Group{});
+    m_entries.assign(nGroups * GROUP_SLOTS, Entry{uint256(), nullptr});
+    m_mask = nGroups - 1;
+    m_size = mapBlockIndex.size();
+    for (CBlockIndex* pindex : mapBlockIndex)
+    {
+        const uint64_t tag = Tag(*pindex->phashBlock);
+        for (size_t g = GroupOf(tag);; g = (g + 1) & m_mask)
+        {
+            const unsigned free = MatchTags(m_groups[g], 0);
+            if (!free)
+                continue;
+            const size_t nSlot = __builtin_ctz(free);
+            m_groups[g].vTag[nSlot] = tag;
+            m_entries[g * GROUP_SLOTS + nSlot] = Entry{*pindex->phashBlock, pindex};
+            break;
+        }
+    }
+}
+
+void CFrozenBlockIndex::FindMany(Span<const uint256> vHash, std::vector<CBlockIndex*>& vResult) const
+{
+    static const size_t PREFETCH_DISTANCE = 8;
+    vResult.resize(vHash.size());
+    for (size_t i = 0; i < (size_t)vHash.size(); i++)
+    {
+        if (i + PREFETCH_DISTANCE < (size_t)vHash.size() && !m_groups.empty())
+            __builtin_prefetch(&m_groups[GroupOf(Tag(vHash[i + PREFETCH_DISTANCE]))]);
+        vResult[i] = Find(vHash[i]);
+    }
+}
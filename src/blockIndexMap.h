@@ -0,0 +1,246 @@
+#ifndef BLOCKCHAIN_BLOCKINDEXMAP_H
+#define BLOCKCHAIN_BLOCKINDEXMAP_H
+#include <memory>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "chain.h"
+#include "common.h"
+#include "memAccount.h"
+#include "span.h"
+#include "uint256.h"
+
+struct BlockHasher
+{
+    // this used to call `GetCheapHash()` in uint256, which was later moved; the
+    // cheap hash function simply calls ReadLE64() however, so the end result is
+    // identical
+    size_t operator()(const uint256 &hash) const { return ReadLE64(hash.begin()); }
+};
+
+/**
+ * Slab allocator for CBlockIndex objects.
+ *
+ * Entries are carved out of fixed-size chunks and never move or get freed
+ * individually, so CBlockIndex pointers and phashBlock stay valid until Clear().
+ * The block hash is stored right next to its index entry, which saves the
+ * separate hash-map node the hash used to live in. Chunks are counted in the
+ * MemoryTag::BLOCK_INDEX account.
+ */
+class CBlockIndexArena
+{
+public:
+    static const size_t CHUNK_SHIFT = 14;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_SHIFT;
+
+    struct Entry
+    {
+        uint256 hash;
+        CBlockIndex index;
+    };
+
+private:
+    std::vector<std::unique_ptr<Entry[]>> m_chunks;
+    size_t m_size = 0;
+
+public:
+    CBlockIndexArena() {}
+    ~CBlockIndexArena() { Clear(); }
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    /** Construct a new, null CBlockIndex whose phashBlock points at a copy of hash. */
+    CBlockIndex* Allocate(const uint256& hash);
+
+    //! n-th allocated entry, in allocation order
+    CBlockIndex* operator[](size_t n) const { return &m_chunks[n >> CHUNK_SHIFT][n & (CHUNK_SIZE - 1)].index; }
+
+    size_t size() const { return m_size; }
+
+    //! bytes reserved by the arena
+    size_t MemoryUsage() const { return m_chunks.size() * CHUNK_SIZE * sizeof(Entry); }
+
+    void Clear();
+};
+
+/**
+ * Hash map from block hash to CBlockIndex, used in place of std::unordered_map while
+ * loading the block index.
+ *
+ * Open addressing with linear probing over a flat array of 16-byte buckets holding the
+ * BlockHasher cheap hash and the entry pointer; the full 32-byte key is only compared
+ * when the cheap hashes match. Index entries themselves live in a CBlockIndexArena.
+ * Entries are never erased.
+ */
+class CBlockIndexMap
+{
+private:
+    struct Bucket
+    {
+        uint64_t nCheapHash;
+        CBlockIndex* pindex;
+    };
+
+    TrackedVector<Bucket, MemoryTag::BLOCK_INDEX> m_buckets;
+    size_t m_mask = 0;
+    CBlockIndexArena m_arena;
+
+    void Rehash(size_t nBuckets);
+
+public:
+    class const_iterator
+    {
+    private:
+        const CBlockIndexArena* m_arena;
+        size_t m_pos;
+
+    public:
+        const_iterator(const CBlockIndexArena* arena, size_t pos) : m_arena(arena), m_pos(pos) {}
+        CBlockIndex* operator*() const { return (*m_arena)[m_pos]; }
+        const_iterator& operator++()
+        {
+            ++m_pos;
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return m_pos == other.m_pos; }
+        bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+    };
+
+    /** Return the entry for hash, or nullptr if there is none. */
+    CBlockIndex* Find(const uint256& hash) const;
+
+    /** Return the entry for hash, creating a new null entry if it does not exist yet. */
+    CBlockIndex* Insert(const uint256& hash, bool* pfInserted = nullptr);
+
+    /** Make room for n entries without rehashing. */
+    void Reserve(size_t n);
+
+    void Clear();
+
+    size_t size() const { return m_arena.size(); }
+    bool empty() const { return m_arena.size() == 0; }
+
+    //! iterate over all entries in insertion order (contiguous in memory)
+    const_iterator begin() const { return const_iterator(&m_arena, 0); }
+    const_iterator end() const { return const_iterator(&m_arena, m_arena.size()); }
+
+    const CBlockIndexArena& GetArena() const { return m_arena; }
+
+    //! bytes used by the bucket array and the arena
+    size_t MemoryUsage() const { return m_buckets.capacity() * sizeof(Bucket) + m_arena.MemoryUsage(); }
+};
+
+/**
+ * Read-only hash index from block hash to CBlockIndex, built once from a loaded
+ * CBlockIndexMap for lookup-heavy work such as joining external data against the chain.
+ *
+ * Slots are grouped eight to a 64-byte cache line that holds only their 64-bit tags
+ * (ReadLE64 of the hash with the low bit set, so 0 marks a free slot). A lookup reads the
+ * one group its tag maps to, compares the eight tags with SIMD, and then compares the full
+ * 32-byte key of a matching slot, which is stored next to its value in a parallel array.
+ * At most 6 of 8 slots per group are used on average, so nearly every lookup touches a
+ * single group; a full group continues into the next one.
+ */
+class CFrozenBlockIndex
+{
+public:
+    static const size_t GROUP_SLOTS = 8;
+
+private:
+    struct alignas(64) Group
+    {
+        uint64_t vTag[GROUP_SLOTS];
+    };
+
+    //! a slot's key and value, side by side so a hit costs one more cache line after the group
+    struct Entry
+    {
+        uint256 hash;
+        CBlockIndex* pindex;
+    };
+
+    TrackedVector<Group, MemoryTag::BLOCK_INDEX> m_groups;
+    TrackedVector<Entry, MemoryTag::BLOCK_INDEX> m_entries;
+    size_t m_mask = 0;
+    size_t m_size = 0;
+
+    static uint64_t Tag(const uint256& hash) { return ReadLE64(hash.begin()) | 1; }
+
+    //! the group is chosen by the high half of the tag, independent of the forced low bit
+    size_t GroupOf(uint64_t tag) const { return (tag >> 32) & m_mask; }
+
+    //! bit i is set if slot i of group holds tag
+    static unsigned MatchTags(const Group& group, uint64_t tag)
+    {
+#if defined(__SSE2__)
+        // hzx SSE2 没有 64 位比较: 比较 32 位, 再与交换高低半后的结果相与
+        const __m128i key = _mm_set1_epi64x(tag);
+        unsigned mask = 0;
+        for (size_t i = 0; i < GROUP_SLOTS; i += 2)
+        {
+            __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)&group.vTag[i]), key);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            mask |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+        }
+        return mask;
+#else
+        unsigned mask = 0;
+        for (size_t i = 0; i < GROUP_SLOTS; i++)
+            mask |= (unsigned)(group.vTag[i] == tag) << i;
+        return mask;
+#endif
+    }
+
+    static bool KeyEqual(const uint256& a, const uint256& b)
+    {
+#if defined(__SSE2__)
+        const __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a.begin()), _mm_loadu_si128((const __m128i*)b.begin()));
+        const __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a.begin() + 16)), _mm_loadu_si128((const __m128i*)(b.begin() + 16)));
+        return _mm_movemask_epi8(_mm_and_si128(lo, hi)) == 0xFFFF;
+#else
+        return a == b;
+#endif
+    }
+
+public:
+    CFrozenBlockIndex() {}
+    explicit CFrozenBlockIndex(const CBlockIndexMap& mapBlockIndex) { Build(mapBlockIndex); }
+
+    /** Replace the contents with every entry of mapBlockIndex. */
+    void Build(const CBlockIndexMap& mapBlockIndex);
+
+    /** Return the entry for hash, or nullptr if there is none. */
+    CBlockIndex* Find(const uint256& hash) const
+    {
+        if (m_groups.empty())
+            return nullptr;
+        const uint64_t tag = Tag(hash);
+        for (size_t g = GroupOf(tag);; g = (g + 1) & m_mask)
+        {
+            const Group& group = m_groups[g];
+            for (unsigned match = MatchTags(group, tag); match; match &= match - 1)
+            {
+                const Entry& entry = m_entries[g * GROUP_SLOTS + __builtin_ctz(match)];
+                if (KeyEqual(entry.hash, hash))
+                    return entry.pindex;
+            }
+            // 组内还有空位, 说明该键插入时会放在这里
+            if (MatchTags(group, 0))
+                return nullptr;
+        }
+    }
+
+    /**
+     * vResult[i] = Find(vHash[i]). The group of a lookup a few positions ahead is prefetched,
+     * so the cache misses of consecutive lookups overlap.
+     */
+    void FindMany(Span<const uint256> vHash, std::vector<CBlockIndex*>& vResult) const;
+
+    size_t size() const { return m_size; }
+
+    //! bytes used by the tag groups and entries
+    size_t MemoryUsage() const { return m_groups.capacity() * sizeof(Group) + m_entries.capacity() * sizeof(Entry); }
+};
+
+#endif
@@ -0,0 +1,457 @@
+#include "blockMan.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <unistd.h>
+#include "chainparams.h"
+#include "clientversion.h"
+#include "common.h"
+#include "hash.h"
+#include "logging.h"
+#include "memAccount.h"
+#include "metrics.h"
+#include "pow.h"
+#include "streams.h"
+#include "trace.h"
+#include "txdb.h"
+
+namespace
+{
+CMetricCounterArray& BlockFileReadBytes()
+{
+    static CMetricCounterArray& metric = Metrics().CounterArray("blockchain_blk_file_read_bytes_total", "Bytes of block records read, per blk file", "file");
+    return metric;
+}
+
+CMetricCounterArray& UndoFileReadBytes()
+{
+    static CMetricCounterArray& metric = Metrics().CounterArray("blockchain_rev_file_read_bytes_total", "Bytes of undo records read, per rev file", "file");
+    return metric;
+}
+
+// 解析成功的区块与交易数, 速率由 Prometheus 的 rate() 求出
+void CountParsed(size_t nTx)
+{
+    static CMetricCounter& blocks = Metrics().Counter("blockchain_blocks_parsed_total", "Blocks deserialized or parsed into views");
+    static CMetricCounter& txs = Metrics().Counter("blockchain_transactions_parsed_total", "Transactions of the blocks parsed");
+    blocks.Add();
+    txs.Add(nTx);
+}
+} // namespace
+
+BlockManager::BlockManager(const std::string& blocks_dir, size_t max_mapped_files, unsigned int readahead)
+    : m_blocks_dir(blocks_dir), m_block_files(blocks_dir, "blk", max_mapped_files), m_undo_files(blocks_dir, "rev", max_mapped_files),
+      m_last_file(-1), m_readahead(readahead)
+{
+}
+
+bool BlockManager::LoadBlockFileInfo(CBlockTreeDB& blocktree)
+{
+    int nLastFile = 0;
+    if (!blocktree.ReadLastBlockFile(nLastFile))
+    {
+        LogError("%s: 数据库中没有 DB_LAST_BLOCK 记录\n", __func__);
+        return false;
+    }
+    std::vector<CBlockFileInfo> vInfo(nLastFile + 1);
+    for (int nFile = 0; nFile <= nLastFile; nFile++)
+    {
+        if (!blocktree.ReadBlockFileInfo(nFile, vInfo[nFile]))
+        {
+            LogError("%s: 读取文件信息失败, 文件: %d\n", __func__, nFile);
+            return false;
+        }
+    }
+    m_file_info.swap(vInfo);
+    m_last_file = nLastFile;
+    LogInfo("%s: 载入 %d 个区块文件信息\n", __func__, nLastFile + 1);
+    return true;
+}
+
+const CBlockFileInfo* BlockManager::GetFileInfo(int nFile) const
+{
+    if (nFile < 0 || nFile >= (int)m_file_info.size())
+        return nullptr;
+    return &m_file_info[nFile];
+}
+
+bool BlockManager::FindBlockRecord(const CBlockIndex* pindex, const CMappedFile& file, Span<const unsigned char>& record) const
+{
+    // hzx 文件信息已载入时, 先排除越界的位置
+    const CBlockFileInfo* info = GetFileInfo(pindex->nFile);
+    if (info && info->nSize && pindex->nDataPos >= info->nSize)
+    {
+        LogError("%s: 偏移位置超出文件大小, 文件: %d, 偏移位置: %u, 文件大小: %u\n", __func__, pindex->nFile, pindex->nDataPos, info->nSize);
+        return false;
+    }
+    if (!file.GetRecord(pindex->nDataPos, Params().MessageStart(), record))
+    {
+        LogError("%s: 区块起始位置或大小不匹配, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    BlockFileReadBytes().Add(pindex->nFile, record.size());
+    return true;
+}
+
+bool BlockManager::LocateBlock(const CBlockIndex* pindex, std::shared_ptr<const CMappedFile>& file, Span<const unsigned char>& record)
+{
+    TRACE_SPAN("LocateBlock", pindex->nHeight, pindex->nFile);
+    file = m_block_files.Get(pindex->nFile);
+    if (!file)
+    {
+        LogError("%s: 文件打开失败 %s\n", __func__, GetBlockFilePath(m_blocks_dir, "blk", pindex->nFile).data());
+        return false;
+    }
+    if (!FindBlockRecord(pindex, *file, record))
+        return false;
+    // 区块跨过一个预读窗口边界时, 提示内核预读下一个窗口, 顺序扫描时每个窗口只调用一次 madvise
+    if (m_readahead)
+    {
+        size_t nEnd = (size_t)pindex->nDataPos + record.size();
+        if (pindex->nDataPos / m_readahead != nEnd / m_readahead)
+            file->Prefetch(nEnd, m_readahead);
+    }
+    return true;
+}
+
+bool BlockManager::ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CMappedFile> file;
+    Span<const unsigned char> record;
+    if (!LocateBlock(pindex, file, record))
+        return false;
+    block.assign(record.begin(), record.end());
+    return true;
+}
+
+bool BlockManager::ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    block.SetNull();
+    std::shared_ptr<const CMappedFile> file;
+    Span<const unsigned char> record;
+    if (!LocateBlock(pindex, file, record))
+        return false;
+    return DecodeBlock(block, pindex, record, consensusParams);
+}
+
+bool BlockManager::DecodeBlock(CBlock& block, const CBlockIndex* pindex, Span<const unsigned char> record, const Consensus::Params& consensusParams) const
+{
+    try
+    {
+        TRACE_SPAN("DeserializeBlock", pindex->nHeight);
+        SpanReader filein(SER_DISK, CLIENT_VERSION, record);
+        UnserializeBlockBatchHash(filein, block);
+    }
+    catch (const std::exception& e)
+    {
+        LogError("%s: Deserialize error - %s, 文件: %d, 偏移位置: %u\n", __func__, e.what(), pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    // Check the header
+    const uint256 hash = block.GetHash();
+    TRACE_SPAN("CheckProofOfWork", pindex->nHeight);
+    if (!CheckProofOfWork(hash, block.nBits, consensusParams))
+    {
+        LogError("%s: CheckProofOfWork failed, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    if (pindex->phashBlock && hash != pindex->GetBlockHash())
+    {
+        LogError("%s: 区块哈希与索引不一致, 高度: %d, 文件: %d, 偏移位置: %u\n", __func__, pindex->nHeight, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    CountParsed(block.vtx.size());
+    return true;
+}
+
+bool BlockManager::ReadBlocks(Span<const CBlockIndex* const> vIndex, std::vector<CBlock>& vBlocks, const Consensus::Params& consensusParams)
+{
+    vBlocks.clear();
+    vBlocks.resize(vIndex.size());
+    std::vector<uint32_t> vOrder(vIndex.size());
+    for (uint32_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::sort(vOrder.begin(), vOrder.end(), [&vIndex](uint32_t a, uint32_t b) {
+        return std::make_pair(vIndex[a]->nFile, vIndex[a]->nDataPos) < std::make_pair(vIndex[b]->nFile, vIndex[b]->nDataPos);
+    });
+
+    /** A contiguous byte range of one blk file covering the records of vOrder[nFirst, nLast). */
+    struct ReadRun
+    {
+        std::shared_ptr<const CMappedFile> file;
+        size_t nBegin, nEnd;
+        size_t nFirst, nLast;
+    };
+    std::vector<ReadRun> vRuns;
+    std::vector<Span<const unsigned char>> vRecords(vIndex.size());
+    std::shared_ptr<const CMappedFile> file;
+    int nFile = -1;
+    for (size_t k = 0; k < vOrder.size(); k++)
+    {
+        const CBlockIndex* pindex = vIndex[vOrder[k]];
+        if (!file || pindex->nFile != nFile)
+        {
+            nFile = pindex->nFile;
+            file = m_block_files.Get(nFile);
+            if (!file)
+            {
+                LogError("%s: 文件打开失败 %s\n", __func__, GetBlockFilePath(m_blocks_dir, "blk", nFile).data());
+                return false;
+            }
+        }
+        Span<const unsigned char>& record = vRecords[vOrder[k]];
+        if (!FindBlockRecord(pindex, *file, record))
+            return false;
+        // hzx 记录前面的魔数与长度也算在读取范围内, 相邻区块之间没有空洞
+        const size_t nBegin = pindex->nDataPos - CMessageHeader::MESSAGE_START_SIZE - sizeof(uint32_t);
+        const size_t nEnd = (size_t)pindex->nDataPos + record.size();
+        if (!vRuns.empty() && vRuns.back().file == file && nBegin <= vRuns.back().nEnd + BLOCK_READ_COALESCE_GAP &&
+            nEnd - vRuns.back().nBegin <= MAX_BLOCK_READ_SIZE)
+        {
+            vRuns.back().nEnd = std::max(vRuns.back().nEnd, nEnd);
+            vRuns.back().nLast = k + 1;
+        }
+        else
+            vRuns.push_back({file, nBegin, nEnd, k, k + 1});
+    }
+
+    // 解析一段时提示内核读入下一段, 磁盘读取与反序列化重叠
+    if (!vRuns.empty())
+        vRuns[0].file->Prefetch(vRuns[0].nBegin, vRuns[0].nEnd - vRuns[0].nBegin);
+    for (size_t r = 0; r < vRuns.size(); r++)
+    {
+        if (r + 1 < vRuns.size())
+            vRuns[r + 1].file->Prefetch(vRuns[r + 1].nBegin, vRuns[r + 1].nEnd - vRuns[r + 1].nBegin);
+        TRACE_SPAN("ReadRun", -1, vIndex[vOrder[vRuns[r].nFirst]]->nFile);
+        for (size_t k = vRuns[r].nFirst; k < vRuns[r].nLast; k++)
+        {
+            if (!DecodeBlock(vBlocks[vOrder[k]], vIndex[vOrder[k]], vRecords[vOrder[k]], consensusParams))
+                return false;
+        }
+        // 已解析的段不再需要, 释放映射的引用, 让 LRU 可以回收文件
+        vRuns[r].file.reset();
+    }
+    return true;
+}
+
+CBlockIOBackend& BlockManager::GetIOBackend()
+{
+    std::lock_guard<std::mutex> lock(m_io_mutex);
+    if (!m_io)
+        m_io = MakeBlockIOBackend();
+    return *m_io;
+}
+
+void BlockManager::SetIOBackend(std::unique_ptr<CBlockIOBackend> io)
+{
+    std::lock_guard<std::mutex> lock(m_io_mutex);
+    m_io = std::move(io);
+}
+
+bool BlockManager::ReadBlocksDirect(Span<const CBlockIndex* const> vIndex, std::vector<CBlock>& vBlocks, const Consensus::Params& consensusParams)
+{
+    const size_t nHeader = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    const size_t nCount = vIndex.size();
+    vBlocks.clear();
+    vBlocks.resize(nCount);
+
+    // hzx 每个文件在本次读取中只打开一次
+    struct FileDescriptors
+    {
+        std::map<int, int> mapFd;
+        ~FileDescriptors()
+        {
+            for (const auto& item : mapFd)
+                close(item.second);
+        }
+    } fds;
+    std::vector<TrackedVector<unsigned char, MemoryTag::BLOCK_IO>> vBuffers(nCount);
+    std::vector<BlockIORequest> vRequests(nCount);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        const CBlockIndex* pindex = vIndex[i];
+        const CBlockFileInfo* info = GetFileInfo(pindex->nFile);
+        if (pindex->nDataPos < nHeader || (info && info->nSize && pindex->nDataPos >= info->nSize))
+        {
+            LogError("%s: 偏移位置不正确, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+            return false;
+        }
+        auto it = fds.mapFd.find(pindex->nFile);
+        if (it == fds.mapFd.end())
+        {
+            const std::string path = GetBlockFilePath(m_blocks_dir, "blk", pindex->nFile);
+            const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                LogError("%s: 文件打开失败 %s\n", __func__, path.data());
+                return false;
+            }
+            it = fds.mapFd.emplace(pindex->nFile, fd).first;
+        }
+        vBuffers[i].resize(BLOCK_READ_PROBE_SIZE);
+        vRequests[i] = BlockIORequest{it->second, pindex->nDataPos - nHeader, BLOCK_READ_PROBE_SIZE, vBuffers[i].data(), 0};
+    }
+    CBlockIOBackend& io = GetIOBackend();
+    {
+        TRACE_SPAN("BlockIORead");
+        if (!io.Read(MakeSpan(vRequests)))
+            return false;
+    }
+
+    // 第二遍: 比探测长度大的区块补读剩余部分
+    std::vector<uint32_t> vSize(nCount);
+    std::vector<BlockIORequest> vRest;
+    for (size_t i = 0; i < nCount; i++)
+    {
+        const CBlockIndex* pindex = vIndex[i];
+        const int64_t nRead = vRequests[i].nResult;
+        if (nRead < (int64_t)nHeader || memcmp(vBuffers[i].data(), Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+        {
+            LogError("%s: 区块起始位置不匹配, 文件: %d, 偏移位置: %u%s%s\n", __func__, pindex->nFile, pindex->nDataPos, nRead < 0 ? ", " : "",
+                   nRead < 0 ? strerror(-nRead) : "");
+            return false;
+        }
+        vSize[i] = ReadLE32(vBuffers[i].data() + CMessageHeader::MESSAGE_START_SIZE);
+        const uint64_t nTotal = nHeader + (uint64_t)vSize[i];
+        if (vSize[i] > MAX_SIZE || (nTotal > (uint64_t)nRead && nRead < BLOCK_READ_PROBE_SIZE))
+        {
+            LogError("%s: 区块大小不正确, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+            return false;
+        }
+        if (nTotal > (uint64_t)nRead)
+        {
+            vBuffers[i].resize(nTotal);
+            vRest.push_back(BlockIORequest{vRequests[i].fd, vRequests[i].nOffset + nRead, (uint32_t)(nTotal - nRead), vBuffers[i].data() + nRead, 0});
+        }
+    }
+    if (!vRest.empty())
+    {
+        TRACE_SPAN("BlockIOReadRest");
+        if (!io.Read(MakeSpan(vRest)))
+            return false;
+    }
+    for (const BlockIORequest& req : vRest)
+    {
+        if (req.nResult != req.nLen)
+        {
+            LogError("%s: 区块读取不完整, 偏移位置: %lu\n", __func__, (unsigned long)req.nOffset);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < nCount; i++)
+    {
+        BlockFileReadBytes().Add(vIndex[i]->nFile, vSize[i]);
+        if (!DecodeBlock(vBlocks[i], vIndex[i], Span<const unsigned char>(vBuffers[i].data() + nHeader, vSize[i]), consensusParams))
+            return false;
+    }
+    return true;
+}
+
+bool BlockManager::ReadBlockView(CBlockView& view, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    std::shared_ptr<const CMappedFile> file;
+    Span<const unsigned char> record;
+    if (!LocateBlock(pindex, file, record))
+    {
+        view.Clear();
+        return false;
+    }
+    return DecodeBlockView(view, pindex, std::move(file), record, consensusParams);
+}
+
+bool BlockManager::DecodeBlockView(CBlockView& view, const CBlockIndex* pindex, std::shared_ptr<const CMappedFile> file, Span<const unsigned char> record,
+                                   const Consensus::Params& consensusParams) const
+{
+    bool fParsed;
+    {
+        TRACE_SPAN("ParseBlockView", pindex->nHeight);
+        fParsed = view.Parse(record, std::move(file));
+    }
+    if (!fParsed)
+    {
+        LogError("%s: 区块格式错误, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    const uint256 hash = view.GetHash();
+    TRACE_SPAN("CheckProofOfWork", pindex->nHeight);
+    if (!CheckProofOfWork(hash, view.GetBits(), consensusParams))
+    {
+        LogError("%s: CheckProofOfWork failed, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    if (pindex->phashBlock && hash != pindex->GetBlockHash())
+    {
+        LogError("%s: 区块哈希与索引不一致, 高度: %d, 文件: %d, 偏移位置: %u\n", __func__, pindex->nHeight, pindex->nFile, pindex->nDataPos);
+        return false;
+    }
+    CountParsed(view.GetTxCount());
+    return true;
+}
+
+bool BlockManager::LocateUndo(const CBlockIndex* pindex, std::shared_ptr<const CMappedFile>& file, Span<const unsigned char>& record)
+{
+    TRACE_SPAN("LocateUndo", pindex->nHeight, pindex->nFile);
+    if (!(pindex->nStatus & BLOCK_HAVE_UNDO) || !pindex->pprev)
+    {
+        LogError("%s: 区块没有 undo 数据, 高度: %d\n", __func__, pindex->nHeight);
+        return false;
+    }
+    const CBlockFileInfo* info = GetFileInfo(pindex->nFile);
+    if (info && info->nUndoSize && pindex->nUndoPos >= info->nUndoSize)
+    {
+        LogError("%s: 偏移位置超出文件大小, 文件: %d, 偏移位置: %u, 文件大小: %u\n", __func__, pindex->nFile, pindex->nUndoPos, info->nUndoSize);
+        return false;
+    }
+    file = m_undo_files.Get(pindex->nFile);
+    if (!file)
+    {
+        LogError("%s: 文件打开失败 %s\n", __func__, GetBlockFilePath(m_blocks_dir, "rev", pindex->nFile).data());
+        return false;
+    }
+    if (!file->GetRecord(pindex->nUndoPos, Params().MessageStart(), record) ||
+        file->size() - pindex->nUndoPos - record.size() < CHash256::OUTPUT_SIZE)
+    {
+        LogError("%s: undo 起始位置或大小不匹配, 文件: %d, 偏移位置: %u\n", __func__, pindex->nFile, pindex->nUndoPos);
+        return false;
+    }
+    // hzx 校验和与 bitcoind 的 UndoReadFromDisk 相同: Hash(上一区块哈希, undo 记录)
+    uint256 hashChecksum;
+    const uint256 hashPrev = pindex->pprev->GetBlockHash();
+    CHash256().Write(hashPrev.begin(), hashPrev.size()).Write(record.data(), record.size()).Finalize(hashChecksum.begin());
+    if (memcmp(hashChecksum.begin(), record.end(), CHash256::OUTPUT_SIZE))
+    {
+        LogError("%s: undo 校验和不匹配, 高度: %d, 文件: %d, 偏移位置: %u\n", __func__, pindex->nHeight, pindex->nFile, pindex->nUndoPos);
+        return false;
+    }
+    UndoFileReadBytes().Add(pindex->nFile, record.size());
+    return true;
+}
+
+bool BlockManager::ReadBlockUndo(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    blockundo.vtxundo.clear();
+    if (!pindex->pprev)
+        return true;
+    std::shared_ptr<const CMappedFile> file;
+    Span<const unsigned char> record;
+    if (!LocateUndo(pindex, file, record))
+        return false;
+    try
+    {
+        TRACE_SPAN("DeserializeUndo", pindex->nHeight);
+        SpanReader filein(SER_DISK, CLIENT_VERSION, record);
+        filein >> blockundo;
+        if (filein.size())
+            throw std::ios_base::failure("trailing bytes");
+    }
+    catch (const std::exception& e)
+    {
+        LogError("%s: Deserialize error - %s, 文件: %d, 偏移位置: %u\n", __func__, e.what(), pindex->nFile, pindex->nUndoPos);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,146 @@
+#ifndef BLOCKCHAIN_BLOCKMAN_H
+#define BLOCKCHAIN_BLOCKMAN_H
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "blkMmap.h"
+#include "block.h"
+#include "blockIO.h"
+#include "blockView.h"
+#include "chain.h"
+#include "params.h"
+#include "undo.h"
+
+class CBlockTreeDB;
+
+//! Default number of bytes after a block that are hinted to the kernel for read-ahead
+static const unsigned int DEFAULT_BLOCK_READAHEAD = 4 << 20;
+//! ReadBlocks: blocks separated by at most this many bytes are merged into one read
+static const unsigned int BLOCK_READ_COALESCE_GAP = 64 << 10;
+//! ReadBlocks: upper bound of a single merged read
+static const unsigned int MAX_BLOCK_READ_SIZE = 16 << 20;
+//! ReadBlocksDirect: bytes requested per block in the first pass, enough for the record header and most blocks
+static const unsigned int BLOCK_READ_PROBE_SIZE = 64 << 10;
+
+/**
+ * Owns everything needed to get at block data on disk:
+ * - the mapped blk?????.dat and rev?????.dat files (one LRU each),
+ * - the CBlockFileInfo table stored in the block tree database,
+ * - the read-ahead policy applied when a block is located.
+ *
+ * Blocks are addressed by their CBlockIndex (nFile, nDataPos / nUndoPos). All methods
+ * are safe to call from several threads at once once LoadBlockFileInfo has returned.
+ */
+class BlockManager
+{
+private:
+    const std::string m_blocks_dir;
+    CMappedFileCache m_block_files;
+    CMappedFileCache m_undo_files;
+
+    //! CBlockFileInfo for files 0..m_last_file, loaded from DB_BLOCK_FILES
+    std::vector<CBlockFileInfo> m_file_info;
+    int m_last_file;
+
+    unsigned int m_readahead;
+
+    //! positioned-read backend of ReadBlocksDirect, created on first use
+    std::unique_ptr<CBlockIOBackend> m_io;
+    std::mutex m_io_mutex;
+
+    //! find the record of pindex in file, which must be its blk file
+    bool FindBlockRecord(const CBlockIndex* pindex, const CMappedFile& file, Span<const unsigned char>& record) const;
+
+public:
+    explicit BlockManager(const std::string& blocks_dir, size_t max_mapped_files = DEFAULT_MAX_MAPPED_FILES, unsigned int readahead = DEFAULT_BLOCK_READAHEAD);
+
+    BlockManager(const BlockManager&) = delete;
+    BlockManager& operator=(const BlockManager&) = delete;
+
+    /** Load the CBlockFileInfo table (DB_LAST_BLOCK and every DB_BLOCK_FILES entry). */
+    bool LoadBlockFileInfo(CBlockTreeDB& blocktree);
+
+    /** Return the info of file nFile, or nullptr if it is not known. */
+    const CBlockFileInfo* GetFileInfo(int nFile) const;
+
+    //! highest blk file number recorded in the database, -1 if none was loaded
+    int GetLastFile() const { return m_last_file; }
+
+    const std::string& GetBlocksDir() const { return m_blocks_dir; }
+
+    std::shared_ptr<const CMappedFile> GetBlockFile(int nFile) { return m_block_files.Get(nFile); }
+    std::shared_ptr<const CMappedFile> GetUndoFile(int nFile) { return m_undo_files.Get(nFile); }
+
+    //! bytes of the blk and rev files currently mapped by the caches
+    size_t MappedBytes() { return m_block_files.MappedBytes() + m_undo_files.MappedBytes(); }
+
+    /**
+     * Find the serialized block of pindex inside its mapped blk file. file keeps the
+     * mapping alive for as long as the caller uses record.
+     */
+    bool LocateBlock(const CBlockIndex* pindex, std::shared_ptr<const CMappedFile>& file, Span<const unsigned char>& record);
+
+    /** Deserialize a block found by LocateBlock and check its header against pindex like ReadBlockFromDisk. */
+    bool DecodeBlock(CBlock& block, const CBlockIndex* pindex, Span<const unsigned char> record, const Consensus::Params& consensusParams) const;
+
+    /** Index a block found by LocateBlock in place like ReadBlockView; the view keeps file alive. */
+    bool DecodeBlockView(CBlockView& view, const CBlockIndex* pindex, std::shared_ptr<const CMappedFile> file, Span<const unsigned char> record,
+                         const Consensus::Params& consensusParams) const;
+
+    /** Copy the serialized block of pindex into block. */
+    bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex);
+
+    /** Deserialize the block of pindex and check that it matches the index entry. */
+    bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+    /**
+     * Read many blocks at once: vBlocks[i] receives the block of vIndex[i]. The requests are
+     * sorted by (nFile, nDataPos), neighbouring blocks of a file are merged into reads of up to
+     * MAX_BLOCK_READ_SIZE, and each merged read is hinted to the kernel while the previous one
+     * is being deserialized, so a height range is read close to sequential disk speed
+     * whatever the order of vIndex.
+     */
+    bool ReadBlocks(Span<const CBlockIndex* const> vIndex, std::vector<CBlock>& vBlocks, const Consensus::Params& consensusParams);
+
+    /**
+     * Read many blocks with positioned reads through the I/O backend (io_uring, or a pread
+     * thread pool) instead of the mapped files. All reads are submitted at once and up to the
+     * backend's depth are in flight, so random lookups on a cold page cache keep the device
+     * queue full instead of faulting in one block at a time. The first pass reads
+     * BLOCK_READ_PROBE_SIZE bytes at each block, which covers the record header and most
+     * blocks; larger blocks get a second pass for the rest. vBlocks[i] receives the block of vIndex[i].
+     */
+    bool ReadBlocksDirect(Span<const CBlockIndex* const> vIndex, std::vector<CBlock>& vBlocks, const Consensus::Params& consensusParams);
+
+    /** Return the backend of ReadBlocksDirect, creating the default one (MakeBlockIOBackend) if none was set. */
+    CBlockIOBackend& GetIOBackend();
+
+    /** Use io instead of the default backend for ReadBlocksDirect. */
+    void SetIOBackend(std::unique_ptr<CBlockIOBackend> io);
+
+    /**
+     * Index the serialized block of pindex in place (no copy, no per-transaction objects)
+     * and check its header hash like ReadBlockFromDisk. The view pins the mapped file.
+     */
+    bool ReadBlockView(CBlockView& view, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+    /**
+     * Find the undo record of pindex (CBlockUndo, stored at nUndoPos in rev?????.dat with the
+     * same file number as the block) and verify the 32-byte checksum that follows it, which
+     * is SHA256d of the previous block hash and the record.
+     */
+    bool LocateUndo(const CBlockIndex* pindex, std::shared_ptr<const CMappedFile>& file, Span<const unsigned char>& record);
+
+    /**
+     * Read the undo data of pindex: one CTxUndo per non-coinbase transaction, holding the
+     * coin spent by each input. The genesis block has no undo data and yields an empty
+     * blockundo.
+     */
+    bool ReadBlockUndo(CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+    /** Set the number of bytes following a located block that are hinted for read-ahead (0 disables). */
+    void SetReadAhead(unsigned int readahead) { m_readahead = readahead; }
+};
+
+#endif
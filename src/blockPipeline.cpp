@@ -0,0 +1,367 @@
+#include "blockPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "logging.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "shutdown.h"
+#include "trace.h"
+
+namespace
+{
+//! distance between the bytes the I/O stage touches to fault a record in (one per page)
+static const size_t FAULT_STRIDE = 4096;
+
+typedef std::chrono::steady_clock StallClock;
+
+int64_t MicrosSince(StallClock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(StallClock::now() - start).count();
+}
+
+size_t RoundUpPow2(size_t n)
+{
+    size_t r = 1;
+    while (r < n)
+        r <<= 1;
+    return r;
+}
+
+void UpdateMax(std::atomic<uint64_t>& max, uint64_t value)
+{
+    uint64_t cur = max.load(std::memory_order_relaxed);
+    while (value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+        ;
+}
+
+/**
+ * Waits inside the pipeline are usually short: yield a few times first, then sleep, so a
+ * stalled stage does not burn the core another stage needs. The time from the first Wait()
+ * to Done() is added to a stall counter.
+ */
+class CBackoff
+{
+private:
+    int m_nSpins = 0;
+    StallClock::time_point m_start;
+
+public:
+    void Wait()
+    {
+        if (m_nSpins++ == 0)
+            m_start = StallClock::now();
+        if (m_nSpins < 16)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    //! end of the stall, if there was one: add its duration to counter and metric
+    void Done(std::atomic<int64_t>& counter, CMetricCounter& metric)
+    {
+        if (m_nSpins)
+        {
+            const int64_t nMicros = MicrosSince(m_start);
+            counter += nMicros;
+            metric.Add(nMicros);
+        }
+        m_nSpins = 0;
+    }
+};
+
+CMetricCounter& StallMetric(const std::string& stage)
+{
+    return Metrics().Counter("blockchain_pipeline_stall_seconds_total", "Time block pipeline stages spent waiting", "stage=\"" + stage + "\"", 1e-6);
+}
+
+CMetricGauge& QueueDepthMetric(const std::string& queue)
+{
+    return Metrics().Gauge("blockchain_pipeline_queue_depth", "Blocks waiting between block pipeline stages", "queue=\"" + queue + "\"");
+}
+
+/**
+ * Bounded multi-producer multi-consumer ring buffer (after D. Vyukov). Every cell carries a
+ * sequence number saying whether it is free for the push with ticket pos (seq == pos) or holds
+ * the value for the pop with ticket pos (seq == pos + 1), so pushes and pops only contend on
+ * one counter each and never take a lock.
+ */
+template <typename T>
+class CBoundedQueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> nSeq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    const size_t m_mask;
+    alignas(64) std::atomic<size_t> m_push{0};
+    alignas(64) std::atomic<size_t> m_pop{0};
+
+public:
+    explicit CBoundedQueue(size_t capacity) : m_cells(new Cell[RoundUpPow2(std::max<size_t>(capacity, 2))]), m_mask(RoundUpPow2(std::max<size_t>(capacity, 2)) - 1)
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].nSeq.store(i, std::memory_order_relaxed);
+    }
+
+    bool TryPush(T& value)
+    {
+        size_t pos = m_push.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            const intptr_t diff = (intptr_t)cell->nSeq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (m_push.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // 队列已满
+            else
+                pos = m_push.load(std::memory_order_relaxed);
+        }
+        cell->value = std::move(value);
+        cell->nSeq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        size_t pos = m_pop.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+            cell = &m_cells[pos & m_mask];
+            const intptr_t diff = (intptr_t)cell->nSeq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (m_pop.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // 队列为空
+            else
+                pos = m_pop.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->value);
+        cell->nSeq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! number of queued values; exact only when no push or pop is in progress
+    size_t SizeApprox() const
+    {
+        const size_t nPush = m_push.load(std::memory_order_relaxed), nPop = m_pop.load(std::memory_order_relaxed);
+        return nPush > nPop ? nPush - nPop : 0;
+    }
+};
+
+/** A block located (and faulted in) by the I/O stage; file is null if it could not be located. */
+struct ReadItem
+{
+    size_t nSeq = 0;
+    const CBlockIndex* pindex = nullptr;
+    std::shared_ptr<const CMappedFile> file;
+    Span<const unsigned char> record;
+};
+
+/**
+ * One entry of the parse queue. Block number nSeq always goes to slot nSeq & mask, so the
+ * queue hands blocks to the consumer in order whatever order the parse threads finish in:
+ * nSeq == n means the slot is free for block n, nSeq == n + 1 that block n is ready.
+ */
+template <typename Block>
+struct ParseSlot
+{
+    std::atomic<size_t> nSeq;
+    const CBlockIndex* pindex = nullptr;
+    size_t nBytes = 0;
+    bool fOk = false;
+    Block block;
+};
+} // namespace
+
+bool CBlockPipeline::Run(Span<const CBlockIndex* const> vIndex, const BlockVisitor& visitor, const BlockPipelineOptions& options)
+{
+    return RunImpl<CBlock>(vIndex, visitor, options);
+}
+
+bool CBlockPipeline::RunViews(Span<const CBlockIndex* const> vIndex, const BlockViewVisitor& visitor, const BlockPipelineOptions& options)
+{
+    return RunImpl<CBlockView>(vIndex, visitor, options);
+}
+
+BlockPipelineStats CBlockPipeline::GetStats() const
+{
+    BlockPipelineStats stats;
+    stats.nBlocks = m_counters.nBlocks;
+    stats.nBytes = m_counters.nBytes;
+    stats.nReadStallMicros = m_counters.nReadStallMicros;
+    stats.nParseStallMicros = m_counters.nParseStallMicros;
+    stats.nConsumerStallMicros = m_counters.nConsumerStallMicros;
+    stats.nMaxReadQueue = m_counters.nMaxReadQueue;
+    stats.nMaxParseQueue = m_counters.nMaxParseQueue;
+    if (stats.nBlocks)
+    {
+        stats.dAvgReadQueue = (double)m_counters.nSumReadQueue / stats.nBlocks;
+        stats.dAvgParseQueue = (double)m_counters.nSumParseQueue / stats.nBlocks;
+    }
+    stats.nElapsedMicros = m_counters.nElapsedMicros;
+    return stats;
+}
+
+template <typename Block>
+bool CBlockPipeline::RunImpl(Span<const CBlockIndex* const> vIndex, const std::function<bool(const CBlockIndex*, const Block&)>& visitor, const BlockPipelineOptions& options)
+{
+    for (std::atomic<uint64_t>* counter : {&m_counters.nBlocks, &m_counters.nBytes, &m_counters.nMaxReadQueue, &m_counters.nMaxParseQueue,
+                                           &m_counters.nSumReadQueue, &m_counters.nSumParseQueue})
+        counter->store(0);
+    for (std::atomic<int64_t>* counter : {&m_counters.nReadStallMicros, &m_counters.nParseStallMicros, &m_counters.nConsumerStallMicros, &m_counters.nElapsedMicros})
+        counter->store(0);
+    const StallClock::time_point start = StallClock::now();
+    const size_t nBlocks = vIndex.size();
+    static CMetricCounter& readStall = StallMetric("read");
+    static CMetricCounter& parseStall = StallMetric("parse");
+    static CMetricCounter& consumerStall = StallMetric("consumer");
+    static CMetricGauge& readQueueDepth = QueueDepthMetric("read");
+    static CMetricGauge& parseQueueDepth = QueueDepthMetric("parse");
+
+    CBoundedQueue<ReadItem> readQueue(options.nReadQueueDepth);
+    const size_t nSlots = RoundUpPow2(std::max(options.nParseQueueDepth, 2));
+    std::unique_ptr<ParseSlot<Block>[]> vSlots(new ParseSlot<Block>[nSlots]);
+    for (size_t i = 0; i < nSlots; i++)
+        vSlots[i].nSeq.store(i, std::memory_order_relaxed);
+
+    // hzx 已读入但消费者还没处理完的字节数, 由 I/O 阶段增加, 消费者减少
+    std::atomic<uint64_t> nBytesAhead(0);
+    std::atomic<size_t> nParsed(0);
+    std::atomic<bool> fReadDone(false), fAbort(false);
+
+    // I/O 阶段: 定位区块并逐页读入, 使解析线程不会阻塞在缺页上
+    auto reader = [&]() {
+        TraceThreadName("pipeline-read");
+        CBackoff backoff;
+        for (size_t i = 0; i < nBlocks && !fAbort; i++)
+        {
+            ReadItem item;
+            item.nSeq = i;
+            item.pindex = vIndex[i];
+            if (m_blockman.LocateBlock(item.pindex, item.file, item.record))
+            {
+                const uint64_t nBytes = item.record.size();
+                while (nBytesAhead.load() && nBytesAhead.load() + nBytes > options.nReadAheadBytes && !fAbort)
+                    backoff.Wait();
+                backoff.Done(m_counters.nReadStallMicros, readStall);
+                nBytesAhead += nBytes;
+                unsigned char sum = 0;
+                for (size_t nPos = 0; nPos < nBytes; nPos += FAULT_STRIDE)
+                    sum ^= ((volatile const unsigned char*)item.record.data())[nPos];
+                (void)sum;
+            }
+            else
+                item.file.reset();
+            while (!readQueue.TryPush(item) && !fAbort)
+                backoff.Wait();
+            backoff.Done(m_counters.nReadStallMicros, readStall);
+        }
+        fReadDone.store(true, std::memory_order_release);
+    };
+
+    // 解析阶段: 区块 n 写入槽位 n & (nSlots - 1), 槽位空出来之前等待
+    auto parser = [&]() {
+        TraceThreadName("pipeline-parse");
+        CBackoff backoff;
+        ReadItem item;
+        while (!fAbort)
+        {
+            if (!readQueue.TryPop(item))
+            {
+                // 读取阶段结束前入队的区块, 在看到结束标志后一定能取到
+                if (!fReadDone.load(std::memory_order_acquire))
+                {
+                    backoff.Wait();
+                    continue;
+                }
+                if (!readQueue.TryPop(item))
+                    break;
+            }
+            ParseSlot<Block>& slot = vSlots[item.nSeq & (nSlots - 1)];
+            while (slot.nSeq.load(std::memory_order_acquire) != item.nSeq && !fAbort)
+                backoff.Wait();
+            backoff.Done(m_counters.nParseStallMicros, parseStall);
+            if (fAbort)
+                break;
+            slot.pindex = item.pindex;
+            slot.nBytes = item.file ? item.record.size() : 0;
+            slot.fOk = item.file && Decode(slot.block, item.pindex, std::move(item.file), item.record);
+            nParsed++;
+            slot.nSeq.store(item.nSeq + 1, std::memory_order_release);
+            item = ReadItem();
+        }
+        backoff.Done(m_counters.nParseStallMicros, parseStall);
+    };
+
+    const int nParseThreads = options.nParseThreads > 0 ? options.nParseThreads : std::max(1, GetScheduler().GetConcurrency() - 1);
+    std::vector<std::thread> vThreads;
+    vThreads.emplace_back(reader);
+    for (int i = 0; i < nParseThreads; i++)
+        vThreads.emplace_back(parser);
+
+    // 消费阶段在调用线程上按顺序执行访问者
+    bool ok = true;
+    CBackoff backoff;
+    for (size_t i = 0; i < nBlocks; i++)
+    {
+        ParseSlot<Block>& slot = vSlots[i & (nSlots - 1)];
+        while (slot.nSeq.load(std::memory_order_acquire) != i + 1)
+        {
+            if (ShutdownRequested())
+            {
+                ok = false;
+                break;
+            }
+            backoff.Wait();
+        }
+        backoff.Done(m_counters.nConsumerStallMicros, consumerStall);
+        if (!ok)
+            break;
+        const uint64_t nReadQueue = readQueue.SizeApprox(), nParseQueue = nParsed - i;
+        UpdateMax(m_counters.nMaxReadQueue, nReadQueue);
+        UpdateMax(m_counters.nMaxParseQueue, nParseQueue);
+        m_counters.nSumReadQueue += nReadQueue;
+        m_counters.nSumParseQueue += nParseQueue;
+        readQueueDepth.Set(nReadQueue);
+        parseQueueDepth.Set(nParseQueue);
+
+        if (!slot.fOk)
+        {
+            LogError("%s: 读取区块失败, 高度: %d, 文件: %d, 偏移位置: %u\n", __func__, slot.pindex->nHeight, slot.pindex->nFile, slot.pindex->nDataPos);
+            ok = false;
+        }
+        else
+        {
+            TRACE_SPAN("Visitor", slot.pindex->nHeight);
+            ok = visitor(slot.pindex, slot.block);
+        }
+        nBytesAhead -= slot.nBytes;
+        m_counters.nBlocks++;
+        m_counters.nBytes += slot.nBytes;
+        slot.nSeq.store(i + nSlots, std::memory_order_release);
+        if (!ok)
+            break;
+    }
+    fAbort = true;
+    for (std::thread& t : vThreads)
+        t.join();
+    m_counters.nElapsedMicros = MicrosSince(start);
+    return ok;
+}
@@ -0,0 +1,101 @@
+#ifndef BLOCKCHAIN_BLOCKPIPELINE_H
+#define BLOCKCHAIN_BLOCKPIPELINE_H
+#include <atomic>
+#include <stdint.h>
+#include "blockMan.h"
+#include "blockScan.h"
+#include "span.h"
+
+//! Bytes of block data the I/O stage may have read ahead of the consumer
+static const uint64_t DEFAULT_PIPELINE_READAHEAD = 64 << 20;
+//! Located blocks waiting for a parse thread (entries are small, a file mapping and a span)
+static const int DEFAULT_PIPELINE_READ_QUEUE = 1024;
+//! Parsed blocks waiting for the consumer; each slot keeps a CBlock / CBlockView alive
+static const int DEFAULT_PIPELINE_PARSE_QUEUE = 64;
+
+struct BlockPipelineOptions
+{
+    //! see DEFAULT_PIPELINE_READAHEAD; a single larger block is still read
+    uint64_t nReadAheadBytes = DEFAULT_PIPELINE_READAHEAD;
+    //! number of parse threads, 0 = the scheduler's concurrency (-par) minus the I/O thread
+    int nParseThreads = 0;
+    //! queue capacities, rounded up to a power of two; see DEFAULT_PIPELINE_READ_QUEUE / DEFAULT_PIPELINE_PARSE_QUEUE
+    int nReadQueueDepth = DEFAULT_PIPELINE_READ_QUEUE;
+    int nParseQueueDepth = DEFAULT_PIPELINE_PARSE_QUEUE;
+};
+
+/**
+ * Counters of a pipeline run. Stall times are the time a stage spent waiting on its
+ * neighbours (summed over the parse threads), which tells which stage is the bottleneck:
+ * a consumer that never stalls is CPU bound itself, parse threads stalled on input mean
+ * the disk is the limit, an I/O stage stalled on the budget means everything downstream is.
+ */
+struct BlockPipelineStats
+{
+    uint64_t nBlocks = 0;
+    uint64_t nBytes = 0;
+    //! I/O stage waiting for read-ahead budget or room in the read queue
+    int64_t nReadStallMicros = 0;
+    //! parse threads waiting for a located block or for a free slot in the parse queue
+    int64_t nParseStallMicros = 0;
+    //! consumer waiting for the next block in order
+    int64_t nConsumerStallMicros = 0;
+    //! queue depths, sampled every time the consumer takes a block
+    uint64_t nMaxReadQueue = 0;
+    uint64_t nMaxParseQueue = 0;
+    double dAvgReadQueue = 0;
+    double dAvgParseQueue = 0;
+    int64_t nElapsedMicros = 0;
+};
+
+/**
+ * Reads a list of blocks in a three stage pipeline and hands them to a visitor in list order:
+ * - one I/O thread locates each block in its mapped file and faults its pages in, running
+ *   ahead of the consumer by at most nReadAheadBytes,
+ * - parse threads turn located blocks into CBlocks or CBlockViews,
+ * - the calling thread runs the visitor.
+ * The stages are joined by bounded lock-free ring buffers, so the disk and the cores are
+ * kept busy at the same time. Unlike CBlockScanner, which spreads whole files over
+ * threads, the pipeline delivers blocks strictly in order at close to disk speed.
+ */
+class CBlockPipeline
+{
+private:
+    BlockManager& m_blockman;
+    const Consensus::Params& m_consensus;
+
+    struct Counters
+    {
+        std::atomic<uint64_t> nBlocks{0}, nBytes{0};
+        std::atomic<int64_t> nReadStallMicros{0}, nParseStallMicros{0}, nConsumerStallMicros{0};
+        std::atomic<uint64_t> nMaxReadQueue{0}, nMaxParseQueue{0}, nSumReadQueue{0}, nSumParseQueue{0};
+        std::atomic<int64_t> nElapsedMicros{0};
+    };
+    Counters m_counters;
+
+    bool Decode(CBlock& block, const CBlockIndex* pindex, std::shared_ptr<const CMappedFile> /* file */, Span<const unsigned char> record) const
+    {
+        return m_blockman.DecodeBlock(block, pindex, record, m_consensus);
+    }
+    bool Decode(CBlockView& view, const CBlockIndex* pindex, std::shared_ptr<const CMappedFile> file, Span<const unsigned char> record) const
+    {
+        return m_blockman.DecodeBlockView(view, pindex, std::move(file), record, m_consensus);
+    }
+
+    template <typename Block>
+    bool RunImpl(Span<const CBlockIndex* const> vIndex, const std::function<bool(const CBlockIndex*, const Block&)>& visitor, const BlockPipelineOptions& options);
+
+public:
+    CBlockPipeline(BlockManager& blockman, const Consensus::Params& consensusParams) : m_blockman(blockman), m_consensus(consensusParams) {}
+
+    /** Read the blocks of vIndex and call visitor for each, in order. Returns false if a block could not be read or the visitor aborted. */
+    bool Run(Span<const CBlockIndex* const> vIndex, const BlockVisitor& visitor, const BlockPipelineOptions& options = BlockPipelineOptions());
+
+    /** Like Run, but the visitor gets zero-copy views; a view is only valid during the call. */
+    bool RunViews(Span<const CBlockIndex* const> vIndex, const BlockViewVisitor& visitor, const BlockPipelineOptions& options = BlockPipelineOptions());
+
+    /** Counters of the current or last run; may be called from another thread while a run is in progress. */
+    BlockPipelineStats GetStats() const;
+};
+
+#endif
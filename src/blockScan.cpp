@@ -0,0 +1,239 @@
+#include "blockScan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "logging.h"
+#include "memAccount.h"
+#include "scheduler.h"
+#include "shutdown.h"
+#include "trace.h"
+
+namespace
+{
+
+/** All blocks of the scan range that live in one blk file. */
+struct FileTask
+{
+    int nFile;
+    int nMinHeight;
+    TrackedVector<const CBlockIndex*, MemoryTag::SCAN> vBlocks;
+};
+
+/**
+ * Reorder buffer used in ordered mode: hands blocks to the visitor in height order. Its
+ * nodes and the pending block objects are counted in MemoryTag::SCAN.
+ */
+template <typename Block>
+class CHeightSequencer
+{
+private:
+    typedef std::function<bool(const CBlockIndex*, const Block&)> Visitor;
+
+    const Visitor& m_visitor;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    typedef std::pair<const CBlockIndex*, std::shared_ptr<const Block>> Pending;
+    std::map<int, Pending, std::less<int>, CTrackingAllocator<std::pair<const int, Pending>, MemoryTag::SCAN>> m_pending;
+    int m_next_height;
+    bool m_delivering = false;
+    bool m_failed = false;
+
+public:
+    CHeightSequencer(const Visitor& visitor, int nStartHeight) : m_visitor(visitor), m_next_height(nStartHeight) {}
+
+    /**
+     * Queue a parsed block and, unless another thread already does it, deliver every block that is
+     * now in sequence. A null pblock (an unreadable block being skipped) only advances the cursor.
+     */
+    bool Push(const CBlockIndex* pindex, std::shared_ptr<const Block> pblock)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pending.emplace(pindex->nHeight, std::make_pair(pindex, std::move(pblock)));
+        if (m_delivering)
+            return !m_failed;
+        m_delivering = true;
+        while (!m_failed && !m_pending.empty() && m_pending.begin()->first == m_next_height)
+        {
+            auto item = std::move(m_pending.begin()->second);
+            m_pending.erase(m_pending.begin());
+            // 访问者在锁外执行, 其他线程可以继续入队
+            lock.unlock();
+            bool ok = true;
+            if (item.second)
+            {
+                TRACE_SPAN("Visitor", item.first->nHeight);
+                ok = m_visitor(item.first, *item.second);
+            }
+            item.second.reset();
+            lock.lock();
+            if (!ok)
+                m_failed = true;
+            m_next_height++;
+        }
+        m_delivering = false;
+        m_cond.notify_all();
+        return !m_failed;
+    }
+
+    /** Block until a file starting at nMinHeight may be parsed without running too far ahead. */
+    bool WaitForWindow(int nMinHeight, int nMaxPending)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [&] { return m_failed || nMinHeight <= m_next_height + nMaxPending; });
+        return !m_failed;
+    }
+
+    void Abort()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failed = true;
+        m_cond.notify_all();
+    }
+};
+
+} // namespace
+
+bool CBlockScanner::Scan(const CChain& chain, const BlockVisitor& visitor, const BlockScanOptions& options)
+{
+    return ScanImpl<CBlock>(chain, visitor, options);
+}
+
+bool CBlockScanner::ScanViews(const CChain& chain, const BlockViewVisitor& visitor, const BlockScanOptions& options)
+{
+    return ScanImpl<CBlockView>(chain, visitor, options);
+}
+
+bool CBlockScanner::ScanWithUndo(const CChain& chain, const BlockUndoVisitor& visitor, const BlockScanOptions& options)
+{
+    return ScanImpl<BlockAndUndo>(
+        chain, [&visitor](const CBlockIndex* pindex, const BlockAndUndo& block) { return visitor(pindex, block.view, block.undo); }, options);
+}
+
+bool CBlockScanner::ReadForScan(const CBlockIndex* pindex, BlockAndUndo& block)
+{
+    if (!m_blockman.ReadBlockView(block.view, pindex, m_consensus) || !m_blockman.ReadBlockUndo(block.undo, pindex))
+        return false;
+    // hzx 检查 undo 记录与区块配对: 每个非 coinbase 交易一项, 每个输入一个 Coin
+    const size_t nTx = block.view.GetTxCount();
+    bool fMatch = block.undo.vtxundo.size() + 1 == nTx;
+    for (size_t i = 1; fMatch && i < nTx; i++)
+        fMatch = block.undo.vtxundo[i - 1].vprevout.size() == block.view.GetTx(i).GetInputCount();
+    if (!fMatch)
+    {
+        LogError("%s: undo 数据与区块不匹配, 高度: %d, 文件: %d\n", __func__, pindex->nHeight, pindex->nFile);
+        return false;
+    }
+    return true;
+}
+
+template <typename Block>
+bool CBlockScanner::ScanImpl(const CChain& chain, const std::function<bool(const CBlockIndex*, const Block&)>& visitor, const BlockScanOptions& options)
+{
+    const int nStart = std::max(options.nStartHeight, 0);
+    const int nStop = options.nStopHeight < 0 ? chain.Height() : std::min(options.nStopHeight, chain.Height());
+    if (nStart > nStop)
+        return true;
+
+    // hzx 按文件分组, 同一个 blk 文件只交给一个线程, 保证文件内顺序读
+    std::map<int, FileTask> mapTasks;
+    for (int nHeight = nStart; nHeight <= nStop; nHeight++)
+    {
+        const CBlockIndex* pindex = chain[nHeight];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        {
+            LogError("%s: 高度 %d 的区块数据不存在\n", __func__, nHeight);
+            return false;
+        }
+        FileTask& task = mapTasks[pindex->nFile];
+        if (task.vBlocks.empty())
+        {
+            task.nFile = pindex->nFile;
+            task.nMinHeight = nHeight;
+        }
+        task.vBlocks.push_back(pindex);
+    }
+
+    std::vector<FileTask> vTasks;
+    vTasks.reserve(mapTasks.size());
+    for (auto& item : mapTasks)
+    {
+        FileTask& task = item.second;
+        if (!options.fOrdered)
+        {
+            std::sort(task.vBlocks.begin(), task.vBlocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nDataPos < b->nDataPos; });
+        }
+        // 有序模式下文件内按高度处理(文件内的区块本身就接近高度顺序), 保证交付游标总能前进
+        vTasks.push_back(std::move(task));
+    }
+    // 低高度的文件先处理, 有序交付时缓冲区最小
+    std::sort(vTasks.begin(), vTasks.end(), [](const FileTask& a, const FileTask& b) { return a.nMinHeight < b.nMinHeight; });
+
+    int nThreads = options.nThreads > 0 ? options.nThreads : GetScheduler().GetConcurrency();
+    nThreads = std::min<int>(nThreads, vTasks.size());
+
+    std::atomic<size_t> nNextTask(0);
+    std::atomic<bool> fFailed(false);
+    CHeightSequencer<Block> sequencer(visitor, nStart);
+
+    auto worker = [&]() {
+        // 无序模式下同一个对象在本线程内反复使用; 有序模式下对象要留在重排缓冲区中, 每个区块单独分配
+        std::shared_ptr<Block> pblock;
+        while (!fFailed)
+        {
+            size_t i = nNextTask++;
+            if (i >= vTasks.size())
+                return;
+            const FileTask& task = vTasks[i];
+            if (options.fOrdered)
+            {
+                TRACE_SPAN("WaitForWindow", task.nMinHeight, task.nFile);
+                if (!sequencer.WaitForWindow(task.nMinHeight, options.nMaxPendingBlocks))
+                    return;
+            }
+            TRACE_SPAN("ScanFile", -1, task.nFile);
+            for (const CBlockIndex* pindex : task.vBlocks)
+            {
+                if (fFailed || ShutdownRequested())
+                {
+                    fFailed = true;
+                    break;
+                }
+                if (!pblock || options.fOrdered)
+                    pblock = std::allocate_shared<Block>(CTrackingAllocator<Block, MemoryTag::SCAN>());
+                bool ok = ReadForScan(pindex, *pblock);
+                if (!ok && options.fnReadError)
+                {
+                    // 跳过无法读取的区块; 有序模式下仍要让交付游标越过它
+                    ok = options.fnReadError(pindex) && (!options.fOrdered || sequencer.Push(pindex, nullptr));
+                }
+                else if (ok && options.fOrdered)
+                    ok = sequencer.Push(pindex, std::move(pblock));
+                else if (ok)
+                {
+                    TRACE_SPAN("Visitor", pindex->nHeight);
+                    ok = visitor(pindex, *pblock);
+                }
+                if (!ok)
+                {
+                    fFailed = true;
+                    sequencer.Abort();
+                    break;
+                }
+            }
+        }
+    };
+
+    // hzx 有序模式下任务会在 WaitForWindow 中阻塞, 它等待的是已被领取(正在运行)的文件, 不会等待仍在排队的任务
+    // 访问者内部等待的任务组只会帮忙运行它自己的任务, 不会在交付线程上领取本组的文件任务
+    CTaskGroup group;
+    for (int i = 1; i < nThreads; i++)
+        group.Run(worker);
+    worker();
+    group.Wait();
+    return !fFailed;
+}
@@ -0,0 +1,98 @@
+#ifndef BLOCKCHAIN_BLOCKSCAN_H
+#define BLOCKCHAIN_BLOCKSCAN_H
+#include <functional>
+#include "blockMan.h"
+#include "block.h"
+#include "blockView.h"
+#include "chain.h"
+#include "undo.h"
+
+/**
+ * Called once for every block of the scanned range. Return false to abort the scan.
+ * In unordered mode the visitor is invoked concurrently from several worker threads
+ * and must be thread-safe; in ordered mode calls are serialized and come in height order.
+ */
+typedef std::function<bool(const CBlockIndex*, const CBlock&)> BlockVisitor;
+
+/** Visitor for CBlockScanner::ScanViews; the view and its spans are only valid during the call. */
+typedef std::function<bool(const CBlockIndex*, const CBlockView&)> BlockViewVisitor;
+
+/**
+ * Visitor for CBlockScanner::ScanWithUndo. blockundo.vtxundo[i - 1] holds the coins spent by
+ * the inputs of transaction i of the view, in input order (the coinbase has no entry).
+ */
+typedef std::function<bool(const CBlockIndex*, const CBlockView&, const CBlockUndo&)> BlockUndoVisitor;
+
+//! Blocks parsed ahead of the delivery cursor before workers stop picking up new files (ordered mode)
+static const int DEFAULT_SCAN_MAX_PENDING_BLOCKS = 4096;
+
+struct BlockScanOptions
+{
+    //! files scanned at once on GetScheduler(), 0 = the scheduler's concurrency
+    int nThreads = 0;
+    //! deliver blocks to the visitor strictly in height order
+    bool fOrdered = false;
+    //! first and last height to scan; -1 = chain tip
+    int nStartHeight = 0;
+    int nStopHeight = -1;
+    //! see DEFAULT_SCAN_MAX_PENDING_BLOCKS
+    int nMaxPendingBlocks = DEFAULT_SCAN_MAX_PENDING_BLOCKS;
+    /**
+     * If set, a block that cannot be read (or whose undo data cannot be) is passed to this
+     * function, possibly from several threads at once, and skipped instead of aborting the
+     * scan; returning false still aborts it.
+     */
+    std::function<bool(const CBlockIndex*)> fnReadError;
+};
+
+/**
+ * Parallel full-chain block scanner.
+ *
+ * The blocks of the requested range are grouped by blk file; each worker takes a
+ * whole file at a time and walks it front to back, so reads within a file stay
+ * sequential while different files are parsed on different cores.
+ */
+class CBlockScanner
+{
+private:
+    BlockManager& m_blockman;
+    const Consensus::Params& m_consensus;
+
+    //! a block paired with its undo record, the unit ScanWithUndo passes through ScanImpl
+    struct BlockAndUndo
+    {
+        CBlockView view;
+        CBlockUndo undo;
+    };
+
+    bool ReadForScan(const CBlockIndex* pindex, CBlock& block) { return m_blockman.ReadBlockFromDisk(block, pindex, m_consensus); }
+    bool ReadForScan(const CBlockIndex* pindex, CBlockView& view) { return m_blockman.ReadBlockView(view, pindex, m_consensus); }
+
+    bool ReadForScan(const CBlockIndex* pindex, BlockAndUndo& block);
+
+    template <typename Block>
+    bool ScanImpl(const CChain& chain, const std::function<bool(const CBlockIndex*, const Block&)>& visitor, const BlockScanOptions& options);
+
+public:
+    CBlockScanner(BlockManager& blockman, const Consensus::Params& consensusParams) : m_blockman(blockman), m_consensus(consensusParams) {}
+
+    /** Scan the blocks of chain. Returns false if a block could not be read or the visitor aborted. */
+    bool Scan(const CChain& chain, const BlockVisitor& visitor, const BlockScanOptions& options = BlockScanOptions());
+
+    /**
+     * Like Scan, but hands the visitor a zero-copy CBlockView instead of a deserialized CBlock.
+     * In unordered mode every worker reuses one view, so once its tables have grown to the
+     * largest block no memory is allocated per block.
+     */
+    bool ScanViews(const CChain& chain, const BlockViewVisitor& visitor, const BlockScanOptions& options = BlockScanOptions());
+
+    /**
+     * Like ScanViews, but also reads the block's undo record from the rev file with the same
+     * number (by the same worker, right after the block) and checks that it has one entry per
+     * input. This resolves every prevout (value, script, height, coinbase flag) without a
+     * UTXO set; the blocks must have been connected, i.e. have BLOCK_HAVE_UNDO.
+     */
+    bool ScanWithUndo(const CChain& chain, const BlockUndoVisitor& visitor, const BlockScanOptions& options = BlockScanOptions());
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "blockVerify.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include "hash.h"
+#include "merkle.h"
+#include "script.h"
+#include "trace.h"
+
+namespace
+{
+//! OP_RETURN, push of 36 bytes, then the BIP141 commitment header 0xaa21a9ed
+const unsigned char WITNESS_COMMITMENT_HEADER[6] = {OP_RETURN, 0x24, 0xaa, 0x21, 0xa9, 0xed};
+const size_t MINIMUM_WITNESS_COMMITMENT = 38;
+} // namespace
+
+bool CheckBlockCommitments(const CBlockView& block, int nHeight, const Consensus::Params& consensusParams, std::string& strReason,
+                           std::vector<uint256>& vHash, std::vector<uint256>& vWitnessHash)
+{
+    // First transaction must be coinbase, the rest must not be
+    if (block.GetTxCount() == 0 || !block.GetTx(0).IsCoinBase())
+    {
+        strReason = "bad-cb-missing";
+        return false;
+    }
+    for (size_t i = 1; i < block.GetTxCount(); i++)
+    {
+        if (block.GetTx(i).IsCoinBase())
+        {
+            strReason = "bad-cb-multiple";
+            return false;
+        }
+    }
+
+    // hzx 一次批量计算所有 txid 与 wtxid
+    bool mutated = false;
+    uint256 hashMerkleRoot;
+    {
+        TRACE_SPAN("CheckMerkleRoot", nHeight);
+        block.GetTxHashes(vHash, &vWitnessHash);
+        hashMerkleRoot = ComputeMerkleRoot(vHash, &mutated);
+    }
+    if (hashMerkleRoot != block.GetHashMerkleRoot())
+    {
+        strReason = "bad-txnmrklroot";
+        return false;
+    }
+    // Check for merkle tree malleability (CVE-2012-2459): repeating sequences
+    // of transactions in a block without affecting the merkle root of a block,
+    // while still invalidating it.
+    if (mutated)
+    {
+        strReason = "bad-txns-duplicate";
+        return false;
+    }
+
+    // Validation for witness commitments.
+    // * We compute the witness hash (which is the hash including witnesses) of all the block's transactions, except the
+    //   coinbase (where 0x0000....0000 is used instead).
+    // * The coinbase scriptWitness is a stack of a single 32-byte vector, containing a witness reserved value (unconstrained).
+    // * We build a merkle tree with all those witness hashes as leaves (similar to the hashMerkleRoot in the block header).
+    // * There must be at least one output whose scriptPubKey is a single 36-byte push, the first 4 bytes of which are
+    //   {0xaa, 0x21, 0xa9, 0xed}, and the following 32 bytes are SHA256^2(witness root, witness reserved value). In case there are
+    //   multiple, the last one is used.
+    TRACE_SPAN("CheckWitnessCommitment", nHeight);
+    const CTransactionView coinbase = block.GetTx(0);
+    Span<const unsigned char> commitment;
+    for (size_t o = 0; o < coinbase.GetOutputCount(); o++)
+    {
+        Span<const unsigned char> script = coinbase.GetOutput(o).GetScriptPubKey();
+        if ((size_t)script.size() >= MINIMUM_WITNESS_COMMITMENT && memcmp(script.data(), WITNESS_COMMITMENT_HEADER, sizeof(WITNESS_COMMITMENT_HEADER)) == 0)
+            commitment = script;
+    }
+    bool fHaveWitness = false;
+    if (nHeight >= consensusParams.SegwitHeight && commitment.size())
+    {
+        const CTxInView coinbase_in = coinbase.GetInput(0);
+        if (coinbase_in.GetWitnessCount() != 1 || coinbase_in.GetWitness(0).size() != 32)
+        {
+            strReason = "bad-witness-nonce-size";
+            return false;
+        }
+        // The malleation check is ignored; as the transaction tree itself
+        // already does not permit it, it is impossible to trigger in the
+        // witness tree.
+        vWitnessHash[0].SetNull();
+        const uint256 hashWitness = ComputeMerkleRoot(vWitnessHash);
+        const Span<const unsigned char> nonce = coinbase_in.GetWitness(0);
+        const uint256 hashCommitment = Hash(hashWitness.begin(), hashWitness.end(), nonce.begin(), nonce.end());
+        if (memcmp(hashCommitment.begin(), commitment.data() + 6, 32))
+        {
+            strReason = "bad-witness-merkle-match";
+            return false;
+        }
+        fHaveWitness = true;
+    }
+
+    // No witness data is allowed in blocks that don't commit to witness data, as this would otherwise leave room for spam
+    if (!fHaveWitness)
+    {
+        for (size_t i = 0; i < block.GetTxCount(); i++)
+        {
+            if (block.GetTx(i).HasWitness())
+            {
+                strReason = "unexpected-witness";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool VerifyBlocks(BlockManager& blockman, const Consensus::Params& consensusParams, const CChain& chain,
+                  const BlockVerifyOptions& options, std::vector<BlockVerifyFailure>& vFailures)
+{
+    std::mutex cs_failures;
+    auto fail = [&](const CBlockIndex* pindex, const std::string& strReason) {
+        std::lock_guard<std::mutex> lock(cs_failures);
+        vFailures.push_back({pindex->nHeight, pindex->nFile, pindex->nDataPos, pindex->GetBlockHash(), strReason});
+    };
+
+    // hzx 读取失败(记录头、大小或工作量不对)只记录下来, 扫描继续
+    BlockScanOptions scan = options.scan;
+    scan.fnReadError = [&](const CBlockIndex* pindex) {
+        fail(pindex, "read-failed");
+        return true;
+    };
+
+    CBlockScanner scanner(blockman, consensusParams);
+    const bool ok = scanner.ScanViews(chain, [&](const CBlockIndex* pindex, const CBlockView& block) {
+        // 每个线程一份临时空间
+        thread_local std::vector<uint256> vHash, vWitnessHash;
+        std::string strReason;
+        if (!CheckBlockCommitments(block, pindex->nHeight, consensusParams, strReason, vHash, vWitnessHash))
+            fail(pindex, strReason);
+        else if (pindex->nTx && block.GetTxCount() != pindex->nTx)
+            fail(pindex, "bad-tx-count");
+        if (options.fCheckUndo && (pindex->nStatus & BLOCK_HAVE_UNDO) && pindex->pprev)
+        {
+            std::shared_ptr<const CMappedFile> file;
+            Span<const unsigned char> record;
+            if (!blockman.LocateUndo(pindex, file, record))
+                fail(pindex, "bad-undo");
+        }
+        return true;
+    }, scan);
+
+    std::sort(vFailures.begin(), vFailures.end(), [](const BlockVerifyFailure& a, const BlockVerifyFailure& b) { return a.nHeight < b.nHeight; });
+    return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef BLOCKCHAIN_BLOCKVERIFY_H
+#define BLOCKCHAIN_BLOCKVERIFY_H
+#include <string>
+#include <vector>
+#include "blockMan.h"
+#include "blockScan.h"
+#include "blockView.h"
+#include "chain.h"
+#include "params.h"
+
+/** A stored block that failed verification. */
+struct BlockVerifyFailure
+{
+    int nHeight;
+    int nFile;
+    unsigned int nDataPos;
+    uint256 hash;
+    //! bitcoind style reject reason, e.g. "bad-txnmrklroot", or "read-failed" / "bad-undo"
+    std::string strReason;
+};
+
+struct BlockVerifyOptions
+{
+    //! how blocks are spread over threads, see BlockScanOptions (fnReadError is set by VerifyBlocks)
+    BlockScanOptions scan;
+    //! also verify the checksum of the undo record of every block that has one
+    bool fCheckUndo = true;
+};
+
+/**
+ * Check the commitments a block makes to its own contents: the first transaction is the only
+ * coinbase, the merkle root matches and is not malleated by duplicate subtrees (CVE-2012-2459),
+ * and, from consensusParams.SegwitHeight on, the coinbase witness commitment (BIP141) matches
+ * the witness merkle root, or no transaction has witness data if there is no commitment.
+ * vHash and vWitnessHash are scratch space that callers can reuse between blocks.
+ */
+bool CheckBlockCommitments(const CBlockView& block, int nHeight, const Consensus::Params& consensusParams, std::string& strReason,
+                           std::vector<uint256>& vHash, std::vector<uint256>& vWitnessHash);
+
+/**
+ * Verify every block of chain (in the height range of options.scan) on all cores: the block
+ * must be readable, its header must hash to the index entry and meet nBits, and
+ * CheckBlockCommitments must pass. Failures are collected in vFailures, sorted by height,
+ * instead of stopping the scan. Returns false only if the scan itself could not be completed.
+ */
+bool VerifyBlocks(BlockManager& blockman, const Consensus::Params& consensusParams, const CChain& chain,
+                  const BlockVerifyOptions& options, std::vector<BlockVerifyFailure>& vFailures);
+
+#endif
@@ -0,0 +1,406 @@
+#include "blockView.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "hash.h"
+#include "memusage.h"
+#include "serialize.h"
+#include "sha256.h"
+
+namespace
+{
+/** Bounds-checked cursor over the raw block; every method returns false instead of throwing. */
+class CRawCursor
+{
+private:
+    const unsigned char* const m_begin;
+    const unsigned char* m_pos;
+    const unsigned char* const m_end;
+
+public:
+    explicit CRawCursor(Span<const unsigned char> data) : m_begin(data.begin()), m_pos(data.begin()), m_end(data.end()) {}
+
+    uint32_t Pos() const { return m_pos - m_begin; }
+    bool AtEnd() const { return m_pos == m_end; }
+
+    bool Skip(uint64_t n)
+    {
+        if (n > (uint64_t)(m_end - m_pos))
+            return false;
+        m_pos += n;
+        return true;
+    }
+
+    bool ReadByte(uint8_t& n)
+    {
+        if (m_pos == m_end)
+            return false;
+        n = *m_pos++;
+        return true;
+    }
+
+    /** Same rules as ::ReadCompactSize: canonical encoding only and at most MAX_SIZE. */
+    bool ReadCompactSize(uint64_t& n)
+    {
+        uint8_t chSize;
+        if (!ReadByte(chSize))
+            return false;
+        uint64_t nMin = 0;
+        int nBytes = 0;
+        if (chSize < 253)
+            n = chSize;
+        else if (chSize == 253)
+            nBytes = 2, nMin = 253;
+        else if (chSize == 254)
+            nBytes = 4, nMin = 0x10000;
+        else
+            nBytes = 8, nMin = 0x100000000ULL;
+        if (nBytes)
+        {
+            if (m_end - m_pos < nBytes)
+                return false;
+            n = 0;
+            for (int i = nBytes - 1; i >= 0; i--)
+                n = (n << 8) | m_pos[i];
+            m_pos += nBytes;
+            if (n < nMin)
+                return false;
+        }
+        return n <= MAX_SIZE;
+    }
+
+    /** A length-prefixed byte string (script or witness item). */
+    bool ReadBytes(uint32_t& nPos, uint32_t& nLen)
+    {
+        uint64_t n;
+        if (!ReadCompactSize(n) || !Skip(n))
+            return false;
+        nPos = Pos() - n;
+        nLen = n;
+        return true;
+    }
+};
+} // namespace
+
+void CBlockView::Clear()
+{
+    m_data = Span<const unsigned char>();
+    m_owner.reset();
+    m_txs.clear();
+    m_inputs.clear();
+    m_outputs.clear();
+    m_witness.clear();
+}
+
+// hzx 与 UnserializeTransaction 的规则一致: vin 为空时下一个字节是 flag, flag 的最低位表示带见证数据,
+// 见证数据全为空或 flag 有未知位都视为格式错误
+bool CBlockView::Parse(Span<const unsigned char> data, std::shared_ptr<const void> owner)
+{
+    Clear();
+    if (data.size() < (std::ptrdiff_t)HEADER_SIZE || (uint64_t)data.size() > std::numeric_limits<uint32_t>::max())
+        return false;
+    CRawCursor cur(data);
+    uint64_t nTx;
+    if (!cur.Skip(HEADER_SIZE) || !cur.ReadCompactSize(nTx))
+        return false;
+    // 每笔交易至少 10 字节, 防止错误的数量导致过量分配
+    m_txs.reserve(std::min<uint64_t>(nTx, data.size() / 10));
+
+    bool ok = true;
+    for (uint64_t t = 0; ok && t < nTx; t++)
+    {
+        TxEntry tx;
+        tx.nBegin = cur.Pos();
+        tx.fWitness = false;
+        uint8_t nFlags = 0;
+        uint64_t nIn = 0, nOut = 0;
+        if (!cur.Skip(4))
+            break;
+        tx.nIoBegin = cur.Pos();
+        if (!cur.ReadCompactSize(nIn))
+            break;
+        if (nIn == 0)
+        {
+            if (!cur.ReadByte(nFlags))
+                break;
+            if (nFlags != 0)
+            {
+                tx.nIoBegin = cur.Pos();
+                if (!cur.ReadCompactSize(nIn))
+                    break;
+            }
+        }
+        tx.nFirstInput = m_inputs.size();
+        tx.nInputs = nIn;
+        for (uint64_t i = 0; ok && i < nIn; i++)
+        {
+            InEntry in;
+            in.nPos = cur.Pos();
+            in.nFirstWitness = 0;
+            in.nWitness = 0;
+            ok = cur.Skip(36) && cur.ReadBytes(in.nScriptPos, in.nScriptLen) && cur.Skip(4);
+            m_inputs.push_back(in);
+        }
+        // vin 为空且 flag 为 0 时, 这个 0 实际上是 vout 的数量
+        if (!ok || ((nIn || nFlags) && !cur.ReadCompactSize(nOut)))
+            break;
+        tx.nFirstOutput = m_outputs.size();
+        tx.nOutputs = nOut;
+        for (uint64_t i = 0; ok && i < nOut; i++)
+        {
+            OutEntry out;
+            out.nPos = cur.Pos();
+            ok = cur.Skip(8) && cur.ReadBytes(out.nScriptPos, out.nScriptLen);
+            m_outputs.push_back(out);
+        }
+        if (!ok)
+            break;
+        tx.nIoEnd = cur.Pos();
+        if (nFlags & 1)
+        {
+            nFlags ^= 1;
+            for (uint64_t i = 0; ok && i < nIn; i++)
+            {
+                InEntry& in = m_inputs[tx.nFirstInput + i];
+                uint64_t nItems = 0;
+                ok = cur.ReadCompactSize(nItems);
+                in.nFirstWitness = m_witness.size();
+                in.nWitness = nItems;
+                for (uint64_t j = 0; ok && j < nItems; j++)
+                {
+                    ItemEntry item;
+                    ok = cur.ReadBytes(item.nPos, item.nLen);
+                    m_witness.push_back(item);
+                }
+                tx.fWitness |= nItems > 0;
+            }
+            // Superfluous witness record
+            if (!tx.fWitness)
+                ok = false;
+        }
+        // Unknown optional data
+        if (!ok || nFlags || !cur.Skip(4))
+            break;
+        tx.nEnd = cur.Pos();
+        m_txs.push_back(tx);
+    }
+    if (!ok || m_txs.size() != nTx || !cur.AtEnd())
+    {
+        Clear();
+        return false;
+    }
+    m_data = data;
+    m_owner = std::move(owner);
+    return true;
+}
+
+uint256 CBlockView::GetHashPrevBlock() const
+{
+    uint256 ret;
+    memcpy(ret.begin(), At(4), 32);
+    return ret;
+}
+
+uint256 CBlockView::GetHashMerkleRoot() const
+{
+    uint256 ret;
+    memcpy(ret.begin(), At(36), 32);
+    return ret;
+}
+
+CBlockHeader CBlockView::GetBlockHeader() const
+{
+    CBlockHeader header;
+    header.nVersion = GetVersion();
+    header.hashPrevBlock = GetHashPrevBlock();
+    header.hashMerkleRoot = GetHashMerkleRoot();
+    header.nTime = GetTime();
+    header.nBits = GetBits();
+    header.nNonce = GetNonce();
+    return header;
+}
+
+uint256 CBlockView::GetHash() const
+{
+    return Hash(At(0), At(HEADER_SIZE));
+}
+
+void CBlockView::GetTxHashes(std::vector<uint256>& vHash, std::vector<uint256>* vWitnessHash) const
+{
+    // 前 nTx 个消息是 txid, 之后是有见证交易的 wtxid; 有见证交易的 txid 原像需要拼接到 m_stripped 中
+    m_stripped.clear();
+    m_hash_input.clear();
+    m_hash_len.clear();
+    size_t nStripped = 0;
+    for (const TxEntry& tx : m_txs)
+        if (tx.fWitness)
+            nStripped += 8 + tx.nIoEnd - tx.nIoBegin;
+    m_stripped.reserve(nStripped);
+    for (const TxEntry& tx : m_txs)
+    {
+        if (!tx.fWitness)
+        {
+            m_hash_input.push_back(At(tx.nBegin));
+            m_hash_len.push_back(tx.nEnd - tx.nBegin);
+            continue;
+        }
+        m_hash_input.push_back(m_stripped.data() + m_stripped.size());
+        m_hash_len.push_back(8 + tx.nIoEnd - tx.nIoBegin);
+        m_stripped.insert(m_stripped.end(), At(tx.nBegin), At(tx.nBegin + 4));
+        m_stripped.insert(m_stripped.end(), At(tx.nIoBegin), At(tx.nIoEnd));
+        m_stripped.insert(m_stripped.end(), At(tx.nEnd - 4), At(tx.nEnd));
+    }
+    if (vWitnessHash)
+    {
+        for (const TxEntry& tx : m_txs)
+        {
+            if (tx.fWitness)
+            {
+                m_hash_input.push_back(At(tx.nBegin));
+                m_hash_len.push_back(tx.nEnd - tx.nBegin);
+            }
+        }
+    }
+    std::vector<uint256> vAll;
+    std::vector<uint256>& vOut = vWitnessHash ? vAll : vHash;
+    vOut.resize(m_hash_input.size());
+    SHA256DBatch(vOut.empty() ? nullptr : vOut[0].begin(), m_hash_input.data(), m_hash_len.data(), m_hash_input.size());
+    if (!vWitnessHash)
+        return;
+    vHash.assign(vAll.begin(), vAll.begin() + m_txs.size());
+    vWitnessHash->resize(m_txs.size());
+    size_t nWitness = m_txs.size();
+    for (size_t i = 0; i < m_txs.size(); i++)
+        (*vWitnessHash)[i] = m_txs[i].fWitness ? vAll[nWitness++] : vAll[i];
+}
+
+Span<const unsigned char> CTxInView::GetPrevHashBytes() const
+{
+    return Span<const unsigned char>(m_block->At(m_block->m_inputs[m_index].nPos), 32);
+}
+
+uint256 CTxInView::GetPrevHash() const
+{
+    uint256 ret;
+    memcpy(ret.begin(), m_block->At(m_block->m_inputs[m_index].nPos), 32);
+    return ret;
+}
+
+uint32_t CTxInView::GetPrevIndex() const
+{
+    return ReadLE32(m_block->At(m_block->m_inputs[m_index].nPos + 32));
+}
+
+bool CTxInView::IsCoinBase() const
+{
+    const unsigned char* p = m_block->At(m_block->m_inputs[m_index].nPos);
+    return GetPrevIndex() == std::numeric_limits<uint32_t>::max() && std::all_of(p, p + 32, [](unsigned char c) { return c == 0; });
+}
+
+Span<const unsigned char> CTxInView::GetScriptSig() const
+{
+    const CBlockView::InEntry& in = m_block->m_inputs[m_index];
+    return Span<const unsigned char>(m_block->At(in.nScriptPos), in.nScriptLen);
+}
+
+uint32_t CTxInView::GetSequence() const
+{
+    const CBlockView::InEntry& in = m_block->m_inputs[m_index];
+    return ReadLE32(m_block->At(in.nScriptPos + in.nScriptLen));
+}
+
+size_t CTxInView::GetWitnessCount() const
+{
+    return m_block->m_inputs[m_index].nWitness;
+}
+
+Span<const unsigned char> CTxInView::GetWitness(size_t i) const
+{
+    const CBlockView::ItemEntry& item = m_block->m_witness[m_block->m_inputs[m_index].nFirstWitness + i];
+    return Span<const unsigned char>(m_block->At(item.nPos), item.nLen);
+}
+
+CAmount CTxOutView::GetValue() const
+{
+    return (CAmount)ReadLE64(m_block->At(m_block->m_outputs[m_index].nPos));
+}
+
+Span<const unsigned char> CTxOutView::GetScriptPubKey() const
+{
+    const CBlockView::OutEntry& out = m_block->m_outputs[m_index];
+    return Span<const unsigned char>(m_block->At(out.nScriptPos), out.nScriptLen);
+}
+
+int32_t CTransactionView::GetVersion() const
+{
+    return ReadLE32(m_block->At(m_block->m_txs[m_index].nBegin));
+}
+
+uint32_t CTransactionView::GetLockTime() const
+{
+    return ReadLE32(m_block->At(m_block->m_txs[m_index].nEnd - 4));
+}
+
+bool CTransactionView::HasWitness() const
+{
+    return m_block->m_txs[m_index].fWitness;
+}
+
+bool CTransactionView::IsCoinBase() const
+{
+    return GetInputCount() == 1 && GetInput(0).IsCoinBase();
+}
+
+size_t CTransactionView::GetInputCount() const
+{
+    return m_block->m_txs[m_index].nInputs;
+}
+
+CTxInView CTransactionView::GetInput(size_t i) const
+{
+    return CTxInView(m_block, m_block->m_txs[m_index].nFirstInput + i);
+}
+
+size_t CTransactionView::GetOutputCount() const
+{
+    return m_block->m_txs[m_index].nOutputs;
+}
+
+CTxOutView CTransactionView::GetOutput(size_t i) const
+{
+    return CTxOutView(m_block, m_block->m_txs[m_index].nFirstOutput + i);
+}
+
+Span<const unsigned char> CTransactionView::GetBytes() const
+{
+    const CBlockView::TxEntry& tx = m_block->m_txs[m_index];
+    return Span<const unsigned char>(m_block->At(tx.nBegin), tx.nEnd - tx.nBegin);
+}
+
+uint256 CTransactionView::GetHash() const
+{
+    const CBlockView::TxEntry& tx = m_block->m_txs[m_index];
+    if (!tx.fWitness)
+        return GetWitnessHash();
+    // nVersion | vin vout | nLockTime, 跳过 marker/flag 与见证数据
+    uint256 result;
+    CHash256()
+        .Write(m_block->At(tx.nBegin), 4)
+        .Write(m_block->At(tx.nIoBegin), tx.nIoEnd - tx.nIoBegin)
+        .Write(m_block->At(tx.nEnd - 4), 4)
+        .Finalize(result.begin());
+    return result;
+}
+
+uint256 CTransactionView::GetWitnessHash() const
+{
+    const CBlockView::TxEntry& tx = m_block->m_txs[m_index];
+    return Hash(m_block->At(tx.nBegin), m_block->At(tx.nEnd));
+}
+
+size_t CBlockView::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(m_txs) + memusage::DynamicUsage(m_inputs) + memusage::DynamicUsage(m_outputs) + memusage::DynamicUsage(m_witness) +
+           memusage::DynamicUsage(m_stripped) + memusage::DynamicUsage(m_hash_input) + memusage::DynamicUsage(m_hash_len);
+}
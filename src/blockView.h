@@ -0,0 +1,186 @@
+#ifndef BLOCKCHAIN_BLOCKVIEW_H
+#define BLOCKCHAIN_BLOCKVIEW_H
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include "amount.h"
+#include "block.h"
+#include "common.h"
+#include "memAccount.h"
+#include "span.h"
+#include "uint256.h"
+
+class CBlockView;
+
+/**
+ * Read-only, zero-copy access to a serialized block (the bytes returned by
+ * BlockManager::ReadRawBlockFromDisk / LocateBlock).
+ *
+ * CBlockView::Parse walks the block once and records the offsets of every transaction,
+ * input, output and witness item in flat tables; the accessors below only do pointer
+ * arithmetic into the original buffer and return Spans into it. The tables are kept
+ * between Parse calls, so a view reused for block after block stops allocating once it
+ * has seen the largest block. All views and spans are invalidated by the next Parse and
+ * must not outlive the buffer (the owner passed to Parse can pin it).
+ */
+class CTxInView
+{
+private:
+    const CBlockView* m_block;
+    uint32_t m_index;
+
+public:
+    CTxInView(const CBlockView* block, uint32_t index) : m_block(block), m_index(index) {}
+
+    //! the 32-byte txid of the spent output, in serialization order (as uint256)
+    Span<const unsigned char> GetPrevHashBytes() const;
+    uint256 GetPrevHash() const;
+    uint32_t GetPrevIndex() const;
+    bool IsCoinBase() const;
+    Span<const unsigned char> GetScriptSig() const;
+    uint32_t GetSequence() const;
+    size_t GetWitnessCount() const;
+    Span<const unsigned char> GetWitness(size_t i) const;
+};
+
+class CTxOutView
+{
+private:
+    const CBlockView* m_block;
+    uint32_t m_index;
+
+public:
+    CTxOutView(const CBlockView* block, uint32_t index) : m_block(block), m_index(index) {}
+
+    CAmount GetValue() const;
+    Span<const unsigned char> GetScriptPubKey() const;
+};
+
+class CTransactionView
+{
+private:
+    const CBlockView* m_block;
+    uint32_t m_index;
+
+public:
+    CTransactionView(const CBlockView* block, uint32_t index) : m_block(block), m_index(index) {}
+
+    int32_t GetVersion() const;
+    uint32_t GetLockTime() const;
+    bool HasWitness() const;
+    bool IsCoinBase() const;
+
+    size_t GetInputCount() const;
+    CTxInView GetInput(size_t i) const;
+    size_t GetOutputCount() const;
+    CTxOutView GetOutput(size_t i) const;
+
+    //! the complete serialization, including marker, flag and witness data
+    Span<const unsigned char> GetBytes() const;
+    //! txid (computed from the bytes on every call)
+    uint256 GetHash() const;
+    //! wtxid, equal to the txid for transactions without witness
+    uint256 GetWitnessHash() const;
+};
+
+class CBlockView
+{
+private:
+    friend class CTxInView;
+    friend class CTxOutView;
+    friend class CTransactionView;
+
+    struct TxEntry
+    {
+        uint32_t nBegin;      //!< nVersion
+        uint32_t nIoBegin;    //!< vin count (after marker and flag)
+        uint32_t nIoEnd;      //!< end of vout
+        uint32_t nEnd;        //!< end of nLockTime
+        uint32_t nFirstInput;
+        uint32_t nInputs;
+        uint32_t nFirstOutput;
+        uint32_t nOutputs;
+        bool fWitness;
+    };
+    struct InEntry
+    {
+        uint32_t nPos;       //!< prevout; scriptSig length follows it
+        uint32_t nScriptPos; //!< scriptSig; nSequence follows it
+        uint32_t nScriptLen;
+        uint32_t nFirstWitness;
+        uint32_t nWitness;
+    };
+    struct OutEntry
+    {
+        uint32_t nPos; //!< nValue
+        uint32_t nScriptPos;
+        uint32_t nScriptLen;
+    };
+    struct ItemEntry
+    {
+        uint32_t nPos;
+        uint32_t nLen;
+    };
+
+    Span<const unsigned char> m_data;
+    std::shared_ptr<const void> m_owner;
+    //! the tables are counted in MemoryTag::BLOCK_VIEW; m_data belongs to the caller
+    TrackedVector<TxEntry, MemoryTag::BLOCK_VIEW> m_txs;
+    TrackedVector<InEntry, MemoryTag::BLOCK_VIEW> m_inputs;
+    TrackedVector<OutEntry, MemoryTag::BLOCK_VIEW> m_outputs;
+    TrackedVector<ItemEntry, MemoryTag::BLOCK_VIEW> m_witness;
+    //! scratch space for GetTxHashes
+    mutable TrackedVector<unsigned char, MemoryTag::BLOCK_VIEW> m_stripped;
+    mutable TrackedVector<const unsigned char*, MemoryTag::BLOCK_VIEW> m_hash_input;
+    mutable TrackedVector<size_t, MemoryTag::BLOCK_VIEW> m_hash_len;
+
+    const unsigned char* At(uint32_t nPos) const { return m_data.data() + nPos; }
+
+public:
+    static const size_t HEADER_SIZE = 80;
+
+    CBlockView() {}
+    CBlockView(const CBlockView&) = delete;
+    CBlockView& operator=(const CBlockView&) = delete;
+
+    /**
+     * Index the serialized block in data (with witness data, as stored on disk). Returns
+     * false if it is malformed or has trailing bytes; the view is then empty. owner (e.g.
+     * the mapped blk file) is kept alive for as long as the view refers to data.
+     */
+    bool Parse(Span<const unsigned char> data, std::shared_ptr<const void> owner = nullptr);
+
+    void Clear();
+
+    bool IsNull() const { return m_data.size() == 0; }
+
+    Span<const unsigned char> GetBytes() const { return m_data; }
+    Span<const unsigned char> GetHeaderBytes() const { return m_data.first(HEADER_SIZE); }
+
+    int32_t GetVersion() const { return ReadLE32(At(0)); }
+    uint256 GetHashPrevBlock() const;
+    uint256 GetHashMerkleRoot() const;
+    uint32_t GetTime() const { return ReadLE32(At(68)); }
+    uint32_t GetBits() const { return ReadLE32(At(72)); }
+    uint32_t GetNonce() const { return ReadLE32(At(76)); }
+    CBlockHeader GetBlockHeader() const;
+    uint256 GetHash() const;
+
+    size_t GetTxCount() const { return m_txs.size(); }
+    CTransactionView GetTx(size_t i) const { return CTransactionView(this, i); }
+
+    //! inputs and outputs of all transactions, for callers that only need totals
+    size_t GetInputCount() const { return m_inputs.size(); }
+    size_t GetOutputCount() const { return m_outputs.size(); }
+
+    /**
+     * Compute every txid (and, if vWitnessHash is not null, every wtxid) with one
+     * SHA256DBatch call, like UnserializeBlockBatchHash.
+     */
+    void GetTxHashes(std::vector<uint256>& vHash, std::vector<uint256>* vWitnessHash = nullptr) const;
+
+    //! heap bytes of the tables (not of the block bytes, which the view does not own)
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif
@@ -362,6 +362,9 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/** Compute what height to jump back to with the CBlockIndex::pskip pointer. */
+int GetSkipHeight(int height);
+
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
@@ -413,7 +416,8 @@ public:
         READWRITE(nNonce);
     }
 
-    uint256 GetBlockHash() const
+    //! the header as stored, with hashPrev instead of pprev
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion = nVersion;
@@ -422,7 +426,12 @@ public:
         block.nTime = nTime;
         block.nBits = nBits;
         block.nNonce = nNonce;
-        return block.GetHash();
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        return GetBlockHeader().GetHash();
     }
 
 
@@ -0,0 +1,531 @@
+#include "chainGen.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include "arith_uint256.h"
+#include "blkMmap.h"
+#include "clientversion.h"
+#include "common.h"
+#include "hash.h"
+#include "logging.h"
+#include "merkle.h"
+#include "streams.h"
+#include "time.h"
+#include "txdb.h"
+#include "undo.h"
+
+static const char* const SCRIPT_NAMES[(int)SyntheticScript::COUNT] = {"p2pkh", "p2sh", "p2wpkh", "p2wsh", "p2tr", "nulldata"};
+
+const char* GetSyntheticScriptName(SyntheticScript t)
+{
+    return (int)t < (int)SyntheticScript::COUNT ? SCRIPT_NAMES[(int)t] : "unknown";
+}
+
+bool ParseScriptMix(const std::string& mix, ChainGenOptions& options)
+{
+    unsigned int vWeights[(int)SyntheticScript::COUNT] = {};
+    size_t nPos = 0;
+    while (nPos < mix.size())
+    {
+        size_t nEnd = mix.find(',', nPos);
+        if (nEnd == std::string::npos)
+            nEnd = mix.size();
+        const std::string item = mix.substr(nPos, nEnd - nPos);
+        const size_t nColon = item.find(':');
+        if (nColon == std::string::npos)
+            return false;
+        const std::string name = item.substr(0, nColon);
+        int t = 0;
+        while (t < (int)SyntheticScript::COUNT && name != SCRIPT_NAMES[t])
+            t++;
+        char* pend = nullptr;
+        const long nWeight = strtol(item.c_str() + nColon + 1, &pend, 10);
+        if (t == (int)SyntheticScript::COUNT || *pend != '\0' || nWeight < 0)
+            return false;
+        vWeights[t] = nWeight;
+        nPos = nEnd + 1;
+    }
+    unsigned int nTotal = 0;
+    for (unsigned int nWeight : vWeights)
+        nTotal += nWeight;
+    if (nTotal == 0)
+        return false;
+    memcpy(options.vScriptWeights, vWeights, sizeof(vWeights));
+    return true;
+}
+
+namespace
+{
+static bool IsWitnessScript(SyntheticScript t)
+{
+    return t == SyntheticScript::P2WPKH || t == SyntheticScript::P2WSH || t == SyntheticScript::P2TR;
+}
+
+/** An unspent output of the synthetic chain, kept as the Coin its spender records in the undo data. */
+struct CSpendable
+{
+    COutPoint prevout;
+    Coin coin;
+    SyntheticScript type;
+};
+
+/** Builds the blocks; the index and file bookkeeping lives in GenerateSyntheticChain. */
+class CChainGenerator
+{
+private:
+    const ChainGenOptions& m_options;
+    std::mt19937_64 m_rng;
+    unsigned int m_total_weight;
+    //! unspent outputs that are spent with a scriptSig (0) or with witness data (1)
+    std::vector<CSpendable> m_pool[2];
+
+public:
+    uint64_t nWitnessTx = 0;
+    uint64_t vOutputs[(int)SyntheticScript::COUNT] = {};
+
+    explicit CChainGenerator(const ChainGenOptions& options) : m_options(options), m_rng(options.nSeed), m_total_weight(0)
+    {
+        for (unsigned int nWeight : options.vScriptWeights)
+            m_total_weight += nWeight;
+    }
+
+    std::vector<unsigned char> RandomBytes(size_t n)
+    {
+        std::vector<unsigned char> ret(n);
+        for (unsigned char& c : ret)
+            c = m_rng();
+        return ret;
+    }
+
+    //! DER encoded ECDSA signatures are 71 or 72 bytes including the sighash byte
+    std::vector<unsigned char> RandomSignature() { return RandomBytes(71 + m_rng() % 2); }
+
+    std::vector<unsigned char> RandomPubKey()
+    {
+        std::vector<unsigned char> ret = RandomBytes(33);
+        ret[0] = 2 + (ret[0] & 1);
+        return ret;
+    }
+
+    CScript MultisigScript()
+    {
+        return CScript() << OP_2 << RandomPubKey() << RandomPubKey() << RandomPubKey() << OP_3 << OP_CHECKMULTISIG;
+    }
+
+    SyntheticScript PickScript(bool fSpendable)
+    {
+        while (true)
+        {
+            unsigned int n = m_rng() % m_total_weight;
+            int t = 0;
+            while (n >= m_options.vScriptWeights[t])
+                n -= m_options.vScriptWeights[t++];
+            if (!fSpendable || (SyntheticScript)t != SyntheticScript::NULL_DATA)
+                return (SyntheticScript)t;
+            // hzx 只允许 OP_RETURN 时没有可花费的类型, 退回到 P2PKH
+            if (m_options.vScriptWeights[t] == m_total_weight)
+                return SyntheticScript::P2PKH;
+        }
+    }
+
+    CScript OutputScript(SyntheticScript t)
+    {
+        switch (t)
+        {
+        case SyntheticScript::P2PKH:
+            return CScript() << OP_DUP << OP_HASH160 << RandomBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        case SyntheticScript::P2SH:
+            return CScript() << OP_HASH160 << RandomBytes(20) << OP_EQUAL;
+        case SyntheticScript::P2WPKH:
+            return CScript() << OP_0 << RandomBytes(20);
+        case SyntheticScript::P2WSH:
+            return CScript() << OP_0 << RandomBytes(32);
+        case SyntheticScript::P2TR:
+            return CScript() << OP_1 << RandomBytes(32);
+        default:
+            return CScript() << OP_RETURN << RandomBytes(1 + m_rng() % 40);
+        }
+    }
+
+    /** Fill in the scriptSig / witness that spends an output of type t. */
+    void SignInput(CTxIn& txin, SyntheticScript t)
+    {
+        switch (t)
+        {
+        case SyntheticScript::P2PKH:
+            txin.scriptSig = CScript() << RandomSignature() << RandomPubKey();
+            break;
+        case SyntheticScript::P2SH:
+        {
+            CScript redeem = MultisigScript();
+            txin.scriptSig = CScript() << OP_0 << RandomSignature() << RandomSignature() << std::vector<unsigned char>(redeem.begin(), redeem.end());
+            break;
+        }
+        case SyntheticScript::P2WPKH:
+            txin.scriptWitness.stack = {RandomSignature(), RandomPubKey()};
+            break;
+        case SyntheticScript::P2WSH:
+        {
+            CScript witness_script = MultisigScript();
+            txin.scriptWitness.stack = {{}, RandomSignature(), RandomSignature(), std::vector<unsigned char>(witness_script.begin(), witness_script.end())};
+            break;
+        }
+        default:
+            txin.scriptWitness.stack = {RandomBytes(64)};
+            break;
+        }
+    }
+
+    /** Append the outputs of tx (already added to the block at nHeight) to the unspent pools. */
+    void AddOutputs(const CTransaction& tx, const std::vector<SyntheticScript>& vTypes, int nHeight)
+    {
+        for (size_t i = 0; i < tx.vout.size(); i++)
+        {
+            vOutputs[(int)vTypes[i]]++;
+            if (vTypes[i] != SyntheticScript::NULL_DATA)
+                m_pool[IsWitnessScript(vTypes[i])].push_back({COutPoint(tx.GetHash(), i), Coin(tx.vout[i], nHeight, tx.IsCoinBase()), vTypes[i]});
+        }
+    }
+
+    /** Split nValue over the outputs of mtx, OP_RETURN outputs carry no value. */
+    void SetOutputs(CMutableTransaction& mtx, std::vector<SyntheticScript>& vTypes, int nOutputs, CAmount nValue)
+    {
+        vTypes.clear();
+        int nSpendable = 0;
+        for (int i = 0; i < nOutputs; i++)
+        {
+            // 第一个输出总是可花费的, 保证未花费输出池不会被耗尽
+            vTypes.push_back(PickScript(i == 0));
+            nSpendable += vTypes.back() != SyntheticScript::NULL_DATA;
+        }
+        mtx.vout.clear();
+        for (SyntheticScript t : vTypes)
+        {
+            CAmount nOut = 0;
+            if (t != SyntheticScript::NULL_DATA)
+            {
+                // 平均分配, 每份再随机浮动 ±50%, 最后一个输出取剩余金额
+                nOut = --nSpendable == 0 ? nValue : nValue / (nSpendable + 1) * (500 + m_rng() % 1000) / 1000;
+                nOut = std::min(nOut, nValue);
+                nValue -= nOut;
+            }
+            mtx.vout.emplace_back(nOut, OutputScript(t));
+        }
+    }
+
+    /**
+     * A transaction spending outputs from the witness pool with probability dWitnessShare
+     * (falling back to the other pool when it is empty). The spent coins go to txundo.
+     * Returns nullptr if nothing is spendable.
+     */
+    CTransactionRef MakeTransaction(CAmount& nFee, std::vector<SyntheticScript>& vTypes, CTxUndo& txundo)
+    {
+        bool fWitness = std::uniform_real_distribution<double>(0, 1)(m_rng) < m_options.dWitnessShare;
+        if (m_pool[fWitness].empty())
+            fWitness = !fWitness;
+        std::vector<CSpendable>& pool = m_pool[fWitness];
+        if (pool.empty())
+            return nullptr;
+
+        CMutableTransaction mtx;
+        mtx.nVersion = 1 + m_rng() % 2;
+        const int nInputs = 1 + m_rng() % std::min<size_t>(m_options.nMaxInputs, pool.size());
+        CAmount nValueIn = 0;
+        for (int i = 0; i < nInputs; i++)
+        {
+            const size_t n = m_rng() % pool.size();
+            mtx.vin.emplace_back(pool[n].prevout);
+            mtx.vin.back().nSequence = CTxIn::SEQUENCE_FINAL - 1;
+            SignInput(mtx.vin.back(), pool[n].type);
+            nValueIn += pool[n].coin.out.nValue;
+            txundo.vprevout.push_back(std::move(pool[n].coin));
+            pool[n] = std::move(pool.back());
+            pool.pop_back();
+        }
+        nFee = std::min<CAmount>(nValueIn, 1000 + m_rng() % 20000);
+        SetOutputs(mtx, vTypes, 1 + m_rng() % m_options.nMaxOutputs, nValueIn - nFee);
+        nWitnessTx += fWitness;
+        return MakeTransactionRef(std::move(mtx));
+    }
+
+    /** Build and mine the block at nHeight on top of pprev, recording the coins it spends in blockundo. */
+    CBlock MakeBlock(const CBlockIndex* pprev, int nHeight, const Consensus::Params& consensus, CBlockUndo& blockundo)
+    {
+        blockundo.vtxundo.clear();
+        CBlock block;
+        block.nVersion = 0x20000000;
+        block.hashPrevBlock = pprev->GetBlockHash();
+        block.nTime = pprev->nTime + 1 + m_rng() % (2 * consensus.nPowTargetSpacing);
+        block.nBits = pprev->nBits;
+        block.vtx.emplace_back(); // coinbase, filled in below
+
+        CAmount nFees = 0;
+        bool fHaveWitness = false;
+        std::vector<std::pair<CTransactionRef, std::vector<SyntheticScript>>> vNew;
+        for (int i = 0; i < m_options.nTxPerBlock; i++)
+        {
+            CAmount nFee = 0;
+            std::vector<SyntheticScript> vTypes;
+            CTxUndo txundo;
+            CTransactionRef tx = MakeTransaction(nFee, vTypes, txundo);
+            if (!tx)
+                break;
+            // hzx 新输出可以被同一区块中后面的交易花费
+            AddOutputs(*tx, vTypes, nHeight);
+            blockundo.vtxundo.push_back(std::move(txundo));
+            nFees += nFee;
+            fHaveWitness |= tx->HasWitness();
+            block.vtx.push_back(tx);
+        }
+
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        CAmount nSubsidy = nHeight / consensus.nSubsidyHalvingInterval >= 64 ? 0 : (50 * COIN) >> (nHeight / consensus.nSubsidyHalvingInterval);
+        // 一个需要 scriptSig 的输出和一个需要见证数据的输出, 两个池子每个区块都会得到补充
+        std::vector<SyntheticScript> vTypes{SyntheticScript::P2PKH, SyntheticScript::P2WPKH};
+        coinbase.vout.emplace_back((nSubsidy + nFees) / 2, OutputScript(vTypes[0]));
+        coinbase.vout.emplace_back(nSubsidy + nFees - coinbase.vout[0].nValue, OutputScript(vTypes[1]));
+        if (fHaveWitness)
+        {
+            // BIP141 witness commitment; the coinbase wtxid counts as 0, so the placeholder does not matter
+            block.vtx[0] = MakeTransactionRef(coinbase);
+            const std::vector<unsigned char> nonce(32, 0);
+            const uint256 witnessroot = BlockWitnessMerkleRoot(block);
+            const uint256 commitment = Hash(witnessroot.begin(), witnessroot.end(), nonce.begin(), nonce.end());
+            std::vector<unsigned char> data{0xaa, 0x21, 0xa9, 0xed};
+            data.insert(data.end(), commitment.begin(), commitment.end());
+            coinbase.vout.emplace_back(0, CScript() << OP_RETURN << data);
+            coinbase.vin[0].scriptWitness.stack.push_back(nonce);
+            vTypes.push_back(SyntheticScript::NULL_DATA);
+        }
+        block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+        AddOutputs(*block.vtx[0], vTypes, nHeight);
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+
+        arith_uint256 target;
+        target.SetCompact(block.nBits);
+        while (UintToArith256(block.GetHash()) > target)
+            block.nNonce++;
+        return block;
+    }
+};
+
+/**
+ * Appends records (magic, size, block) to blk?????.dat files and the matching undo records
+ * (magic, size, CBlockUndo, checksum) to rev?????.dat, bitcoind style.
+ */
+class CBlockFileWriter
+{
+private:
+    const std::string m_blocks_dir;
+    const CMessageHeader::MessageStartChars& m_message_start;
+    const unsigned int m_max_file_size;
+    FILE* m_file;
+    FILE* m_undo_file;
+
+public:
+    std::vector<CBlockFileInfo> vInfo;
+    //! first file changed since the last Commit
+    int nFirstDirty;
+
+    CBlockFileWriter(const std::string& blocks_dir, const CMessageHeader::MessageStartChars& message_start, unsigned int max_file_size)
+        : m_blocks_dir(blocks_dir), m_message_start(message_start), m_max_file_size(max_file_size), m_file(nullptr), m_undo_file(nullptr), nFirstDirty(0)
+    {
+    }
+
+    ~CBlockFileWriter()
+    {
+        if (m_file)
+            fclose(m_file);
+        if (m_undo_file)
+            fclose(m_undo_file);
+    }
+
+    int LastFile() const { return (int)vInfo.size() - 1; }
+
+    bool Open(int nFile)
+    {
+        const bool fCloseFailed = (m_file && fclose(m_file) != 0) | (m_undo_file && fclose(m_undo_file) != 0);
+        m_file = m_undo_file = nullptr;
+        if (fCloseFailed)
+            return false;
+        // hzx 区块 N 的 undo 数据与区块写入编号相同的 rev 文件
+        const std::string path = GetBlockFilePath(m_blocks_dir, "blk", nFile);
+        const std::string undo_path = GetBlockFilePath(m_blocks_dir, "rev", nFile);
+        m_file = fopen(path.c_str(), "wb");
+        m_undo_file = fopen(undo_path.c_str(), "wb");
+        if (!m_file || !m_undo_file)
+        {
+            LogError("%s: 无法创建区块文件 %s\n", __func__, (m_file ? undo_path : path).data());
+            return false;
+        }
+        vInfo.emplace_back();
+        return true;
+    }
+
+    /** Write block to the current file (starting a new one when it is full), setting pindex->nFile and nDataPos. */
+    bool WriteBlock(const CBlock& block, CBlockIndex* pindex)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss.reserve(1 << 20);
+        ss.write((const char*)m_message_start, CMessageHeader::MESSAGE_START_SIZE);
+        ss << (uint32_t)0;
+        ss << block;
+        const uint32_t nBlockSize = ss.size() - CMessageHeader::MESSAGE_START_SIZE - sizeof(uint32_t);
+        WriteLE32((unsigned char*)&ss[CMessageHeader::MESSAGE_START_SIZE], nBlockSize);
+
+        if (!m_file || (vInfo.back().nBlocks > 0 && vInfo.back().nSize + ss.size() > m_max_file_size))
+        {
+            if (!Open(vInfo.size()))
+                return false;
+        }
+        CBlockFileInfo& info = vInfo.back();
+        if (fwrite(ss.data(), 1, ss.size(), m_file) != ss.size())
+        {
+            LogError("%s: 写入区块文件失败, 文件: %d\n", __func__, LastFile());
+            return false;
+        }
+        pindex->nFile = LastFile();
+        pindex->nDataPos = info.nSize + CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+        pindex->nStatus |= BLOCK_HAVE_DATA;
+        info.nSize += ss.size();
+        info.AddBlock(pindex->nHeight, block.GetBlockTime());
+        return true;
+    }
+
+    /**
+     * Write the undo data of the block just written by WriteBlock to the rev file with the same
+     * number, setting pindex->nUndoPos. The checksum covers the previous block hash, like
+     * bitcoind's UndoWriteToDisk.
+     */
+    bool WriteUndo(const CBlockUndo& blockundo, CBlockIndex* pindex)
+    {
+        assert(pindex->pprev && pindex->nFile == LastFile());
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss.write((const char*)m_message_start, CMessageHeader::MESSAGE_START_SIZE);
+        ss << (uint32_t)0;
+        const size_t nHeaderSize = ss.size();
+        ss << blockundo;
+        const uint32_t nUndoSize = ss.size() - nHeaderSize;
+        WriteLE32((unsigned char*)&ss[CMessageHeader::MESSAGE_START_SIZE], nUndoSize);
+        uint256 hashChecksum;
+        const uint256 hashPrev = pindex->pprev->GetBlockHash();
+        CHash256().Write(hashPrev.begin(), hashPrev.size()).Write((const unsigned char*)&ss[nHeaderSize], nUndoSize).Finalize(hashChecksum.begin());
+        ss << hashChecksum;
+
+        CBlockFileInfo& info = vInfo.back();
+        if (fwrite(ss.data(), 1, ss.size(), m_undo_file) != ss.size())
+        {
+            LogError("%s: 写入 undo 文件失败, 文件: %d\n", __func__, LastFile());
+            return false;
+        }
+        pindex->nUndoPos = info.nUndoSize + nHeaderSize;
+        pindex->nStatus |= BLOCK_HAVE_UNDO;
+        info.nUndoSize += ss.size();
+        return true;
+    }
+
+    /** Make the written blocks durable; must succeed before the index entries pointing at them are written. */
+    bool Flush()
+    {
+        return (!m_file || (fflush(m_file) == 0 && fsync(fileno(m_file)) == 0)) &&
+               (!m_undo_file || (fflush(m_undo_file) == 0 && fsync(fileno(m_undo_file)) == 0));
+    }
+};
+} // namespace
+
+bool GenerateSyntheticChain(const CChainParams& chainparams, const std::string& blocks_dir, CBlockTreeDB& blocktree, const ChainGenOptions& options)
+{
+    const Consensus::Params& consensus = chainparams.GetConsensus();
+    if (!chainparams.MineBlocksOnDemand())
+    {
+        LogError("%s: 只能在不调整难度的链(regtest)上生成区块\n", __func__);
+        return false;
+    }
+    if (options.nBlocks < 0 || options.nTxPerBlock < 0 || options.nMaxInputs < 1 || options.nMaxOutputs < 1 ||
+        options.nFlushInterval < 1 || !std::any_of(std::begin(options.vScriptWeights), std::end(options.vScriptWeights), [](unsigned int n) { return n > 0; }))
+    {
+        LogError("%s: 参数不正确\n", __func__);
+        return false;
+    }
+
+    CChainGenerator generator(options);
+    CBlockFileWriter writer(blocks_dir, chainparams.MessageStart(), options.nMaxBlockFileSize);
+    // hzx CBlockIndex 的 phashBlock 指向 vHashes 中的元素, deque 追加时不会移动已有元素
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+    std::vector<const CBlockIndex*> vDirty;
+    uint64_t nTx = 0;
+
+    auto commit = [&]() {
+        if (!writer.Flush())
+        {
+            LogError("%s: 区块文件同步失败\n", __func__);
+            return false;
+        }
+        std::vector<std::pair<int, const CBlockFileInfo*>> vFiles;
+        for (int nFile = writer.nFirstDirty; nFile <= writer.LastFile(); nFile++)
+            vFiles.emplace_back(nFile, &writer.vInfo[nFile]);
+        if (!blocktree.WriteBatchSync(vFiles, writer.LastFile(), vDirty))
+            return false;
+        writer.nFirstDirty = writer.LastFile();
+        vDirty.clear();
+        return true;
+    };
+
+    const int64_t nStart = GetTimeMillis().count();
+    for (int nHeight = 0; nHeight <= options.nBlocks; nHeight++)
+    {
+        CBlockUndo blockundo;
+        const CBlock block = nHeight == 0 ? chainparams.GenesisBlock() : generator.MakeBlock(&vIndex.back(), nHeight, consensus, blockundo);
+        vHashes.push_back(block.GetHash());
+        CBlockIndex* pprev = nHeight == 0 ? nullptr : &vIndex.back();
+        vIndex.emplace_back(block.GetBlockHeader());
+        CBlockIndex* pindex = &vIndex.back();
+        pindex->phashBlock = &vHashes.back();
+        pindex->pprev = pprev;
+        pindex->nHeight = nHeight;
+        pindex->nTx = block.vtx.size();
+        nTx += pindex->nTx;
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        // 创世块没有 undo 数据
+        if (!writer.WriteBlock(block, pindex) || (pprev && !writer.WriteUndo(blockundo, pindex)))
+            return false;
+        vDirty.push_back(pindex);
+        if ((int)vDirty.size() >= options.nFlushInterval)
+        {
+            if (!commit())
+                return false;
+            LogInfo("%s: 已生成 %d 个区块\n", __func__, nHeight + 1);
+        }
+    }
+    if (!commit())
+        return false;
+
+    // 删除旧数据目录中残留的编号更大的区块文件, 避免与新索引混在一起
+    for (const char* prefix : {"blk", "rev"})
+        for (int nFile = writer.LastFile() + 1; remove(GetBlockFilePath(blocks_dir, prefix, nFile).c_str()) == 0; nFile++)
+            ;
+
+    uint64_t nBytes = 0, nUndoBytes = 0;
+    for (const CBlockFileInfo& info : writer.vInfo)
+    {
+        nBytes += info.nSize;
+        nUndoBytes += info.nUndoSize;
+    }
+    LogInfo("%s: 生成 %d 个区块(含创世块), %lu 笔交易(%lu 笔带见证数据), %d 个区块文件共 %lu 字节(undo %lu 字节), 耗时 %ld ms\n", __func__,
+           options.nBlocks + 1, (unsigned long)nTx, (unsigned long)generator.nWitnessTx, writer.LastFile() + 1,
+           (unsigned long)nBytes, (unsigned long)nUndoBytes, (long)(GetTimeMillis().count() - nStart));
+    for (int t = 0; t < (int)SyntheticScript::COUNT; t++)
+        LogInfo("    %-9s %lu 个输出\n", GetSyntheticScriptName((SyntheticScript)t), (unsigned long)generator.vOutputs[t]);
+    LogInfo("    链尾: %s\n", vIndex.back().GetBlockHash().ToString().data());
+    return true;
+}
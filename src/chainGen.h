@@ -0,0 +1,65 @@
+#ifndef BLOCKCHAIN_CHAINGEN_H
+#define BLOCKCHAIN_CHAINGEN_H
+#include <stdint.h>
+#include <string>
+#include "chainparams.h"
+
+class CBlockTreeDB;
+
+//! The maximum size of a blk?????.dat file (same as bitcoind)
+static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+
+/** Output script templates produced by the synthetic chain generator. */
+enum class SyntheticScript
+{
+    P2PKH,     //!< spent with scriptSig <sig> <pubkey>
+    P2SH,      //!< 2-of-3 multisig redeem script, spent with scriptSig
+    P2WPKH,    //!< spent with witness <sig> <pubkey>
+    P2WSH,     //!< 2-of-3 multisig witness script
+    P2TR,      //!< key path spend, witness <sig>
+    NULL_DATA, //!< OP_RETURN, never spent
+    COUNT
+};
+
+/** Name used for t in ParseScriptMix and in the generator summary, e.g. "p2wpkh". */
+const char* GetSyntheticScriptName(SyntheticScript t);
+
+struct ChainGenOptions
+{
+    //! blocks to generate on top of the genesis block
+    int nBlocks = 1000;
+    //! non-coinbase transactions per block
+    int nTxPerBlock = 100;
+    //! inputs and outputs per transaction are drawn from [1, nMaxInputs] and [1, nMaxOutputs]
+    int nMaxInputs = 3;
+    int nMaxOutputs = 3;
+    //! share of non-coinbase transactions that spend segwit outputs (and therefore carry witness data)
+    double dWitnessShare = 0.5;
+    //! relative frequency of each SyntheticScript among the created outputs
+    unsigned int vScriptWeights[(int)SyntheticScript::COUNT] = {40, 10, 30, 10, 5, 5};
+    //! a new blk file is started when the next block would not fit
+    unsigned int nMaxBlockFileSize = MAX_BLOCKFILE_SIZE;
+    //! block index entries written to the database per batch
+    int nFlushInterval = 10000;
+    uint64_t nSeed = 1;
+};
+
+/**
+ * Parse a script mix such as "p2pkh:40,p2wpkh:30,p2tr:30" into options.vScriptWeights.
+ * Types that are not listed get weight 0. Returns false on a malformed string.
+ */
+bool ParseScriptMix(const std::string& mix, ChainGenOptions& options);
+
+/**
+ * Write a synthetic chain of options.nBlocks blocks on top of the genesis block of
+ * chainparams: blk?????.dat files in blocks_dir (magic, size, block, exactly as bitcoind
+ * lays them out), the undo data of every block but the genesis in the rev?????.dat file
+ * with the same number, and a matching DB_BLOCK_INDEX / DB_BLOCK_FILES / DB_LAST_BLOCK set
+ * in blocktree. Every transaction spends outputs created earlier in the chain, so the coin
+ * flow is consistent; signatures and keys are random bytes of realistic size. The
+ * header of each block is mined against nBits of the genesis block, which must be easy
+ * (regtest). The output only depends on options, including nSeed.
+ */
+bool GenerateSyntheticChain(const CChainParams& chainparams, const std::string& blocks_dir, CBlockTreeDB& blocktree, const ChainGenOptions& options);
+
+#endif
@@ -1,4 +1,5 @@
 #include "chainparamsbase.h"
+#include "logging.h"
 #include "tinyformat.h"
 #include <memory>
 #include <assert.h>
@@ -26,7 +27,7 @@ const CBaseChainParams& BaseParams()
 
 std::unique_ptr<CBaseChainParams> CreateBaseChainParams(const std::string& chain)
 {
-    printf("%s : 创建CBaseChainParams指针 \n", __func__);
+    LogInfo("%s : 创建CBaseChainParams指针 \n", __func__);
     if (chain == CBaseChainParams::MAIN)
         return MakeUnique<CBaseChainParams>("", 8332);
     else if (chain == CBaseChainParams::TESTNET)
@@ -42,7 +43,7 @@ std::unique_ptr<CBaseChainParams> CreateBaseChainParams(const std::string& chain
 }
 
 void SelectBaseParams(const std::string& chain){
-    printf("%s : 初始化 globalChainParams : %s\n", __func__, chain.data());
+    LogInfo("%s : 初始化 globalChainParams : %s\n", __func__, chain.data());
     globalChainBaseParams = CreateBaseChainParams(chain);
 
 }
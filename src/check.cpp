@@ -0,0 +1,1140 @@
+// hzx 确定性检查程序, 与 main.cpp 一样由 VS Code 的 Build 任务编译(打开本文件编译, 生成 check.out),
+// 或使用 "Check" 任务编译.
+//
+// 所有输入都由固定种子生成, 每项检查把优化后的实现与简单的参考实现(或已知结果)逐项比较,
+// 结果写到 stderr, 有检查失败时返回 1.
+//
+// 参数:
+//   -filter=<子串>   只运行名字包含该子串的检查
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ftw.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "arith_uint256.h"
+#include "block.h"
+#include "blockIndexMap.h"
+#include "blockIndexLink.h"
+#include "blockMan.h"
+#include "blockView.h"
+#include "chain.h"
+#include "chainGen.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "reindex.h"
+#include "scheduler.h"
+#include "sha256.h"
+#include "streams.h"
+#include "strencodings.h"
+#include "transaction.h"
+#include "txdb.h"
+
+using namespace std;
+
+namespace
+{
+
+//! 当前检查中失败的断言数
+int g_nCheckFailures = 0;
+
+void CheckFailed(const char *expr, const char *file, int line)
+{
+    if (g_nCheckFailures++ < 10)
+        fprintf(stderr, "  %s:%d: 检查失败: %s\n", file, line, expr);
+}
+
+#define CHECK(expr)                                \
+    do                                             \
+    {                                              \
+        if (!(expr))                               \
+            CheckFailed(#expr, __FILE__, __LINE__); \
+    } while (0)
+
+class CCheckRunner
+{
+private:
+    string m_filter;
+    int m_nRun = 0;
+    int m_nFailed = 0;
+
+public:
+    explicit CCheckRunner(const string &filter) : m_filter(filter) {}
+
+    bool Enabled(const string &name) const { return m_filter.empty() || name.find(m_filter) != string::npos; }
+
+    /** 运行一项检查; fn 中任何失败的 CHECK 或未捕获的异常都使该项失败. */
+    void Run(const string &name, const function<void()> &fn)
+    {
+        if (!Enabled(name))
+            return;
+        g_nCheckFailures = 0;
+        try
+        {
+            fn();
+        }
+        catch (const exception &e)
+        {
+            fprintf(stderr, "  未捕获的异常: %s\n", e.what());
+            g_nCheckFailures++;
+        }
+        m_nRun++;
+        if (g_nCheckFailures)
+            m_nFailed++;
+        fprintf(stderr, "%-48s %s\n", name.data(), g_nCheckFailures ? "失败" : "通过");
+    }
+
+    int GetRun() const { return m_nRun; }
+    int GetFailed() const { return m_nFailed; }
+};
+
+vector<unsigned char> RandomBytes(mt19937_64 &rng, size_t n)
+{
+    vector<unsigned char> ret(n);
+    for (unsigned char &c : ret)
+        c = rng();
+    return ret;
+}
+
+uint256 RandomHash(mt19937_64 &rng)
+{
+    uint256 ret;
+    for (unsigned char *p = ret.begin(); p != ret.end(); p++)
+        *p = rng();
+    return ret;
+}
+
+string SHA256Hex(const string &str)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char *)str.data(), str.size()).Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+//! 逐条调用 CSHA256 计算的双重 SHA256, 作为多路实现的参考
+uint256 ReferenceHash256(const unsigned char *data, size_t len)
+{
+    uint256 ret;
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    CSHA256().Write(hash, sizeof(hash)).Finalize(ret.begin());
+    return ret;
+}
+
+/**
+ * 在每一种可用的 SHA256 实现上检查: CSHA256 的已知结果, 分段写入与一次写入一致,
+ * SHA256D64 与 SHA256DBatch 在各种个数与长度(覆盖 2/4/8 路与剩余部分)下与逐条计算一致.
+ * 参考值先用标准实现算出, 再与其他实现比较.
+ */
+void CheckSHA256(CCheckRunner &runner, mt19937_64 &rng)
+{
+    const vector<unsigned char> data = RandomBytes(rng, 64 * 64 + 4096);
+    vector<size_t> vLen(300);
+    for (size_t i = 0; i < vLen.size(); i++)
+        vLen[i] = i < 130 ? i : rng() % 1000;
+    vector<const unsigned char *> vInput(vLen.size());
+    vector<size_t> vSplit(vLen.size());
+    for (size_t i = 0; i < vInput.size(); i++)
+    {
+        vInput[i] = data.data() + rng() % (data.size() - vLen[i] + 1);
+        vSplit[i] = vLen[i] ? rng() % vLen[i] : 0;
+    }
+
+    SHA256AutoDetect(sha256_implementation::STANDARD);
+    vector<uint256> vD64Ref(64), vBatchRef(vLen.size());
+    for (size_t i = 0; i < vD64Ref.size(); i++)
+        vD64Ref[i] = ReferenceHash256(data.data() + 64 * i, 64);
+    for (size_t i = 0; i < vBatchRef.size(); i++)
+        vBatchRef[i] = ReferenceHash256(vInput[i], vLen[i]);
+
+    static const sha256_implementation::UseImplementation implementations[] = {
+        sha256_implementation::STANDARD,
+        sha256_implementation::USE_SSE4,
+        sha256_implementation::USE_SSE4_AND_AVX2,
+        sha256_implementation::USE_SSE4_AND_SHANI,
+    };
+    vector<string> vSeen;
+    for (sha256_implementation::UseImplementation impl : implementations)
+    {
+        const string name = SHA256AutoDetect(impl);
+        if (find(vSeen.begin(), vSeen.end(), name) != vSeen.end())
+            continue;
+        vSeen.push_back(name);
+
+        runner.Run("SHA256[" + name + "]", [&] {
+            CHECK(SHA256Hex("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+            CHECK(SHA256Hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+            CHECK(SHA256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+            // 分段写入, 段长跨越 64 字节块的边界
+            for (size_t i = 0; i < vBatchRef.size(); i++)
+            {
+                uint256 hash;
+                unsigned char inner[CSHA256::OUTPUT_SIZE];
+                CSHA256().Write(vInput[i], vSplit[i]).Write(vInput[i] + vSplit[i], vLen[i] - vSplit[i]).Finalize(inner);
+                CSHA256().Write(inner, sizeof(inner)).Finalize(hash.begin());
+                CHECK(hash == vBatchRef[i]);
+            }
+        });
+        runner.Run("SHA256D64[" + name + "]", [&] {
+            for (size_t nBlocks = 0; nBlocks <= vD64Ref.size(); nBlocks++)
+            {
+                vector<uint256> vOut(nBlocks + 1);
+                vOut[nBlocks] = uint256S("5a5a5a");
+                SHA256D64(vOut[0].begin(), data.data(), nBlocks);
+                for (size_t i = 0; i < nBlocks; i++)
+                    CHECK(vOut[i] == vD64Ref[i]);
+                // 不能写出输出范围
+                CHECK(vOut[nBlocks] == uint256S("5a5a5a"));
+            }
+        });
+        runner.Run("SHA256DBatch[" + name + "]", [&] {
+            // 先全部一起, 再取不同的起点与个数
+            for (size_t nStart : {0, 1, 7, 129})
+            {
+                for (size_t nCount : {0, 1, 2, 3, 5, 8, 9, 17, 64, 171})
+                {
+                    nCount = min(nCount, vInput.size() - nStart);
+                    vector<uint256> vOut(nCount);
+                    SHA256DBatch(vOut.empty() ? nullptr : vOut[0].begin(), vInput.data() + nStart, vLen.data() + nStart, nCount);
+                    for (size_t i = 0; i < nCount; i++)
+                        CHECK(vOut[i] == vBatchRef[nStart + i]);
+                }
+            }
+            vector<uint256> vOut(vInput.size());
+            SHA256DBatch(vOut[0].begin(), vInput.data(), vLen.data(), vInput.size());
+            CHECK(vOut == vBatchRef);
+        });
+    }
+    SHA256AutoDetect();
+}
+
+/** 区块中的交易哈希一起批量计算, 结果必须与逐笔序列化计算的 txid 和 wtxid 相同. */
+void CheckBlockBatchHash(CCheckRunner &runner, mt19937_64 &rng)
+{
+    runner.Run("UnserializeBlockBatchHash", [&] {
+        CBlock block;
+        block.nVersion = 0x20000000;
+        block.hashPrevBlock = RandomHash(rng);
+        block.nTime = 1600000000;
+        block.nBits = 0x207fffff;
+        for (int t = 0; t < 300; t++)
+        {
+            CMutableTransaction mtx;
+            mtx.nVersion = 2;
+            const int nIn = 1 + rng() % 3, nOut = 1 + rng() % 3;
+            for (int i = 0; i < nIn; i++)
+            {
+                CTxIn in(RandomHash(rng), rng() % 4);
+                in.scriptSig = CScript() << RandomBytes(rng, rng() % 120);
+                if (t % 2)
+                    in.scriptWitness.stack.push_back(RandomBytes(rng, rng() % 200));
+                mtx.vin.push_back(in);
+            }
+            for (int i = 0; i < nOut; i++)
+                mtx.vout.emplace_back(rng() % 100000000, CScript() << RandomBytes(rng, 20 + rng() % 20));
+            block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+        }
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ssBlock << block;
+        const vector<unsigned char> raw(ssBlock.begin(), ssBlock.end());
+
+        CBlock batch;
+        SpanReader reader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(raw.data(), raw.size()));
+        UnserializeBlockBatchHash(reader, batch);
+        CHECK(batch.GetHash() == block.GetHash());
+        CHECK(batch.vtx.size() == block.vtx.size());
+        for (size_t i = 0; i < min(batch.vtx.size(), block.vtx.size()); i++)
+        {
+            CHECK(batch.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+            CHECK(batch.vtx[i]->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+            CHECK(batch.vtx[i]->GetHash() == SerializeHash(*block.vtx[i], SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS));
+        }
+    });
+}
+
+/**
+ * CFrozenBlockIndex 与 CBlockIndexMap 对每个键给出相同的结果. 除了随机哈希, 还加入
+ * 前 8 字节相同(标签相同, 只能靠完整比较区分)的键, 以及落在同一组、把组填满后
+ * 溢出到后面各组的键.
+ */
+void CheckFrozenBlockIndex(CCheckRunner &runner, mt19937_64 &rng)
+{
+    runner.Run("FrozenBlockIndex", [&] {
+        const CFrozenBlockIndex empty;
+        CHECK(empty.size() == 0);
+        CHECK(empty.Find(RandomHash(rng)) == nullptr);
+
+        CBlockIndexMap mapBlockIndex;
+        vector<uint256> vHashes;
+        for (int i = 0; i < 100000; i++)
+            vHashes.push_back(RandomHash(rng));
+        // 标签相同: 前 8 字节相同, 或只差最低位(标签的最低位固定为 1)
+        const uint256 base = RandomHash(rng);
+        for (int i = 0; i < 40; i++)
+        {
+            uint256 hash = RandomHash(rng);
+            memcpy(hash.begin(), base.begin(), 8);
+            if (i % 2)
+                hash.begin()[0] ^= 1;
+            vHashes.push_back(hash);
+        }
+        // 同一组: 标签的高 32 位相同, 低 32 位不同
+        for (int i = 0; i < 40; i++)
+        {
+            uint256 hash = RandomHash(rng);
+            memcpy(hash.begin() + 4, base.begin() + 4, 4);
+            vHashes.push_back(hash);
+        }
+        for (const uint256 &hash : vHashes)
+            mapBlockIndex.Insert(hash);
+
+        const CFrozenBlockIndex frozen(mapBlockIndex);
+        CHECK(frozen.size() == mapBlockIndex.size());
+        vector<uint256> vQueries;
+        for (const uint256 &hash : vHashes)
+        {
+            vQueries.push_back(hash);
+            // 与已有的键共享标签或组, 但不存在
+            uint256 miss = hash;
+            miss.begin()[31] ^= 0x80;
+            vQueries.push_back(miss);
+            miss = hash;
+            miss.begin()[0] ^= 0x01;
+            vQueries.push_back(miss);
+        }
+        for (int i = 0; i < 1000; i++)
+            vQueries.push_back(RandomHash(rng));
+
+        vector<CBlockIndex *> vResult;
+        frozen.FindMany(MakeSpan(vQueries), vResult);
+        CHECK(vResult.size() == vQueries.size());
+        for (size_t i = 0; i < vQueries.size(); i++)
+        {
+            CBlockIndex *pindex = mapBlockIndex.Find(vQueries[i]);
+            CHECK(frozen.Find(vQueries[i]) == pindex);
+            CHECK(i >= vResult.size() || vResult[i] == pindex);
+            CHECK(!pindex || *pindex->phashBlock == vQueries[i]);
+        }
+        for (const uint256 &hash : vHashes)
+            CHECK(frozen.Find(hash) != nullptr);
+    });
+}
+
+/**
+ * LinkBlockIndex 与原来的串行做法(按顺序由 pprev 推出 nChainWork, nTimeMax, nChainTx,
+ * 再 BuildSkip)结果相同. 树中有主链、长短不一的分叉、非单调的时间戳, 以及少量没有
+ * 交易的区块(其后代的 nChainTx 为 0). 区块数足够分成多个高度范围并行计算.
+ */
+void CheckLinkBlockIndex(CCheckRunner &runner, mt19937_64 &rng)
+{
+    static const int N_BLOCKS = 200000;
+    // 串行参考: 按创建顺序(父区块总在前面)逐个推出
+    vector<CBlockIndex> vSerial(N_BLOCKS);
+    vector<int> vParent(N_BLOCKS, -1);
+    int nTip = -1;
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        CBlockIndex &index = vSerial[i];
+        if (i > 0)
+        {
+            // 约 10% 接在最近 2000 个区块中的某一个上, 形成分叉(分叉也会被继续延长)
+            vParent[i] = rng() % 10 ? nTip : i - 1 - rng() % min(i, 2000);
+            index.pprev = &vSerial[vParent[i]];
+        }
+        index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+        index.nBits = 0x1d00ffff - (index.nHeight / 2016) % 64;
+        index.nTime = 1600000000 + 600 * index.nHeight - rng() % 7200;
+        index.nTx = rng() % 20000 == 0 ? 0 : 1 + rng() % 3000;
+        if (vParent[i] == nTip)
+            nTip = i;
+    }
+    for (CBlockIndex &index : vSerial)
+    {
+        CBlockIndex *pprev = index.pprev;
+        index.nChainWork = (pprev ? pprev->nChainWork : 0) + GetBlockProof(index);
+        index.nTimeMax = pprev ? max(pprev->nTimeMax, index.nTime) : index.nTime;
+        if (index.nTx == 0)
+            index.nChainTx = 0;
+        else if (pprev)
+            index.nChainTx = pprev->nChainTx ? pprev->nChainTx + index.nTx : 0;
+        else
+            index.nChainTx = index.nTx;
+        if (pprev)
+            index.BuildSkip();
+    }
+
+    CBlockIndexMap mapBlockIndex;
+    mapBlockIndex.Reserve(N_BLOCKS);
+    vector<CBlockIndex *> vIndex(N_BLOCKS);
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        vIndex[i] = mapBlockIndex.Insert(RandomHash(rng));
+        vIndex[i]->nHeight = vSerial[i].nHeight;
+        vIndex[i]->nBits = vSerial[i].nBits;
+        vIndex[i]->nTime = vSerial[i].nTime;
+        vIndex[i]->nTx = vSerial[i].nTx;
+        vIndex[i]->pprev = vParent[i] < 0 ? nullptr : vIndex[vParent[i]];
+    }
+
+    for (int nThreads : {1, 4, 0})
+    {
+        runner.Run("LinkBlockIndex_" + to_string(nThreads) + "thread", [&] {
+            for (CBlockIndex *pindex : vIndex)
+            {
+                pindex->nChainWork = 0;
+                pindex->nTimeMax = 0;
+                pindex->nChainTx = 12345;
+                pindex->pskip = nullptr;
+            }
+            vector<CBlockIndex *> vSortedByHeight;
+            SortBlockIndexByHeight(mapBlockIndex, vSortedByHeight);
+            CHECK(vSortedByHeight.size() == (size_t)N_BLOCKS);
+            for (size_t i = 1; i < vSortedByHeight.size(); i++)
+                CHECK(vSortedByHeight[i - 1]->nHeight <= vSortedByHeight[i]->nHeight);
+            LinkBlockIndex(MakeSpan(vSortedByHeight), nThreads);
+
+            for (int i = 0; i < N_BLOCKS; i++)
+            {
+                const CBlockIndex &expected = vSerial[i];
+                const CBlockIndex *pindex = vIndex[i];
+                CHECK(pindex->nChainWork == expected.nChainWork);
+                CHECK(pindex->nTimeMax == expected.nTimeMax);
+                CHECK(pindex->nChainTx == expected.nChainTx);
+                CHECK(expected.pskip ? pindex->pskip == vIndex[expected.pskip - vSerial.data()] : !pindex->pskip);
+            }
+        });
+    }
+}
+
+/** nDepth 层嵌套的任务组, 每层 nFanout 个任务, 每个任务建立并等待下一层的组. */
+void RunNested(CTaskScheduler &scheduler, int nDepth, int nFanout, atomic<int> &nLeaves)
+{
+    CTaskGroup group(scheduler);
+    for (int i = 0; i < nFanout; i++)
+    {
+        group.Run([&scheduler, nDepth, nFanout, &nLeaves] {
+            if (nDepth > 1)
+                RunNested(scheduler, nDepth - 1, nFanout, nLeaves);
+            else
+                nLeaves++;
+        });
+    }
+    group.Wait();
+}
+
+/**
+ * 任务抛出的异常由 Wait 重新抛出, 且只抛出一次; 析构函数不抛出; ParallelFor 抛出后不再
+ * 分配新的下标. 嵌套的任务组在只有一个线程(没有工作线程, 全部由等待的线程运行)和
+ * 多个线程时都能完成, 并且等待子组时不会运行无关组的任务.
+ */
+void CheckScheduler(CCheckRunner &runner)
+{
+    for (int nThreads : {1, 4})
+    {
+        SchedulerOptions options;
+        options.nThreads = nThreads;
+        CTaskScheduler scheduler(options);
+        const string suffix = "_" + to_string(nThreads) + "thread";
+
+        runner.Run("TaskGroupException" + suffix, [&] {
+            atomic<int> nRun(0);
+            CTaskGroup group(scheduler);
+            for (int i = 0; i < 100; i++)
+            {
+                group.Run([&nRun, i] {
+                    nRun++;
+                    if (i == 37 || i == 80)
+                        throw runtime_error("task " + to_string(i));
+                });
+            }
+            bool fThrown = false;
+            try
+            {
+                group.Wait();
+            }
+            catch (const runtime_error &e)
+            {
+                fThrown = true;
+                CHECK(string(e.what()) == "task 37" || string(e.what()) == "task 80");
+            }
+            CHECK(fThrown);
+            // 其余任务照常运行, 异常只交给一次 Wait
+            CHECK(nRun == 100);
+            group.Wait();
+
+            // 没有 Wait 就析构: 等待任务结束, 丢弃异常
+            {
+                CTaskGroup dropped(scheduler);
+                dropped.Run([] { throw runtime_error("dropped"); });
+            }
+        });
+
+        runner.Run("TaskGroupNested" + suffix, [&] {
+            atomic<int> nLeaves(0);
+            RunNested(scheduler, 4, 6, nLeaves);
+            CHECK(nLeaves == 6 * 6 * 6 * 6);
+
+            // 嵌套组中的异常经过每一层 Wait 传到最外层
+            bool fThrown = false;
+            try
+            {
+                CTaskGroup outer(scheduler);
+                outer.Run([&scheduler] {
+                    CTaskGroup inner(scheduler);
+                    inner.Run([] { throw runtime_error("inner"); });
+                    inner.Wait();
+                });
+                outer.Wait();
+            }
+            catch (const runtime_error &e)
+            {
+                fThrown = string(e.what()) == "inner";
+            }
+            CHECK(fThrown);
+        });
+    }
+
+    runner.Run("TaskGroupWaitOwnTasksOnly", [&] {
+        // 没有工作线程: 所有任务都在等待的线程上运行, 顺序确定
+        SchedulerOptions options;
+        options.nThreads = 1;
+        CTaskScheduler scheduler(options);
+        bool fForeignRun = false, fChildRun = false, fForeignSeenByChild = true;
+        CTaskGroup foreign(scheduler);
+        foreign.Run([&] { fForeignRun = true; });
+        CTaskGroup group(scheduler);
+        group.Run([&] {
+            CTaskGroup child(scheduler);
+            child.Run([&] { fChildRun = true; });
+            child.Wait();
+            fForeignSeenByChild = fForeignRun;
+        });
+        group.Wait();
+        CHECK(fChildRun);
+        CHECK(!fForeignSeenByChild);
+        CHECK(!fForeignRun);
+        foreign.Wait();
+        CHECK(fForeignRun);
+    });
+
+    runner.Run("ParallelFor", [&] {
+        vector<atomic<int>> vCalls(10000);
+        ParallelFor(vCalls.size(), 0, [&](size_t i) { vCalls[i]++; });
+        bool fOnce = true;
+        for (const atomic<int> &n : vCalls)
+            fOnce &= n == 1;
+        CHECK(fOnce);
+
+        // 抛出后剩下的下标不再分配: 单线程时恰好调用到抛出的那一个, 多线程时其他调用都较慢
+        for (int nMaxThreads : {1, 4})
+        {
+            atomic<size_t> nCalls(0);
+            bool fThrown = false;
+            try
+            {
+                ParallelFor(100000, nMaxThreads, [&](size_t i) {
+                    nCalls++;
+                    if (i == 10)
+                        throw runtime_error("ParallelFor");
+                    this_thread::sleep_for(chrono::microseconds(10));
+                });
+            }
+            catch (const runtime_error &e)
+            {
+                fThrown = string(e.what()) == "ParallelFor";
+            }
+            CHECK(fThrown);
+            CHECK(nMaxThreads == 1 ? nCalls == 11 : nCalls < 100000);
+        }
+    });
+}
+
+string MakeTempDirectory()
+{
+    char path[] = "/tmp/blockchain_check_XXXXXX";
+    return mkdtemp(path) ? path : "";
+}
+
+/** 从 blocktree 载入区块索引并链接, vChain 为工作量最大的链, 按高度排列. */
+bool LoadBlockTree(CBlockTreeDB &blocktree, CBlockIndexMap &mapBlockIndex, vector<const CBlockIndex *> &vChain, int nThreads = 0)
+{
+    auto insert = [&](const uint256 &hash) -> CBlockIndex * {
+        return hash.IsNull() ? nullptr : mapBlockIndex.Insert(hash);
+    };
+    if (!blocktree.LoadBlockIndexGuts(Params().GetConsensus(), insert, nThreads))
+        return false;
+    vector<CBlockIndex *> vSortedByHeight;
+    SortBlockIndexByHeight(mapBlockIndex, vSortedByHeight);
+    LinkBlockIndex(MakeSpan(vSortedByHeight));
+    const CBlockIndex *pindexTip = nullptr;
+    for (const CBlockIndex *pindex : vSortedByHeight)
+    {
+        if (!pindexTip || pindex->nChainWork > pindexTip->nChainWork)
+            pindexTip = pindex;
+    }
+    vChain.clear();
+    for (const CBlockIndex *pindex = pindexTip; pindex; pindex = pindex->pprev)
+        vChain.push_back(pindex);
+    reverse(vChain.begin(), vChain.end());
+    return true;
+}
+
+/**
+ * 在临时目录中生成的小型 regtest 链(几个 blk/rev 文件), 区块索引数据库放在内存中.
+ * 析构时删除临时目录.
+ */
+class CSyntheticChain
+{
+private:
+    const string m_dir;
+
+public:
+    CBlockTreeDB m_blocktree;
+    ChainGenOptions m_options;
+    bool m_ok = false;
+
+    CSyntheticChain() : m_dir(MakeTempDirectory()), m_blocktree("check_block_index", 8 << 20, true, false)
+    {
+        m_options.nBlocks = 300;
+        // 每个区块约 100 KB, 大多数超过 BLOCK_READ_PROBE_SIZE, 直接读取需要第二轮
+        m_options.nTxPerBlock = 250;
+        m_options.nMaxBlockFileSize = 4 << 20;
+        m_ok = !m_dir.empty() && GenerateSyntheticChain(Params(), GetBlocksDir(), m_blocktree, m_options);
+    }
+
+    ~CSyntheticChain()
+    {
+        if (!m_dir.empty())
+            nftw(m_dir.c_str(), [](const char *path, const struct stat *, int, struct FTW *) { return remove(path); }, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    string GetBlocksDir() const { return m_dir; }
+
+    /** 载入生成器写入的区块索引, 见 LoadBlockTree. */
+    bool Load(CBlockIndexMap &mapBlockIndex, vector<const CBlockIndex *> &vChain, int nThreads = 0)
+    {
+        return LoadBlockTree(m_blocktree, mapBlockIndex, vChain, nThreads);
+    }
+};
+
+/** 按哈希首字节分段并发载入的区块索引与单线程载入的完全相同. */
+void CheckLoadBlockIndex(CCheckRunner &runner, CSyntheticChain &chain)
+{
+    runner.Run("LoadBlockIndexGuts", [&] {
+        CBlockIndexMap mapSerial;
+        vector<const CBlockIndex *> vChain;
+        CHECK(chain.Load(mapSerial, vChain, 1));
+        CHECK(mapSerial.size() == (size_t)chain.m_options.nBlocks + 1);
+        CHECK(vChain.size() == (size_t)chain.m_options.nBlocks + 1);
+        CHECK(!vChain.empty() && vChain[0]->GetBlockHash() == Params().GetConsensus().hashGenesisBlock);
+        // 链分布在几个 blk 文件中
+        CHECK(!vChain.empty() && vChain.back()->nFile >= 2);
+        for (int nThreads : {2, 7, 256})
+        {
+            CBlockIndexMap mapBlockIndex;
+            vector<const CBlockIndex *> vParallel;
+            CHECK(chain.Load(mapBlockIndex, vParallel, nThreads));
+            CHECK(mapBlockIndex.size() == mapSerial.size());
+            for (const CBlockIndex *expected : mapSerial)
+            {
+                const CBlockIndex *pindex = mapBlockIndex.Find(expected->GetBlockHash());
+                CHECK(pindex);
+                if (!pindex)
+                    continue;
+                CHECK((pindex->pprev ? pindex->pprev->GetBlockHash() : uint256()) == (expected->pprev ? expected->pprev->GetBlockHash() : uint256()));
+                CHECK(pindex->nHeight == expected->nHeight);
+                CHECK(pindex->nFile == expected->nFile);
+                CHECK(pindex->nDataPos == expected->nDataPos);
+                CHECK(pindex->nUndoPos == expected->nUndoPos);
+                CHECK(pindex->nStatus == expected->nStatus);
+                CHECK(pindex->nTx == expected->nTx);
+                CHECK(pindex->nChainWork == expected->nChainWork);
+                CHECK(pindex->GetBlockHeader().GetHash() == expected->GetBlockHash());
+            }
+        }
+    });
+}
+
+/**
+ * 按高度重放生成的链, 自己记录每笔交易创建的输出: 每个区块的 undo 数据对每笔非 coinbase
+ * 交易的每个输入给出的 Coin 必须正是它花费的那个输出(金额, 脚本, 高度, 是否来自 coinbase).
+ */
+void CheckBlockUndo(CCheckRunner &runner, CSyntheticChain &chain)
+{
+    runner.Run("ReadBlockUndo", [&] {
+        CBlockIndexMap mapBlockIndex;
+        vector<const CBlockIndex *> vChain;
+        BlockManager blockman(chain.GetBlocksDir());
+        CHECK(chain.Load(mapBlockIndex, vChain));
+        CHECK(blockman.LoadBlockFileInfo(chain.m_blocktree));
+        map<COutPoint, Coin> mapCoins;
+        size_t nSpent = 0;
+        for (const CBlockIndex *pindex : vChain)
+        {
+            CBlock block;
+            CBlockUndo blockundo;
+            const bool fRead = blockman.ReadBlockFromDisk(block, pindex, Params().GetConsensus()) && blockman.ReadBlockUndo(blockundo, pindex);
+            CHECK(fRead);
+            if (!fRead)
+                return;
+            CHECK(blockundo.vtxundo.size() == block.vtx.size() - 1);
+            for (size_t i = 0; i < block.vtx.size(); i++)
+            {
+                const CTransaction &tx = *block.vtx[i];
+                if (i > 0 && i - 1 < blockundo.vtxundo.size())
+                {
+                    const CTxUndo &txundo = blockundo.vtxundo[i - 1];
+                    CHECK(txundo.vprevout.size() == tx.vin.size());
+                    for (size_t j = 0; j < min(tx.vin.size(), txundo.vprevout.size()); j++)
+                    {
+                        const auto it = mapCoins.find(tx.vin[j].prevout);
+                        CHECK(it != mapCoins.end());
+                        if (it == mapCoins.end())
+                            continue;
+                        const Coin &coin = txundo.vprevout[j];
+                        CHECK(coin.out == it->second.out);
+                        CHECK(coin.nHeight == it->second.nHeight);
+                        CHECK(coin.fCoinBase == it->second.fCoinBase);
+                        mapCoins.erase(it);
+                        nSpent++;
+                    }
+                }
+                for (size_t j = 0; j < tx.vout.size(); j++)
+                    mapCoins[COutPoint(tx.GetHash(), j)] = Coin(tx.vout[j], pindex->nHeight, i == 0);
+            }
+        }
+        CHECK(nSpent > 0);
+    });
+}
+
+bool SameBlock(const CBlock &a, const CBlock &b)
+{
+    CDataStream ssA(SER_DISK, CLIENT_VERSION), ssB(SER_DISK, CLIENT_VERSION);
+    ssA << a;
+    ssB << b;
+    if (ssA.str() != ssB.str() || a.vtx.size() != b.vtx.size())
+        return false;
+    for (size_t i = 0; i < a.vtx.size(); i++)
+    {
+        if (a.vtx[i]->GetHash() != b.vtx[i]->GetHash() || a.vtx[i]->GetWitnessHash() != b.vtx[i]->GetWitnessHash())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * 批量读取(合并相邻读取的 ReadBlocks, 以及经由 io_uring 和 pread 线程池的 ReadBlocksDirect)
+ * 对乱序且有重复的请求给出的区块与逐个 ReadBlockFromDisk 相同.
+ */
+void CheckReadBlocks(CCheckRunner &runner, CSyntheticChain &chain, mt19937_64 &rng)
+{
+    CBlockIndexMap mapBlockIndex;
+    vector<const CBlockIndex *> vChain;
+    BlockManager blockman(chain.GetBlocksDir());
+    const bool fLoaded = chain.Load(mapBlockIndex, vChain) && blockman.LoadBlockFileInfo(chain.m_blocktree);
+    if (!fLoaded)
+    {
+        runner.Run("ReadBlocks", [&] { CHECK(fLoaded); });
+        return;
+    }
+    const Consensus::Params &consensus = Params().GetConsensus();
+    vector<CBlock> vExpected(vChain.size());
+    size_t nLarge = 0;
+    for (size_t i = 0; i < vChain.size(); i++)
+    {
+        blockman.ReadBlockFromDisk(vExpected[i], vChain[i], consensus);
+        nLarge += ::GetSerializeSize(vExpected[i], CLIENT_VERSION) > BLOCK_READ_PROBE_SIZE;
+    }
+    // 整条链的乱序排列, 再加上一些重复的请求
+    vector<size_t> vOrder(vChain.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    shuffle(vOrder.begin(), vOrder.end(), rng);
+    for (int i = 0; i < 50; i++)
+        vOrder.push_back(rng() % vChain.size());
+    vector<const CBlockIndex *> vIndex;
+    for (size_t i : vOrder)
+        vIndex.push_back(vChain[i]);
+
+    auto check_read = [&](const function<bool(Span<const CBlockIndex *const>, vector<CBlock> &)> &read) {
+        CHECK(nLarge > 0 && nLarge < vChain.size());
+        for (size_t nCount : {(size_t)0, (size_t)1, (size_t)5, vIndex.size()})
+        {
+            vector<CBlock> vBlocks;
+            CHECK(read(Span<const CBlockIndex *const>(vIndex.data(), nCount), vBlocks));
+            CHECK(vBlocks.size() == nCount);
+            for (size_t i = 0; i < min(nCount, vBlocks.size()); i++)
+                CHECK(SameBlock(vBlocks[i], vExpected[vOrder[i]]));
+        }
+    };
+    runner.Run("ReadBlocks", [&] {
+        check_read([&](Span<const CBlockIndex *const> v, vector<CBlock> &vBlocks) { return blockman.ReadBlocks(v, vBlocks, consensus); });
+    });
+    runner.Run("ReadBlocksDirect[" + string(blockman.GetIOBackend().GetName()) + "]", [&] {
+        check_read([&](Span<const CBlockIndex *const> v, vector<CBlock> &vBlocks) { return blockman.ReadBlocksDirect(v, vBlocks, consensus); });
+    });
+    // 不使用 io_uring 时的后备实现, 深度小于请求数
+    blockman.SetIOBackend(MakeBlockIOBackend(4, false));
+    runner.Run("ReadBlocksDirect[" + string(blockman.GetIOBackend().GetName()) + "]", [&] {
+        check_read([&](Span<const CBlockIndex *const> v, vector<CBlock> &vBlocks) { return blockman.ReadBlocksDirect(v, vBlocks, consensus); });
+    });
+}
+
+/** 在 blk 文件末尾追加一条记录(魔数, 长度, 区块), 返回追加前的文件大小. */
+long AppendBlockRecord(const string &path, const CBlock &block)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    FILE *file = fopen(path.c_str(), "ab");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    const long nPos = ftell(file);
+    unsigned char size[4];
+    WriteLE32(size, ssBlock.size());
+    const bool ok = fwrite(Params().MessageStart(), 1, CMessageHeader::MESSAGE_START_SIZE, file) == CMessageHeader::MESSAGE_START_SIZE &&
+                    fwrite(size, 1, sizeof(size), file) == sizeof(size) && fwrite(ssBlock.data(), 1, ssBlock.size(), file) == ssBlock.size();
+    return fclose(file) == 0 && ok ? nPos : -1;
+}
+
+/** 修改 nNonce 直到区块头满足自己的 nBits(regtest 难度很低) */
+void MineHeader(CBlock &block)
+{
+    arith_uint256 target;
+    target.SetCompact(block.nBits);
+    for (block.nNonce = 0; UintToArith256(block.GetHash()) > target; block.nNonce++)
+    {
+    }
+}
+
+/**
+ * 从生成的 blk/rev 文件重建区块索引, 写入新的内存数据库: 每个区块的前一区块, 高度,
+ * 位置, undo 位置, 交易数与 BLOCK_HAVE_UNDO, 以及每个文件的 nSize / nUndoSize 都必须与
+ * 生成器写入的索引相同. 另外在最后一个 blk 文件末尾追加一个前一区块不存在的区块及其
+ * 子区块, 重建时两者都必须被丢弃; 检查结束后恢复文件.
+ */
+void CheckReindex(CCheckRunner &runner, CSyntheticChain &chain, mt19937_64 &rng)
+{
+    CBlockIndexMap mapExpected;
+    vector<const CBlockIndex *> vExpectedChain;
+    BlockManager expectedman(chain.GetBlocksDir());
+    const bool fLoaded = chain.Load(mapExpected, vExpectedChain) && expectedman.LoadBlockFileInfo(chain.m_blocktree);
+
+    // 重建 blocks_dir 的索引, 与生成器的索引逐项比较; vDropped 中的区块不能出现在重建的索引中,
+    // 最后一个 blk 文件末尾追加了 nAppended 字节
+    auto check_reindex = [&](const vector<uint256> &vDropped, unsigned int nAppended) {
+        CHECK(fLoaded);
+        CBlockTreeDB blocktree("check_reindex", 8 << 20, true, true);
+        ReindexOptions options;
+        options.nBatchSize = 100;
+        CHECK(ReindexBlockFiles(Params(), chain.GetBlocksDir(), blocktree, options));
+        bool fReindexing = true;
+        blocktree.ReadReindexing(fReindexing);
+        CHECK(!fReindexing);
+
+        CBlockIndexMap mapBlockIndex;
+        vector<const CBlockIndex *> vChain;
+        CHECK(LoadBlockTree(blocktree, mapBlockIndex, vChain));
+        CHECK(mapBlockIndex.size() == mapExpected.size());
+        CHECK(vChain.size() == vExpectedChain.size());
+        for (const CBlockIndex *expected : mapExpected)
+        {
+            const CBlockIndex *pindex = mapBlockIndex.Find(expected->GetBlockHash());
+            CHECK(pindex);
+            if (!pindex)
+                continue;
+            CHECK((pindex->pprev ? pindex->pprev->GetBlockHash() : uint256()) == (expected->pprev ? expected->pprev->GetBlockHash() : uint256()));
+            CHECK(pindex->nHeight == expected->nHeight);
+            CHECK(pindex->nFile == expected->nFile);
+            CHECK(pindex->nDataPos == expected->nDataPos);
+            CHECK(pindex->nUndoPos == expected->nUndoPos);
+            CHECK(pindex->nTx == expected->nTx);
+            CHECK((pindex->nStatus & BLOCK_HAVE_DATA) != 0);
+            CHECK((pindex->nStatus & BLOCK_HAVE_UNDO) == (expected->nStatus & BLOCK_HAVE_UNDO));
+        }
+        for (const uint256 &hash : vDropped)
+            CHECK(!mapBlockIndex.Find(hash));
+
+        BlockManager blockman(chain.GetBlocksDir());
+        CHECK(blockman.LoadBlockFileInfo(blocktree));
+        CHECK(blockman.GetLastFile() == expectedman.GetLastFile());
+        for (int nFile = 0; nFile <= expectedman.GetLastFile(); nFile++)
+        {
+            const CBlockFileInfo *info = blockman.GetFileInfo(nFile);
+            const CBlockFileInfo *expected = expectedman.GetFileInfo(nFile);
+            CHECK(info && expected);
+            if (!info || !expected)
+                continue;
+            // 追加的孤块记录格式完整, 计入所在 blk 文件的 nSize
+            CHECK(info->nSize == expected->nSize + (nFile == expectedman.GetLastFile() ? nAppended : 0));
+            CHECK(info->nUndoSize == expected->nUndoSize);
+            CHECK(info->nBlocks == expected->nBlocks);
+        }
+    };
+
+    runner.Run("ReindexBlockFiles", [&] { check_reindex({}, 0); });
+
+    runner.Run("ReindexBlockFilesOrphan", [&] {
+        CHECK(fLoaded && vExpectedChain.size() > 10);
+        if (!fLoaded || vExpectedChain.size() <= 10)
+            return;
+        // 孤块: 交易取自链中的一个区块(默克尔根不变), 前一区块是随机哈希
+        CBlock orphan;
+        CHECK(expectedman.ReadBlockFromDisk(orphan, vExpectedChain[10], Params().GetConsensus()));
+        orphan.hashPrevBlock = RandomHash(rng);
+        MineHeader(orphan);
+        CBlock child = orphan;
+        child.hashPrevBlock = orphan.GetHash();
+        MineHeader(child);
+
+        const string path = GetBlockFilePath(chain.GetBlocksDir(), "blk", expectedman.GetLastFile());
+        const long nOldSize = AppendBlockRecord(path, orphan);
+        CHECK(nOldSize >= 0 && AppendBlockRecord(path, child) > nOldSize);
+        struct stat st;
+        const unsigned int nAppended = stat(path.c_str(), &st) == 0 && nOldSize >= 0 ? st.st_size - nOldSize : 0;
+        check_reindex({orphan.GetHash(), child.GetHash()}, nAppended);
+        CHECK(nOldSize < 0 || truncate(path.c_str(), nOldSize) == 0);
+    });
+}
+
+/** 视图中的一笔交易与反序列化得到的交易逐项相同. */
+bool SameTransaction(const CTransactionView &view, const CTransaction &tx)
+{
+    if (view.GetVersion() != tx.nVersion || view.GetLockTime() != tx.nLockTime || view.HasWitness() != tx.HasWitness() ||
+        view.IsCoinBase() != tx.IsCoinBase() || view.GetInputCount() != tx.vin.size() || view.GetOutputCount() != tx.vout.size())
+        return false;
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+        const CTxInView in = view.GetInput(i);
+        const CTxIn &expected = tx.vin[i];
+        const Span<const unsigned char> script = in.GetScriptSig();
+        if (in.GetPrevHash() != expected.prevout.hash || in.GetPrevIndex() != expected.prevout.n || in.GetSequence() != expected.nSequence ||
+            !equal(script.begin(), script.end(), expected.scriptSig.begin(), expected.scriptSig.end()) ||
+            in.GetWitnessCount() != expected.scriptWitness.stack.size())
+            return false;
+        for (size_t j = 0; j < in.GetWitnessCount(); j++)
+        {
+            const Span<const unsigned char> item = in.GetWitness(j);
+            if (!equal(item.begin(), item.end(), expected.scriptWitness.stack[j].begin(), expected.scriptWitness.stack[j].end()))
+                return false;
+        }
+    }
+    for (size_t i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOutView out = view.GetOutput(i);
+        const Span<const unsigned char> script = out.GetScriptPubKey();
+        if (out.GetValue() != tx.vout[i].nValue || !equal(script.begin(), script.end(), tx.vout[i].scriptPubKey.begin(), tx.vout[i].scriptPubKey.end()))
+            return false;
+    }
+    return view.GetHash() == tx.GetHash() && view.GetWitnessHash() == tx.GetWitnessHash();
+}
+
+/** 区块头, 交易数与 txs 的序列化拼成的区块字节 */
+vector<unsigned char> MakeBlockBytes(const CBlockHeader &header, const vector<vector<unsigned char>> &vTx)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << header;
+    WriteCompactSize(ss, vTx.size());
+    for (const vector<unsigned char> &tx : vTx)
+        ss.write((const char *)tx.data(), tx.size());
+    return vector<unsigned char>(ss.begin(), ss.end());
+}
+
+/** CBlock 反序列化是否接受 data(并且没有剩余字节) */
+bool DeserializeBlock(const vector<unsigned char> &data)
+{
+    try
+    {
+        CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+        CBlock block;
+        ss >> block;
+        return ss.empty();
+    }
+    catch (const ios_base::failure &)
+    {
+        return false;
+    }
+}
+
+/**
+ * 对生成的链中的每个区块, CBlockView::Parse 得到的视图与 ReadBlockFromDisk 反序列化的区块
+ * 相同: 交易, 输入, 输出与见证数据的个数和内容, txid 与 wtxid(逐笔与 GetTxHashes 批量).
+ * 另外 Parse 必须像 CBlock 反序列化一样拒绝多余的见证标志, 未知的标志位和末尾多余的字节.
+ */
+void CheckBlockView(CCheckRunner &runner, CSyntheticChain &chain, mt19937_64 &rng)
+{
+    runner.Run("CBlockViewParse", [&] {
+        CBlockIndexMap mapBlockIndex;
+        vector<const CBlockIndex *> vChain;
+        BlockManager blockman(chain.GetBlocksDir());
+        CHECK(chain.Load(mapBlockIndex, vChain));
+        CHECK(blockman.LoadBlockFileInfo(chain.m_blocktree));
+        CBlockView view;
+        vector<uint256> vHash, vWitnessHash;
+        size_t nWitnessTx = 0;
+        for (const CBlockIndex *pindex : vChain)
+        {
+            CBlock block;
+            vector<uint8_t> raw;
+            const bool fRead = blockman.ReadBlockFromDisk(block, pindex, Params().GetConsensus()) && blockman.ReadRawBlockFromDisk(raw, pindex);
+            CHECK(fRead);
+            if (!fRead)
+                return;
+            const bool fParsed = view.Parse(Span<const unsigned char>(raw.data(), raw.size()));
+            CHECK(fParsed);
+            if (!fParsed)
+                continue;
+            CHECK(view.GetHash() == block.GetHash());
+            CHECK(view.GetHashMerkleRoot() == block.hashMerkleRoot);
+            CHECK(view.GetTxCount() == block.vtx.size());
+            if (view.GetTxCount() != block.vtx.size())
+                continue;
+            size_t nInputs = 0, nOutputs = 0;
+            for (size_t i = 0; i < block.vtx.size(); i++)
+            {
+                CHECK(SameTransaction(view.GetTx(i), *block.vtx[i]));
+                nInputs += block.vtx[i]->vin.size();
+                nOutputs += block.vtx[i]->vout.size();
+                nWitnessTx += block.vtx[i]->HasWitness();
+            }
+            CHECK(view.GetInputCount() == nInputs);
+            CHECK(view.GetOutputCount() == nOutputs);
+            view.GetTxHashes(vHash, &vWitnessHash);
+            CHECK(vHash.size() == block.vtx.size() && vWitnessHash.size() == block.vtx.size());
+            for (size_t i = 0; i < min(vHash.size(), vWitnessHash.size()) && i < block.vtx.size(); i++)
+                CHECK(vHash[i] == block.vtx[i]->GetHash() && vWitnessHash[i] == block.vtx[i]->GetWitnessHash());
+        }
+        // 生成的链中有带见证数据的交易
+        CHECK(nWitnessTx > 0);
+    });
+
+    runner.Run("CBlockViewParseMalformed", [&] {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        for (int i = 0; i < 2; i++)
+            mtx.vin.emplace_back(RandomHash(rng), i);
+        mtx.vout.emplace_back(5000, CScript() << RandomBytes(rng, 20));
+        mtx.vin[0].scriptWitness.stack.push_back(RandomBytes(rng, 72));
+        const CTransaction witnesstx(mtx);
+        CDataStream ssWitness(SER_DISK, CLIENT_VERSION), ssStripped(SER_DISK, CLIENT_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        ssWitness << witnesstx;
+        ssStripped << witnesstx;
+        const vector<unsigned char> witness(ssWitness.begin(), ssWitness.end()), stripped(ssStripped.begin(), ssStripped.end());
+        CBlockHeader header;
+        header.nVersion = 0x20000000;
+        header.hashPrevBlock = RandomHash(rng);
+
+        CBlockView view;
+        auto parse = [&](const vector<unsigned char> &data) { return view.Parse(Span<const unsigned char>(data.data(), data.size())); };
+        // 合法的区块: 带见证数据与不带见证数据的交易
+        const vector<unsigned char> valid = MakeBlockBytes(header, {stripped, witness});
+        CHECK(parse(valid) && view.GetTxCount() == 2 && !view.GetTx(0).HasWitness() && view.GetTx(1).HasWitness());
+        CHECK(DeserializeBlock(valid));
+
+        // 多余的见证标志: 有 marker 与 flag, 但每个输入的见证数据都为空
+        vector<unsigned char> superfluous = stripped;
+        superfluous.insert(superfluous.begin() + 4, {0x00, 0x01});
+        superfluous.insert(superfluous.end() - 4, witnesstx.vin.size(), 0x00);
+        // 未知的标志位: 带见证数据, flag 多出一位
+        vector<unsigned char> unknown = witness;
+        CHECK(unknown[4] == 0x00 && unknown[5] == 0x01);
+        unknown[5] = 0x03;
+        vector<unsigned char> trailing = valid;
+        trailing.push_back(0x00);
+        for (const vector<unsigned char> &data : {MakeBlockBytes(header, {stripped, superfluous}), MakeBlockBytes(header, {unknown}), trailing})
+        {
+            CHECK(!parse(data));
+            CHECK(view.IsNull() && view.GetTxCount() == 0);
+            CHECK(!DeserializeBlock(data));
+        }
+        // 拒绝之后视图可以继续使用
+        CHECK(parse(valid));
+    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    string filter;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        if (arg.compare(0, 8, "-filter=") == 0)
+            filter = arg.substr(8);
+        else
+        {
+            fprintf(stderr, "usage: %s [-filter=<substring>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 其他模块的诊断信息经 BCLog::Logger 的写线程输出到 stdout, 检查期间把 stdout 重定向到 /dev/null 丢弃, 结果只写到 stderr
+    fflush(stdout);
+    if (!freopen("/dev/null", "w", stdout))
+        fprintf(stderr, "无法重定向标准输出\n");
+
+    SHA256AutoDetect();
+    CCheckRunner runner(filter);
+    // 每项检查使用独立的固定种子, 单独运行某项检查时输入不变
+    {
+        mt19937_64 rng(1);
+        CheckSHA256(runner, rng);
+    }
+    {
+        mt19937_64 rng(2);
+        CheckBlockBatchHash(runner, rng);
+    }
+    {
+        mt19937_64 rng(3);
+        CheckFrozenBlockIndex(runner, rng);
+    }
+    {
+        mt19937_64 rng(4);
+        CheckLinkBlockIndex(runner, rng);
+    }
+    CheckScheduler(runner);
+
+    // 以下检查读取生成的 regtest 链
+    if (runner.Enabled("LoadBlockIndexGuts") || runner.Enabled("ReadBlockUndo") || runner.Enabled("ReadBlocks") || runner.Enabled("Reindex") ||
+        runner.Enabled("CBlockViewParse"))
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        CSyntheticChain chain;
+        if (!chain.m_ok)
+        {
+            fprintf(stderr, "无法生成检查用的区块链\n");
+            return 1;
+        }
+        CheckLoadBlockIndex(runner, chain);
+        CheckBlockUndo(runner, chain);
+        {
+            mt19937_64 rng(5);
+            CheckReadBlocks(runner, chain, rng);
+        }
+        {
+            mt19937_64 rng(6);
+            CheckReindex(runner, chain, rng);
+        }
+        {
+            mt19937_64 rng(7);
+            CheckBlockView(runner, chain, rng);
+        }
+    }
+
+    fprintf(stderr, "%d 项检查, %d 项失败\n", runner.GetRun(), runner.GetFailed());
+    return runner.GetFailed() ? 1 : 0;
+}
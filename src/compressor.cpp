@@ -0,0 +1,373 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compressor.h"
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+// hzx secp256k1 的素数域 p = 2^256 - 2^32 - 977, 元素用 4 个 64 位小端 limb 表示.
+// 这里只用于未压缩公钥的压缩/解压(求 y 坐标), 不追求常数时间
+typedef unsigned __int128 uint128;
+typedef uint64_t FieldElem[4];
+
+const uint64_t FIELD_C = 0x1000003D1ULL; // 2^256 mod p
+const FieldElem FIELD_P = {0xFFFFFFFEFFFFFC2FULL, ~0ULL, ~0ULL, ~0ULL};
+
+bool FieldGreaterOrEqualP(const FieldElem a)
+{
+    return a[3] == ~0ULL && a[2] == ~0ULL && a[1] == ~0ULL && a[0] >= FIELD_P[0];
+}
+
+void FieldSetBytes(FieldElem r, const unsigned char* be32)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | be32[(3 - i) * 8 + j];
+        r[i] = v;
+    }
+}
+
+void FieldGetBytes(unsigned char* be32, const FieldElem a)
+{
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            be32[(3 - i) * 8 + j] = a[i] >> (56 - 8 * j);
+}
+
+//! r = a + b*C 折叠后的结果, 输入为 512 位乘积
+void FieldReduce(FieldElem r, const uint64_t t[8])
+{
+    uint64_t s[4];
+    uint128 c = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        c += (uint128)t[i] + (uint128)t[4 + i] * FIELD_C;
+        s[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    // 第二次折叠, c < 2^34
+    c = (uint128)s[0] + c * FIELD_C;
+    s[0] = (uint64_t)c;
+    c >>= 64;
+    for (int i = 1; i < 4; i++)
+    {
+        c += s[i];
+        s[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    if (c)
+    {
+        // 再次溢出时 s 很小, 加上 C 不会再进位
+        c = (uint128)s[0] + FIELD_C;
+        s[0] = (uint64_t)c;
+        c >>= 64;
+        for (int i = 1; i < 4 && c; i++)
+        {
+            c += s[i];
+            s[i] = (uint64_t)c;
+            c >>= 64;
+        }
+    }
+    if (FieldGreaterOrEqualP(s))
+    {
+        // s - p = s + C - 2^256
+        c = (uint128)s[0] + FIELD_C;
+        s[0] = (uint64_t)c;
+        c >>= 64;
+        for (int i = 1; i < 4; i++)
+        {
+            c += s[i];
+            s[i] = (uint64_t)c;
+            c >>= 64;
+        }
+    }
+    memcpy(r, s, sizeof(s));
+}
+
+void FieldMul(FieldElem r, const FieldElem a, const FieldElem b)
+{
+    uint64_t t[8] = {0};
+    for (int i = 0; i < 4; i++)
+    {
+        uint128 c = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            c += (uint128)a[i] * b[j] + t[i + j];
+            t[i + j] = (uint64_t)c;
+            c >>= 64;
+        }
+        t[i + 4] = (uint64_t)c;
+    }
+    FieldReduce(r, t);
+}
+
+void FieldAddSmall(FieldElem r, uint64_t v)
+{
+    uint64_t t[8] = {r[0], r[1], r[2], r[3], 0, 0, 0, 0};
+    uint128 c = v;
+    for (int i = 0; i < 5; i++)
+    {
+        c += t[i];
+        t[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    FieldReduce(r, t);
+}
+
+//! r = x^3 + 7
+void CurveRhs(FieldElem r, const FieldElem x)
+{
+    FieldElem x2;
+    FieldMul(x2, x, x);
+    FieldMul(r, x2, x);
+    FieldAddSmall(r, 7);
+}
+
+//! p ≡ 3 (mod 4), 所以 sqrt(a) = a^((p+1)/4); 返回 false 表示 a 不是二次剩余
+bool FieldSqrt(FieldElem r, const FieldElem a)
+{
+    // e = (p + 1) / 4
+    FieldElem e;
+    uint128 c = (uint128)FIELD_P[0] + 1;
+    e[0] = (uint64_t)c;
+    c >>= 64;
+    for (int i = 1; i < 4; i++)
+    {
+        c += FIELD_P[i];
+        e[i] = (uint64_t)c;
+        c >>= 64;
+    }
+    for (int i = 0; i < 4; i++)
+        e[i] = (e[i] >> 2) | (i < 3 ? e[i + 1] << 62 : (uint64_t)c << 62);
+
+    FieldElem x = {1, 0, 0, 0};
+    for (int bit = 255; bit >= 0; bit--)
+    {
+        FieldMul(x, x, x);
+        if ((e[bit / 64] >> (bit % 64)) & 1)
+            FieldMul(x, x, a);
+    }
+    FieldElem check;
+    FieldMul(check, x, x);
+    if (memcmp(check, a, sizeof(check)) != 0)
+        return false;
+    memcpy(r, x, sizeof(x));
+    return true;
+}
+
+//! 未压缩公钥 04 || x || y 是否在曲线上
+bool IsValidUncompressedPubKey(const unsigned char* pubkey)
+{
+    if (pubkey[0] != 0x04)
+        return false;
+    FieldElem x, y, y2, rhs;
+    FieldSetBytes(x, pubkey + 1);
+    FieldSetBytes(y, pubkey + 33);
+    if (FieldGreaterOrEqualP(x) || FieldGreaterOrEqualP(y))
+        return false;
+    FieldMul(y2, y, y);
+    CurveRhs(rhs, x);
+    return memcmp(y2, rhs, sizeof(y2)) == 0;
+}
+
+//! 由 x 坐标与 y 的奇偶性恢复未压缩公钥
+bool DecompressPubKey(unsigned char* out65, const unsigned char* x32, bool fOdd)
+{
+    FieldElem x, rhs, y;
+    FieldSetBytes(x, x32);
+    if (FieldGreaterOrEqualP(x))
+        return false;
+    CurveRhs(rhs, x);
+    if (!FieldSqrt(y, rhs))
+        return false;
+    if ((bool)(y[0] & 1) != fOdd)
+    {
+        // y = p - y (y != 0, 因为 x^3 + 7 = 0 在 p 上无解)
+        uint128 borrow = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint128 d = (uint128)FIELD_P[i] - y[i] - borrow;
+            y[i] = (uint64_t)d;
+            borrow = (d >> 64) ? 1 : 0;
+        }
+    }
+    out65[0] = 0x04;
+    memcpy(out65 + 1, x32, 32);
+    FieldGetBytes(out65 + 33, y);
+    return true;
+}
+
+bool IsToKeyID(const CScript& script)
+{
+    return script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160
+                            && script[2] == 20 && script[23] == OP_EQUALVERIFY
+                            && script[24] == OP_CHECKSIG;
+}
+
+bool IsToScriptID(const CScript& script)
+{
+    return script.size() == 23 && script[0] == OP_HASH160 && script[1] == 20
+                            && script[22] == OP_EQUAL;
+}
+
+bool IsToPubKey(const CScript& script)
+{
+    if (script.size() == 35 && script[0] == 33 && script[34] == OP_CHECKSIG
+                            && (script[1] == 0x02 || script[1] == 0x03))
+        return true;
+    if (script.size() == 67 && script[0] == 65 && script[66] == OP_CHECKSIG
+                            && script[1] == 0x04)
+        return IsValidUncompressedPubKey(&script[1]);  // if not fully valid, a case that would not be compressible
+    return false;
+}
+} // namespace
+
+bool CompressScript(const CScript& script, std::vector<unsigned char>& out)
+{
+    if (IsToKeyID(script))
+    {
+        out.resize(21);
+        out[0] = 0x00;
+        memcpy(&out[1], &script[3], 20);
+        return true;
+    }
+    if (IsToScriptID(script))
+    {
+        out.resize(21);
+        out[0] = 0x01;
+        memcpy(&out[1], &script[2], 20);
+        return true;
+    }
+    if (IsToPubKey(script))
+    {
+        out.resize(33);
+        memcpy(&out[1], &script[2], 32);
+        if (script[1] == 0x02 || script[1] == 0x03)
+        {
+            out[0] = script[1];
+            return true;
+        }
+        out[0] = 0x04 | (script[65] & 0x01);
+        return true;
+    }
+    return false;
+}
+
+unsigned int GetSpecialScriptSize(unsigned int nSize)
+{
+    if (nSize == 0 || nSize == 1)
+        return 20;
+    if (nSize == 2 || nSize == 3 || nSize == 4 || nSize == 5)
+        return 32;
+    return 0;
+}
+
+bool DecompressScript(CScript& script, unsigned int nSize, const std::vector<unsigned char>& in)
+{
+    switch (nSize)
+    {
+    case 0x00:
+        script.resize(25);
+        script[0] = OP_DUP;
+        script[1] = OP_HASH160;
+        script[2] = 20;
+        memcpy(&script[3], in.data(), 20);
+        script[23] = OP_EQUALVERIFY;
+        script[24] = OP_CHECKSIG;
+        return true;
+    case 0x01:
+        script.resize(23);
+        script[0] = OP_HASH160;
+        script[1] = 20;
+        memcpy(&script[2], in.data(), 20);
+        script[22] = OP_EQUAL;
+        return true;
+    case 0x02:
+    case 0x03:
+        script.resize(35);
+        script[0] = 33;
+        script[1] = nSize;
+        memcpy(&script[2], in.data(), 32);
+        script[34] = OP_CHECKSIG;
+        return true;
+    case 0x04:
+    case 0x05:
+        unsigned char vch[65];
+        if (!DecompressPubKey(vch, in.data(), nSize == 0x05))
+            return false;
+        script.resize(67);
+        script[0] = 65;
+        memcpy(&script[1], vch, 65);
+        script[66] = OP_CHECKSIG;
+        return true;
+    }
+    return false;
+}
+
+// Amount compression:
+// * If the amount is 0, output 0
+// * first, divide the amount (in base units) by the largest power of 10 possible; call the exponent e (e is max 9)
+// * if e<9, the last digit of the resulting number cannot be 0; store it as d, and drop it (divide by 10)
+//   * call the result n
+//   * output 1 + 10*(9*n + d - 1) + e
+// * if e==9, we only know the resulting number is not zero, so output 1 + 10*(n - 1) + 9
+// (this is decodable, as d is in [1-9] and e is in [0-9])
+
+uint64_t CompressAmount(uint64_t n)
+{
+    if (n == 0)
+        return 0;
+    int e = 0;
+    while (((n % 10) == 0) && e < 9)
+    {
+        n /= 10;
+        e++;
+    }
+    if (e < 9)
+    {
+        int d = (n % 10);
+        assert(d >= 1 && d <= 9);
+        n /= 10;
+        return 1 + (n * 9 + d - 1) * 10 + e;
+    }
+    else
+    {
+        return 1 + (n - 1) * 10 + 9;
+    }
+}
+
+uint64_t DecompressAmount(uint64_t x)
+{
+    // x = 0  OR  x = 1+10*(9*n + d - 1) + e  OR  x = 1+10*(n - 1) + 9
+    if (x == 0)
+        return 0;
+    x--;
+    // x = 10*(9*n + d - 1) + e
+    int e = x % 10;
+    x /= 10;
+    uint64_t n = 0;
+    if (e < 9)
+    {
+        // x = 9*n + d - 1
+        int d = (x % 9) + 1;
+        x /= 9;
+        // x = n
+        n = x * 10 + d;
+    }
+    else
+    {
+        n = x + 1;
+    }
+    while (e)
+    {
+        n *= 10;
+        e--;
+    }
+    return n;
+}
@@ -11,6 +11,7 @@
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include "leveldb/helpers/memenv/memenv.h"
+#include "logging.h"
 #include <stdint.h>
 #include <algorithm>
 
@@ -21,10 +22,10 @@ public:
     // Please do not do this in normal code
     void Logv(const char *format, va_list ap) override
     {
-        // 暂时注释掉
-        // if (!LogAcceptCategory(BCLog::LEVELDB)) {
-        //     return;
-        // }
+        if (!LogAcceptCategory(BCLog::LEVELDB, BCLog::Level::Debug))
+        {
+            return;
+        }
         char buffer[500];
         for (int iter = 0; iter < 2; iter++)
         {
@@ -74,7 +75,7 @@ public:
 
             assert(p <= limit);
             base[std::min(bufsize - 1, (int)(p - base))] = '\0';
-            // LogPrintf("leveldb: %s", base);  /* Continued */
+            LogDebug(BCLog::LEVELDB, "leveldb: %s", base); /* Continued */
             if (base != buffer)
             {
                 delete[] base;
@@ -107,8 +108,8 @@ static void SetMaxOpenFiles(leveldb::Options *options)
         options->max_open_files = 64;
     }
 #endif
-    printf("BCLog::LEVELDB, LevelDB using max_open_files=%d (default=%d)\n",
-           options->max_open_files, default_open_files);
+    LogDebug(BCLog::LEVELDB, "LevelDB using max_open_files=%d (default=%d)\n",
+             options->max_open_files, default_open_files);
 }
 
 static leveldb::Options GetOptions(size_t nCacheSize)
@@ -132,7 +133,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
 CDBWrapper::CDBWrapper(const std::string &path, unsigned long nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
     : m_name(path)
 {
-    printf("%s : 初始化CDBWrapper变量 \n", __func__);
+    LogDebug(BCLog::LEVELDB, "%s : 初始化CDBWrapper变量 \n", __func__);
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
@@ -204,8 +205,10 @@ bool CDBWrapper::WriteBatch(CDBBatch &batch, bool fSync)
     // if (log_memory) {
     //     mem_before = DynamicMemoryUsage() / 1024.0 / 1024;
     // }
-    // leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
-    // dbwrapper_private::HandleError(status);
+    leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    // HandleError 成功时也会打印, 写入频繁, 只在失败时调用
+    if (!status.ok())
+        dbwrapper_private::HandleError(status);
     // if (log_memory) {
     //     double mem_after = DynamicMemoryUsage() / 1024.0 / 1024;
     //     // LogPrint(BCLog::LEVELDB, "WriteBatch memory usage: db=%s, before=%.1fMiB, after=%.1fMiB\n",
@@ -225,6 +228,11 @@ size_t CDBWrapper::DynamicMemoryUsage() const
     return stoul(memory);
 }
 
+bool CDBWrapper::GetProperty(const std::string &property, std::string &value) const
+{
+    return pdb->GetProperty(property, &value);
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -253,8 +261,18 @@ bool CDBWrapper::IsEmpty()
 
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
-void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
-void CDBIterator::Next() { piter->Next(); }
+void CDBIterator::SeekToFirst()
+{
+    CMetricTimer timer(seek_latency);
+    piter->SeekToFirst();
+}
+void CDBIterator::Next()
+{
+    if (nNextCalls++ % DBWRAPPER_NEXT_SAMPLE_INTERVAL)
+        return piter->Next();
+    CMetricTimer timer(next_latency);
+    piter->Next();
+}
 
 namespace dbwrapper_private
 {
@@ -263,13 +281,13 @@ void HandleError(const leveldb::Status &status)
 {
     if (status.ok())
     {
-        printf("%s: levelDB 打开成功\n", __func__);
+        LogDebug(BCLog::LEVELDB, "%s: levelDB 打开成功\n", __func__);
         return;
     }
     const std::string errmsg = "Fatal LevelDB error: " + status.ToString();
-    printf("%s: levelDB 打开失败,错误信息: %s\n", __func__, errmsg.data());
+    LogError("%s: levelDB 打开失败,错误信息: %s\n", __func__, errmsg.data());
     // LogPrintf("%s\n", errmsg);
-    // LogPrintf("You can use -debug=leveldb to get more complete diagnostic messages\n");
+    LogInfo("You can use -debug=leveldb to get more complete diagnostic messages\n");
     throw dbwrapper_error(errmsg);
 }
 
@@ -278,4 +296,16 @@ const std::vector<unsigned char> &GetObfuscateKey(const CDBWrapper &w)
     return w.obfuscate_key;
 }
 
+CMetricHistogram &GetLatency()
+{
+    static CMetricHistogram &histogram = Metrics().Histogram("blockchain_leveldb_get_seconds", "Latency of LevelDB point lookups");
+    return histogram;
+}
+
+CMetricHistogram &IterateLatency(const char *op)
+{
+    // 只在创建迭代器时查找一次
+    return Metrics().Histogram("blockchain_leveldb_iterate_seconds", "Latency of LevelDB iterator seeks and steps (steps are sampled)", std::string("op=\"") + op + "\"");
+}
+
 } // namespace dbwrapper_private
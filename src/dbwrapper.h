@@ -7,6 +7,7 @@
 
 #include "clientversion.h"
 // #include <fs.h>
+#include "metrics.h"
 #include "serialize.h"
 #include "streams.h"
 // #include <util/system.h>
@@ -18,6 +19,8 @@
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! Only one in this many CDBIterator::Next calls is timed; timing one costs about as much as the step
+static const uint32_t DBWRAPPER_NEXT_SAMPLE_INTERVAL = 16;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -41,6 +44,12 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/** Latency of point lookups (Read, Exists) of every database. */
+CMetricHistogram& GetLatency();
+
+/** Latency of iterator moves of every database; op is "seek" or "next" (sampled, see DBWRAPPER_NEXT_SAMPLE_INTERVAL). */
+CMetricHistogram& IterateLatency(const char* op);
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -119,6 +128,9 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    CMetricHistogram& seek_latency;
+    CMetricHistogram& next_latency;
+    uint32_t nNextCalls = 0;
 
 public:
 
@@ -127,7 +139,8 @@ public:
      * @param[in] _piter           The original leveldb iterator.
      */
     CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) :
-        parent(_parent), piter(_piter) { };
+        parent(_parent), piter(_piter), seek_latency(dbwrapper_private::IterateLatency("seek")),
+        next_latency(dbwrapper_private::IterateLatency("next")) { };
     ~CDBIterator();
 
     bool Valid() const;
@@ -140,6 +153,7 @@ public:
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        CMetricTimer timer(seek_latency);
         piter->Seek(slKey);
     }
 
@@ -238,7 +252,11 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status;
+        {
+            CMetricTimer timer(dbwrapper_private::GetLatency());
+            status = pdb->Get(readoptions, slKey, &strValue);
+        }
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -272,7 +290,11 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status;
+        {
+            CMetricTimer timer(dbwrapper_private::GetLatency());
+            status = pdb->Get(readoptions, slKey, &strValue);
+        }
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -295,6 +317,9 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
+    // Read a LevelDB property such as "leveldb.sstables"; false if it is unknown.
+    bool GetProperty(const std::string& property, std::string& value) const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -0,0 +1,97 @@
+// hzx 生成用于测试与基准测试的 regtest 数据目录, 与 main.cpp 一样由 VS Code 的 Build 任务编译(打开本文件编译, 生成 generate.out).
+//
+// 生成的目录结构与 bitcoind 相同: <datadir>/blocks/blk?????.dat, rev?????.dat 与 <datadir>/blocks/index,
+// 之后可以用 main.out -chain=regtest -datadir=<datadir> 载入.
+//
+// 参数:
+//   -datadir=<目录>      输出目录(必需), 已有的区块索引会被清空
+//   -blocks=<n>          创世块之后的区块数, 默认 1000
+//   -txs=<n>             每个区块中非 coinbase 交易数, 默认 100
+//   -maxinputs=<n>       每笔交易最多的输入数, 默认 3
+//   -maxoutputs=<n>      每笔交易最多的输出数, 默认 3
+//   -witness=<0..1>      花费隔离见证输出(带见证数据)的交易比例, 默认 0.5
+//   -scripts=<类型:权重,...>  输出脚本的比例, 类型为 p2pkh p2sh p2wpkh p2wsh p2tr nulldata,
+//                        默认 p2pkh:40,p2sh:10,p2wpkh:30,p2wsh:10,p2tr:5,nulldata:5
+//   -filesize=<MiB>      单个 blk 文件的最大大小, 默认 128
+//   -seed=<n>            随机数种子, 默认 1
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include "chainGen.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "sha256.h"
+#include "txdb.h"
+
+using namespace std;
+
+static bool MakeDirectory(const string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0)
+        return S_ISDIR(st.st_mode);
+    return mkdir(path.c_str(), 0755) == 0;
+}
+
+static int Usage(const char *name)
+{
+    fprintf(stderr, "usage: %s -datadir=<dir> [-blocks=<n>] [-txs=<n>] [-maxinputs=<n>] [-maxoutputs=<n>] [-witness=<share>]\n"
+                    "       [-scripts=<type:weight,...>] [-filesize=<MiB>] [-seed=<n>]\n",
+            name);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    string datadir;
+    ChainGenOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        const size_t nEq = arg.find('=');
+        if (arg[0] != '-' || nEq == string::npos)
+            return Usage(argv[0]);
+        const string name = arg.substr(1, nEq - 1), value = arg.substr(nEq + 1);
+        if (name == "datadir")
+            datadir = value;
+        else if (name == "blocks")
+            options.nBlocks = atoi(value.c_str());
+        else if (name == "txs")
+            options.nTxPerBlock = atoi(value.c_str());
+        else if (name == "maxinputs")
+            options.nMaxInputs = atoi(value.c_str());
+        else if (name == "maxoutputs")
+            options.nMaxOutputs = atoi(value.c_str());
+        else if (name == "witness")
+            options.dWitnessShare = atof(value.c_str());
+        else if (name == "filesize")
+            options.nMaxBlockFileSize = (unsigned int)max(1, min(atoi(value.c_str()), 4095)) << 20;
+        else if (name == "seed")
+            options.nSeed = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "scripts")
+        {
+            if (!ParseScriptMix(value, options))
+            {
+                fprintf(stderr, "无法解析 -scripts=%s\n", value.data());
+                return 1;
+            }
+        }
+        else
+            return Usage(argv[0]);
+    }
+    if (datadir.empty())
+        return Usage(argv[0]);
+
+    SelectParams(CBaseChainParams::REGTEST);
+    SHA256AutoDetect();
+    const string blocks_dir = datadir + "/blocks";
+    if (!MakeDirectory(datadir) || !MakeDirectory(blocks_dir))
+    {
+        fprintf(stderr, "无法创建目录 %s\n", blocks_dir.data());
+        return 1;
+    }
+    CBlockTreeDB blocktree(blocks_dir + "/index", 8 << 20, false, true);
+    return GenerateSyntheticChain(Params(), blocks_dir, blocktree, options) ? 0 : 1;
+}
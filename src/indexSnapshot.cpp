@@ -0,0 +1,196 @@
+#include "indexSnapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include "arith_uint256.h"
+#include "blkMmap.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "logging.h"
+#include "streams.h"
+#include "trace.h"
+#include "txdb.h"
+
+namespace
+{
+//! magic, version, fingerprint and record count
+static const size_t INDEX_SNAPSHOT_HEADER_SIZE = 4 + 4 + 68 + 4;
+} // namespace
+
+bool GetIndexSnapshotFingerprint(CBlockTreeDB& blocktree, CIndexSnapshotFingerprint& fingerprint)
+{
+    // hzx 只使用 leveldb 的公开接口: 文件信息记录与表文件列表, 不读取 leveldb 的内部结构
+    int nLastFile = 0;
+    if (!blocktree.ReadLastBlockFile(nLastFile))
+        return false;
+    CHashWriter hwFileInfo(SER_DISK, CLIENT_VERSION);
+    for (int nFile = 0; nFile <= nLastFile; nFile++)
+    {
+        CBlockFileInfo info;
+        if (!blocktree.ReadBlockFileInfo(nFile, info))
+            return false;
+        hwFileInfo << info;
+    }
+    std::string strTables;
+    if (!blocktree.GetProperty("leveldb.sstables", strTables))
+        return false;
+    CHashWriter hwTables(SER_DISK, CLIENT_VERSION);
+    hwTables.write(strTables.data(), strTables.size());
+    fingerprint.nLastBlockFile = nLastFile;
+    fingerprint.hashFileInfo = hwFileInfo.GetHash();
+    fingerprint.hashTables = hwTables.GetHash();
+    return true;
+}
+
+bool WriteIndexSnapshot(const std::string& path, const CBlockIndexMap& mapBlockIndex, const CIndexSnapshotFingerprint& fingerprint)
+{
+    TRACE_SPAN("WriteIndexSnapshot");
+    std::vector<const CBlockIndex*> vEntries;
+    vEntries.reserve(mapBlockIndex.size());
+    for (const CBlockIndex* pindex : mapBlockIndex)
+        vEntries.push_back(pindex);
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    std::unordered_map<const CBlockIndex*, int32_t> mapPos;
+    mapPos.reserve(vEntries.size());
+    for (size_t i = 0; i < vEntries.size(); i++)
+        mapPos.emplace(vEntries[i], i);
+    auto pos_of = [&](const CBlockIndex* pindex) -> int32_t {
+        if (!pindex)
+            return -1;
+        auto it = mapPos.find(pindex);
+        return it == mapPos.end() ? -1 : it->second;
+    };
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.reserve(INDEX_SNAPSHOT_HEADER_SIZE + vEntries.size() * CIndexSnapshotRecord::SIZE);
+    ss << INDEX_SNAPSHOT_MAGIC << INDEX_SNAPSHOT_VERSION << fingerprint << (uint32_t)vEntries.size();
+    for (const CBlockIndex* pindex : vEntries)
+    {
+        CIndexSnapshotRecord record;
+        record.hash = pindex->GetBlockHash();
+        record.nPrev = pos_of(pindex->pprev);
+        record.nSkip = pos_of(pindex->pskip);
+        record.nHeight = pindex->nHeight;
+        record.nFile = pindex->nFile;
+        record.nDataPos = pindex->nDataPos;
+        record.nUndoPos = pindex->nUndoPos;
+        record.nChainWork = ArithToUint256(pindex->nChainWork);
+        record.nTx = pindex->nTx;
+        record.nChainTx = pindex->nChainTx;
+        record.nStatus = pindex->nStatus;
+        record.nVersion = pindex->nVersion;
+        record.hashMerkleRoot = pindex->hashMerkleRoot;
+        record.nTime = pindex->nTime;
+        record.nBits = pindex->nBits;
+        record.nNonce = pindex->nNonce;
+        record.nSequenceId = pindex->nSequenceId;
+        record.nTimeMax = pindex->nTimeMax;
+        ss << record;
+    }
+
+    const std::string tmp_path = path + ".new";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file)
+    {
+        LogError("%s: 无法创建快照文件 %s\n", __func__, tmp_path.data());
+        return false;
+    }
+    bool ok = fwrite(ss.data(), 1, ss.size(), file) == ss.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        LogError("%s: 写入快照文件失败 %s\n", __func__, path.data());
+        remove(tmp_path.c_str());
+        return false;
+    }
+    LogInfo("%s: 写入 %lu 个区块索引到快照 %s\n", __func__, (unsigned long)vEntries.size(), path.data());
+    return true;
+}
+
+bool LoadIndexSnapshot(const std::string& path, const CIndexSnapshotFingerprint& fingerprint, CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight)
+{
+    TRACE_SPAN("LoadIndexSnapshot");
+    CMappedFile file(path);
+    if (file.IsNull())
+        return false;
+
+    std::vector<std::pair<int32_t, int32_t>> vLinks;
+    try
+    {
+        SpanReader ss(SER_DISK, CLIENT_VERSION, file.GetSpan());
+        uint32_t nMagic, nVersion, nRecords;
+        CIndexSnapshotFingerprint fingerprintFile;
+        ss >> nMagic >> nVersion >> fingerprintFile >> nRecords;
+        if (nMagic != INDEX_SNAPSHOT_MAGIC || nVersion != INDEX_SNAPSHOT_VERSION)
+        {
+            LogWarning("%s: 快照格式或版本不匹配, 忽略 %s\n", __func__, path.data());
+            return false;
+        }
+        if (fingerprintFile != fingerprint)
+        {
+            LogInfo("%s: 区块索引数据库已变化, 快照过期\n", __func__);
+            return false;
+        }
+        if (ss.size() != (size_t)nRecords * CIndexSnapshotRecord::SIZE)
+        {
+            LogError("%s: 快照文件大小不正确 %s\n", __func__, path.data());
+            return false;
+        }
+
+        mapBlockIndex.Reserve(nRecords);
+        vSortedByHeight.clear();
+        vSortedByHeight.reserve(nRecords);
+        vLinks.reserve(nRecords);
+        CIndexSnapshotRecord record;
+        for (uint32_t i = 0; i < nRecords; i++)
+        {
+            ss >> record;
+            bool fInserted = false;
+            CBlockIndex* pindex = mapBlockIndex.Insert(record.hash, &fInserted);
+            if (!fInserted)
+                throw std::ios_base::failure("duplicate block hash");
+            pindex->nHeight = record.nHeight;
+            pindex->nFile = record.nFile;
+            pindex->nDataPos = record.nDataPos;
+            pindex->nUndoPos = record.nUndoPos;
+            pindex->nChainWork = UintToArith256(record.nChainWork);
+            pindex->nTx = record.nTx;
+            pindex->nChainTx = record.nChainTx;
+            pindex->nStatus = record.nStatus;
+            pindex->nVersion = record.nVersion;
+            pindex->hashMerkleRoot = record.hashMerkleRoot;
+            pindex->nTime = record.nTime;
+            pindex->nBits = record.nBits;
+            pindex->nNonce = record.nNonce;
+            pindex->nSequenceId = record.nSequenceId;
+            pindex->nTimeMax = record.nTimeMax;
+            vSortedByHeight.push_back(pindex);
+            vLinks.emplace_back(record.nPrev, record.nSkip);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LogError("%s: 读取快照失败 - %s\n", __func__, e.what());
+        mapBlockIndex.Clear();
+        vSortedByHeight.clear();
+        return false;
+    }
+
+    const int32_t nRecords = vSortedByHeight.size();
+    for (int32_t i = 0; i < nRecords; i++)
+    {
+        const int32_t nPrev = vLinks[i].first, nSkip = vLinks[i].second;
+        if (nPrev >= nRecords || nSkip >= nRecords)
+        {
+            LogError("%s: 快照中的链接越界 %s\n", __func__, path.data());
+            mapBlockIndex.Clear();
+            vSortedByHeight.clear();
+            return false;
+        }
+        vSortedByHeight[i]->pprev = nPrev < 0 ? nullptr : vSortedByHeight[nPrev];
+        vSortedByHeight[i]->pskip = nSkip < 0 ? nullptr : vSortedByHeight[nSkip];
+    }
+    LogInfo("%s: 从快照载入 %d 个区块索引\n", __func__, nRecords);
+    return true;
+}
@@ -0,0 +1,116 @@
+#ifndef BLOCKCHAIN_INDEXSNAPSHOT_H
+#define BLOCKCHAIN_INDEXSNAPSHOT_H
+#include <string>
+#include <vector>
+#include "blockIndexMap.h"
+#include "chain.h"
+#include "serialize.h"
+
+class CBlockTreeDB;
+
+static const uint32_t INDEX_SNAPSHOT_MAGIC = 0x78646968; // "hidx"
+static const uint32_t INDEX_SNAPSHOT_VERSION = 2;
+
+/**
+ * Identifies the state of blocks/index a snapshot was computed from. A snapshot is only
+ * used if the database still has the same last block file (DB_LAST_BLOCK), the same
+ * DB_BLOCK_FILES records and the same table files. Every write goes to the LevelDB log,
+ * which is turned into a new table when the database is opened again, so a database that
+ * was written since the snapshot always lists different tables.
+ */
+struct CIndexSnapshotFingerprint
+{
+    int32_t nLastBlockFile = -1;
+    //! hash of the DB_BLOCK_FILES records 0 .. nLastBlockFile
+    uint256 hashFileInfo;
+    //! hash of the "leveldb.sstables" property: number, size and key range of every table
+    uint256 hashTables;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nLastBlockFile);
+        READWRITE(hashFileInfo);
+        READWRITE(hashTables);
+    }
+
+    friend bool operator==(const CIndexSnapshotFingerprint& a, const CIndexSnapshotFingerprint& b)
+    {
+        return a.nLastBlockFile == b.nLastBlockFile && a.hashFileInfo == b.hashFileInfo && a.hashTables == b.hashTables;
+    }
+    friend bool operator!=(const CIndexSnapshotFingerprint& a, const CIndexSnapshotFingerprint& b) { return !(a == b); }
+};
+
+/**
+ * One CBlockIndex in the snapshot file. Every field is fixed width, so record n lives
+ * at a known offset and the file can be used straight from an mmap. Links to other
+ * entries are stored as record numbers (-1 = none).
+ */
+struct CIndexSnapshotRecord
+{
+    static const size_t SIZE = 156;
+
+    uint256 hash;
+    int32_t nPrev;
+    int32_t nSkip;
+    int32_t nHeight;
+    int32_t nFile;
+    uint32_t nDataPos;
+    uint32_t nUndoPos;
+    uint256 nChainWork;
+    uint32_t nTx;
+    uint32_t nChainTx;
+    uint32_t nStatus;
+    int32_t nVersion;
+    uint256 hashMerkleRoot;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nNonce;
+    int32_t nSequenceId;
+    uint32_t nTimeMax;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hash);
+        READWRITE(nPrev);
+        READWRITE(nSkip);
+        READWRITE(nHeight);
+        READWRITE(nFile);
+        READWRITE(nDataPos);
+        READWRITE(nUndoPos);
+        READWRITE(nChainWork);
+        READWRITE(nTx);
+        READWRITE(nChainTx);
+        READWRITE(nStatus);
+        READWRITE(nVersion);
+        READWRITE(hashMerkleRoot);
+        READWRITE(nTime);
+        READWRITE(nBits);
+        READWRITE(nNonce);
+        READWRITE(nSequenceId);
+        READWRITE(nTimeMax);
+    }
+};
+
+/** Compute the fingerprint of the current block tree database. */
+bool GetIndexSnapshotFingerprint(CBlockTreeDB& blocktree, CIndexSnapshotFingerprint& fingerprint);
+
+/**
+ * Write every entry of mapBlockIndex, with its computed fields (nChainWork, nTimeMax,
+ * nChainTx, pskip), to path. Records are written in height order. The file is written
+ * next to path and renamed into place, so a crash never leaves a truncated snapshot.
+ */
+bool WriteIndexSnapshot(const std::string& path, const CBlockIndexMap& mapBlockIndex, const CIndexSnapshotFingerprint& fingerprint);
+
+/**
+ * Load a snapshot into the (empty) mapBlockIndex if it exists, has the current version and
+ * matches fingerprint. vSortedByHeight receives the loaded entries in height order.
+ */
+bool LoadIndexSnapshot(const std::string& path, const CIndexSnapshotFingerprint& fingerprint, CBlockIndexMap& mapBlockIndex, std::vector<CBlockIndex*>& vSortedByHeight);
+
+#endif
@@ -0,0 +1,327 @@
+#include "logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace BCLog
+{
+std::atomic<uint32_t> g_categories{0};
+
+struct Logger::Ring
+{
+    //! bytes written by the owning thread; [nTail, nHead) holds records not yet written out
+    alignas(64) std::atomic<uint64_t> nHead{0};
+    //! bytes taken by the writer
+    alignas(64) std::atomic<uint64_t> nTail{0};
+    //! set when the owning thread exits; the ring is dropped once it is empty
+    std::atomic<bool> fOrphaned{false};
+    char vData[RING_SIZE];
+};
+
+namespace
+{
+//! every record starts with its sequence number and length
+const size_t RECORD_HEADER_SIZE = 12;
+//! the writer sleeps at most this long between passes
+const std::chrono::milliseconds WRITER_INTERVAL{10};
+
+const struct
+{
+    LogFlags flag;
+    const char* name;
+} LOG_CATEGORIES[] = {
+    {INDEX, "index"},
+    {LEVELDB, "leveldb"},
+    {IO, "io"},
+    {BENCH, "bench"},
+    {VALIDATION, "validation"},
+    {MEMORY, "memory"},
+    {ALL, "all"},
+};
+
+const char* GetCategoryName(LogFlags category)
+{
+    for (const auto& entry : LOG_CATEGORIES)
+        if (entry.flag == category)
+            return entry.name;
+    return "?";
+}
+
+/** Holds the calling thread's ring and marks it orphaned when the thread exits. */
+struct CLocalRing
+{
+    std::shared_ptr<Logger::Ring> ring;
+    ~CLocalRing()
+    {
+        if (ring)
+            ring->fOrphaned = true;
+    }
+};
+thread_local CLocalRing t_ring;
+
+// 环形缓冲区的位置只增不减, 取模后可能跨过末尾, 分两段复制
+void CopyIn(Logger::Ring& ring, uint64_t nPos, const void* src, size_t n)
+{
+    const size_t nOffset = nPos & (RING_SIZE - 1);
+    const size_t nFirst = std::min(n, RING_SIZE - nOffset);
+    memcpy(ring.vData + nOffset, src, nFirst);
+    memcpy(ring.vData, (const char*)src + nFirst, n - nFirst);
+}
+
+void CopyOut(const Logger::Ring& ring, uint64_t nPos, void* dst, size_t n)
+{
+    const size_t nOffset = nPos & (RING_SIZE - 1);
+    const size_t nFirst = std::min(n, RING_SIZE - nOffset);
+    memcpy(dst, ring.vData + nOffset, nFirst);
+    memcpy((char*)dst + nFirst, ring.vData, n - nFirst);
+}
+} // namespace
+
+Logger::Ring& Logger::LocalRing()
+{
+    if (!t_ring.ring)
+    {
+        std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rings.push_back(ring);
+        if (!m_running)
+        {
+            m_running = true;
+            m_writer = std::thread(&Logger::WriterThread, this);
+        }
+        t_ring.ring = std::move(ring);
+    }
+    return *t_ring.ring;
+}
+
+std::ostringstream& Logger::LocalStream()
+{
+    thread_local std::ostringstream stream;
+    return stream;
+}
+
+void Logger::Wake()
+{
+    // hzx 不加锁, 写线程若恰好在检查 m_wake 之后、睡眠之前错过通知, 最多在 WRITER_INTERVAL 后醒来
+    m_wake.store(true, std::memory_order_release);
+    m_cond_wake.notify_one();
+}
+
+void Logger::LogPrintStr(LogFlags category, Level level, const std::string& str)
+{
+    std::string prefix;
+    if (level == Level::Debug)
+        prefix = std::string("[") + GetCategoryName(category) + "] ";
+    else if (level == Level::Warning)
+        prefix = "[warning] ";
+    else if (level == Level::Error)
+        prefix = "[error] ";
+
+    const size_t nRecord = RECORD_HEADER_SIZE + prefix.size() + str.size();
+    if (m_shutdown.load(std::memory_order_acquire) || nRecord > RING_SIZE / 2)
+    {
+        // 退出之后, 或者消息太大放不进环形缓冲区
+        WriteDirect(prefix, str);
+        return;
+    }
+
+    Ring& ring = LocalRing();
+    const uint64_t nSeq = m_seq.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t nHead = ring.nHead.load(std::memory_order_relaxed);
+    uint64_t nTail = ring.nTail.load(std::memory_order_acquire);
+    // hzx 缓冲区满时等待写线程取走, 不丢弃消息; 等待期间开始退出时写线程不会再来, 改为直接写
+    while (RING_SIZE - (nHead - nTail) < nRecord)
+    {
+        if (m_shutdown.load(std::memory_order_acquire))
+        {
+            WriteDirect(prefix, str);
+            return;
+        }
+        Wake();
+        std::this_thread::yield();
+        nTail = ring.nTail.load(std::memory_order_acquire);
+    }
+    const uint32_t nLen = prefix.size() + str.size();
+    char header[RECORD_HEADER_SIZE];
+    memcpy(header, &nSeq, 8);
+    memcpy(header + 8, &nLen, 4);
+    CopyIn(ring, nHead, header, RECORD_HEADER_SIZE);
+    CopyIn(ring, nHead + RECORD_HEADER_SIZE, prefix.data(), prefix.size());
+    CopyIn(ring, nHead + RECORD_HEADER_SIZE + prefix.size(), str.data(), str.size());
+    ring.nHead.store(nHead + nRecord, std::memory_order_release);
+    // 只在越过半满时唤醒一次, 避免每条消息都进入内核
+    const bool fHalfFull = nHead - nTail <= RING_SIZE / 2 && nHead + nRecord - nTail > RING_SIZE / 2;
+    if (level >= Level::Warning || fHalfFull)
+        Wake();
+}
+
+void Logger::WriteDirect(const std::string& prefix, const std::string& str)
+{
+    // 先写出已排队的消息再直接写, 保持顺序
+    Flush();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running && t_ring.ring)
+    {
+        // 写线程已经退出: 本线程缓冲区中剩下的消息由本线程写出
+        Ring& ring = *t_ring.ring;
+        uint64_t nTail = ring.nTail.load(std::memory_order_acquire);
+        const uint64_t nHead = ring.nHead.load(std::memory_order_relaxed);
+        std::string text;
+        while (nTail < nHead)
+        {
+            char header[RECORD_HEADER_SIZE];
+            CopyOut(ring, nTail, header, RECORD_HEADER_SIZE);
+            uint32_t nLen;
+            memcpy(&nLen, header + 8, 4);
+            text.resize(nLen);
+            CopyOut(ring, nTail + RECORD_HEADER_SIZE, &text[0], nLen);
+            fwrite(text.data(), 1, text.size(), m_file);
+            nTail += RECORD_HEADER_SIZE + nLen;
+        }
+        ring.nTail.store(nTail, std::memory_order_release);
+    }
+    fwrite(prefix.data(), 1, prefix.size(), m_file);
+    fwrite(str.data(), 1, str.size(), m_file);
+    fflush(m_file);
+}
+
+void Logger::WriterThread()
+{
+    //! where a record of this pass lives in stage
+    struct Record
+    {
+        uint64_t nSeq;
+        size_t nPos;
+        uint32_t nLen;
+    };
+    std::vector<Record> vRecords;
+    std::string stage, out;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        const bool fStop = m_stop;
+        m_wake.store(false, std::memory_order_relaxed);
+        const std::vector<std::shared_ptr<Ring>> vRings = m_rings;
+        lock.unlock();
+
+        for (const std::shared_ptr<Ring>& ring : vRings)
+        {
+            uint64_t nTail = ring->nTail.load(std::memory_order_relaxed);
+            const uint64_t nHead = ring->nHead.load(std::memory_order_acquire);
+            while (nTail < nHead)
+            {
+                char header[RECORD_HEADER_SIZE];
+                CopyOut(*ring, nTail, header, RECORD_HEADER_SIZE);
+                Record record;
+                memcpy(&record.nSeq, header, 8);
+                memcpy(&record.nLen, header + 8, 4);
+                record.nPos = stage.size();
+                stage.resize(stage.size() + record.nLen);
+                CopyOut(*ring, nTail + RECORD_HEADER_SIZE, &stage[record.nPos], record.nLen);
+                vRecords.push_back(record);
+                nTail += RECORD_HEADER_SIZE + record.nLen;
+            }
+            ring->nTail.store(nTail, std::memory_order_release);
+        }
+        // 各线程的消息按序号合并, 一次写出
+        std::sort(vRecords.begin(), vRecords.end(), [](const Record& a, const Record& b) { return a.nSeq < b.nSeq; });
+        for (const Record& record : vRecords)
+            out.append(stage, record.nPos, record.nLen);
+        if (!out.empty())
+        {
+            fwrite(out.data(), 1, out.size(), m_file);
+            fflush(m_file);
+        }
+        const bool fIdle = vRecords.empty();
+        vRecords.clear();
+        stage.clear();
+        out.clear();
+
+        lock.lock();
+        // 线程退出后不会再写入, 置位 fOrphaned 之后仍为空的缓冲区可以丢弃
+        m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<Ring>& ring) {
+                          return ring->fOrphaned && ring->nTail.load() == ring->nHead.load();
+                      }),
+                      m_rings.end());
+        m_passes++;
+        m_cond_pass.notify_all();
+        if (fStop)
+            break;
+        if (fIdle)
+            m_cond_wake.wait_for(lock, WRITER_INTERVAL, [&] { return m_stop || m_wake.load(std::memory_order_acquire); });
+    }
+    m_running = false;
+    m_cond_pass.notify_all();
+}
+
+void Logger::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_running)
+    {
+        // 调用时正在进行的一轮可能已经错过本线程最后的消息, 等到下一轮结束
+        const uint64_t nTarget = m_passes + 2;
+        m_wake.store(true, std::memory_order_relaxed);
+        m_cond_wake.notify_one();
+        m_cond_pass.wait(lock, [&] { return m_passes >= nTarget || !m_running; });
+    }
+    fflush(m_file);
+}
+
+void Logger::Shutdown()
+{
+    m_shutdown.store(true, std::memory_order_release);
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        writer = std::move(m_writer);
+    }
+    m_cond_wake.notify_one();
+    if (writer.joinable())
+        writer.join();
+}
+
+Logger& LogInstance()
+{
+    // hzx 有意不释放: 退出时其它静态对象的析构函数仍可能写日志
+    static Logger* g_logger = [] {
+        Logger* logger = new Logger();
+        std::atexit([] { LogInstance().Shutdown(); });
+        return logger;
+    }();
+    return *g_logger;
+}
+
+bool GetLogCategory(const std::string& name, LogFlags& flag)
+{
+    for (const auto& entry : LOG_CATEGORIES)
+    {
+        if (name == entry.name)
+        {
+            flag = entry.flag;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EnableCategories(const std::string& names)
+{
+    size_t nBegin = 0;
+    while (nBegin <= names.size())
+    {
+        size_t nEnd = names.find(',', nBegin);
+        if (nEnd == std::string::npos)
+            nEnd = names.size();
+        LogFlags flag;
+        if (!GetLogCategory(names.substr(nBegin, nEnd - nBegin), flag))
+            return false;
+        g_categories.fetch_or(flag, std::memory_order_relaxed);
+        nBegin = nEnd + 1;
+    }
+    return true;
+}
+} // namespace BCLog
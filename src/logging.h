@@ -0,0 +1,154 @@
+#ifndef BLOCKCHAIN_LOGGING_H
+#define BLOCKCHAIN_LOGGING_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tinyformat.h"
+
+//! LogDebug calls are compiled out entirely (arguments are still type checked) when this is 0
+#ifndef LOG_DEBUG_COMPILED
+#define LOG_DEBUG_COMPILED 1
+#endif
+
+namespace BCLog
+{
+enum LogFlags : uint32_t
+{
+    NONE = 0,
+    //! block index loading, linking and snapshots
+    INDEX = (1 << 0),
+    LEVELDB = (1 << 1),
+    //! block and undo file reads, raw block dumps
+    IO = (1 << 2),
+    //! per stage timings
+    BENCH = (1 << 3),
+    //! proof of work and other per block checks
+    VALIDATION = (1 << 4),
+    //! memory reports after loading and after each scan
+    MEMORY = (1 << 5),
+    ALL = ~(uint32_t)0,
+};
+
+enum class Level
+{
+    Debug = 0,
+    Info,
+    Warning,
+    Error,
+};
+
+//! Bytes of the ring buffer each logging thread owns
+static const size_t RING_SIZE = 1 << 16;
+
+//! Categories whose debug logs are written; read on every LogDebug, so kept outside the Logger
+extern std::atomic<uint32_t> g_categories;
+
+/**
+ * Asynchronous log writer. Every thread that logs gets its own single-producer ring buffer
+ * of RING_SIZE bytes, so logging takes no lock and never waits for the terminal: a message
+ * is formatted, copied into the ring and the thread moves on. A background thread drains
+ * all rings, orders the messages of one pass by a global sequence number and writes them
+ * with a single fwrite. A thread whose ring is full waits for the writer instead of losing
+ * the message, unless the writer is shutting down; a message too large for a ring, or logged
+ * after Shutdown(), is written directly after a Flush. Pending messages are written at exit.
+ */
+class Logger
+{
+public:
+    //! one thread's ring buffer, defined in logging.cpp
+    struct Ring;
+
+private:
+    FILE* m_file = stdout;
+    std::atomic<uint64_t> m_seq{0};
+    std::atomic<bool> m_shutdown{false};
+
+    std::mutex m_mutex;
+    //! wakes the writer early (a flush, a warning or a ring filling up)
+    std::condition_variable m_cond_wake;
+    std::condition_variable m_cond_pass;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    std::thread m_writer;
+    bool m_running = false;
+    bool m_stop = false;
+    //! set by Wake(); the writer starts another pass instead of sleeping
+    std::atomic<bool> m_wake{false};
+    //! completed writer passes
+    uint64_t m_passes = 0;
+
+    Ring& LocalRing();
+    //! the calling thread's stream, reused so formatting does not construct one every time
+    static std::ostringstream& LocalStream();
+    void Wake();
+    void WriterThread();
+    //! write one message synchronously, after every message queued before it
+    void WriteDirect(const std::string& prefix, const std::string& str);
+
+public:
+    /** Queue one line. */
+    void LogPrintStr(LogFlags category, Level level, const std::string& str);
+
+    /** Format and queue one line. */
+    template <typename... Args>
+    void LogPrintf(LogFlags category, Level level, const char* fmt, const Args&... args)
+    {
+        std::ostringstream& stream = LocalStream();
+        stream.str(std::string());
+        tfm::format(stream, fmt, args...);
+        LogPrintStr(category, level, stream.str());
+    }
+
+    /** Wait until every message logged before the call has been written. */
+    void Flush();
+
+    /** Flush and stop the writer thread; later messages are written synchronously. */
+    void Shutdown();
+};
+
+Logger& LogInstance();
+
+/** Parse a category name ("index", "leveldb", "io", "bench", "validation", "all"); false if unknown. */
+bool GetLogCategory(const std::string& name, LogFlags& flag);
+
+/** Enable debug logs of the comma separated categories in names; false if one is unknown. */
+bool EnableCategories(const std::string& names);
+} // namespace BCLog
+
+/** Whether a log of this category and level is written; for a disabled debug log this is one load and one branch. */
+static inline bool LogAcceptCategory(BCLog::LogFlags category, BCLog::Level level)
+{
+    if (level >= BCLog::Level::Info)
+        return true;
+    return __builtin_expect((BCLog::g_categories.load(std::memory_order_relaxed) & category) != 0, 0);
+}
+
+#define LogPrintLevel_(category, level, ...)                                                       \
+    do                                                                                             \
+    {                                                                                              \
+        if (LogAcceptCategory((category), (level)))                                                \
+            BCLog::LogInstance().LogPrintf((category), (level), __VA_ARGS__);                      \
+    } while (0)
+
+#define LogInfo(...) LogPrintLevel_(BCLog::NONE, BCLog::Level::Info, __VA_ARGS__)
+#define LogWarning(...) LogPrintLevel_(BCLog::NONE, BCLog::Level::Warning, __VA_ARGS__)
+#define LogError(...) LogPrintLevel_(BCLog::NONE, BCLog::Level::Error, __VA_ARGS__)
+
+#if LOG_DEBUG_COMPILED
+#define LogDebug(category, ...) LogPrintLevel_(category, BCLog::Level::Debug, __VA_ARGS__)
+#else
+#define LogDebug(category, ...)         \
+    do                                  \
+    {                                   \
+        if (false)                      \
+            tfm::format(__VA_ARGS__);   \
+    } while (0)
+#endif
+
+#endif
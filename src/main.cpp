@@ -1,6 +1,11 @@
 #include <cstdio>
+#include <sys/stat.h>
 #include <string>
 #include "chainparams.h"
+#include "chainparamsbase.h"
+#include "logging.h"
+#include "metrics.h"
+#include "trace.h"
 #include "time.h"
 #include <algorithm>
 #include <atomic>
@@ -12,20 +17,29 @@
 #include "shutdown.h"
 #include "pow.h"
 #include <fstream>
+#include <random>
 #include "serialize.h"
-#include "blkFile.h"
+#include "blockIndexMap.h"
+#include "memAccount.h"
+#include "memusage.h"
+#include "core_memusage.h"
+#include "blockIndexLink.h"
+#include "blockMan.h"
+#include "indexSnapshot.h"
+#include "blockScan.h"
+#include "blockPipeline.h"
+#include "reindex.h"
+#include "scheduler.h"
+#include "archive.h"
+#include "blockVerify.h"
+#include "sha256.h"
+#include "protocol.h"
+#include "strencodings.h"
 
 std::string data_dir = ""; // 数据路径
 static const long long nDefaultDbCache = 450L;
 std::unique_ptr<CBlockTreeDB> pblocktree;
-
-struct BlockHasher
-{
-    // this used to call `GetCheapHash()` in uint256, which was later moved; the
-    // cheap hash function simply calls ReadLE64() however, so the end result is
-    // identical
-    size_t operator()(const uint256 &hash) const { return ReadLE64(hash.begin()); }
-};
+std::unique_ptr<BlockManager> pblockman; // blk/rev 文件与文件信息管理
 
 struct CBlockIndexWorkComparator
 {
@@ -55,23 +69,23 @@ struct CBlockIndexWorkComparator
     }
 };
 
-typedef std::unordered_map<uint256, CBlockIndex *, BlockHasher> BlockMap;
-BlockMap m_block_index; // 区块树结构
+typedef CBlockIndexMap BlockMap;
+BlockMap m_block_index; // 区块树结构, CBlockIndex 对象分配在 m_block_index 自带的 arena 中
 /**
      * All pairs A->B, where A (or one of its ancestors) misses transactions, but B has transactions.
      * Pruned nodes may have entries where B is missing data.
      */
-std::multimap<CBlockIndex *, CBlockIndex *> m_blocks_unlinked;
+std::multimap<CBlockIndex *, CBlockIndex *, std::less<CBlockIndex *>, CTrackingAllocator<std::pair<CBlockIndex *const, CBlockIndex *>, MemoryTag::BLOCK_INDEX_SETS>> m_blocks_unlinked;
 
 /** Dirty block index entries. */
-std::set<CBlockIndex *> setDirtyBlockIndex;
+std::set<CBlockIndex *, std::less<CBlockIndex *>, CTrackingAllocator<CBlockIndex *, MemoryTag::BLOCK_INDEX_SETS>> setDirtyBlockIndex;
 
 /**
      * The set of all CBlockIndex entries with BLOCK_VALID_TRANSACTIONS (for itself and all ancestors) and
      * as good as our current tip or better. Entries may be failed, though, and pruning nodes may be
      * missing the data for the block.
      */
-std::set<CBlockIndex *, CBlockIndexWorkComparator> setBlockIndexCandidates;
+std::set<CBlockIndex *, CBlockIndexWorkComparator, CTrackingAllocator<CBlockIndex *, MemoryTag::BLOCK_INDEX_SETS>> setBlockIndexCandidates;
 
 // hzx pindex BestInvalid 记录块号最大的非法块
 CBlockIndex *pindexBestInvalid = nullptr;
@@ -79,9 +93,15 @@ CBlockIndex *pindexBestInvalid = nullptr;
 // 工作量最大,最早接收到的区块
 CBlockIndex *pindexBestHeader = nullptr;
 
+// hzx 由 setBlockIndexCandidates 中工作量最大的区块回溯得到的主链
+CChain chainActive;
+
 void AppInit(const string &network)
 {
     SelectParams(network);
+    // hzx 按CPU选择 SHA256 实现(SHA-NI/AVX2/SSE4), 选择后会自检
+    const std::string sha256_algo = SHA256AutoDetect();
+    LogInfo("Using the '%s' SHA256 implementation\n", sha256_algo.data());
     return;
 }
 
@@ -92,23 +112,75 @@ CBlockIndex *InsertBlockIndex(const uint256 &hash)
     if (hash.IsNull())
         return nullptr;
 
-    // Return existing
-    BlockMap::iterator mi = m_block_index.find(hash);
-    if (mi != m_block_index.end())
-        return (*mi).second;
-
-    // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
-    mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    printf("%s: 成功插入区块: %s\n", __func__, hash.ToString().data());
+    // Return existing or create new
+    bool fInserted = false;
+    CBlockIndex *pindexNew = m_block_index.Insert(hash, &fInserted);
+    if (!fInserted)
+        return pindexNew;
+    LogDebug(BCLog::INDEX, "%s: 成功插入区块: %s\n", __func__, hash.ToString().data());
     return pindexNew;
 }
 
+// hzx 根据区块的计算字段(nChainWork, nChainTx)更新候选集合、最大非法块与最优区块头
+static void UpdateBlockIndexSets(CBlockIndex *pindex)
+{
+    // 如果该区块合法,并且所有父区块到该区块的交易都已经被下载,放入candidate区块中
+    // pindex中nStatus状态字段, 对应于BlockStatus字段,根据字段选择
+    // 第一次时,只有创世块会被放入block_index_candidates 中,因为创世块的pprev为nullptr
+    if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->HaveTxsDownloaded() || pindex->pprev == nullptr))
+    {
+        setBlockIndexCandidates.insert(pindex);
+    }
+    //
+    if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
+        pindexBestInvalid = pindex;
+    // 记录目前为止最长的合法的blockHeader的CBlockIndex索引
+    if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        pindexBestHeader = pindex;
+}
+
+static void PrintLoadedBlockIndex(std::chrono::milliseconds load_block_index_start_time)
+{
+    for (const CBlockIndex *e : setBlockIndexCandidates)
+        LogDebug(BCLog::INDEX, "%s\n", (e->ToString()).data());
+    LogInfo("%s: 载入 %lu 个区块索引, 耗时 %ld ms\n", __func__, (unsigned long)m_block_index.size(),
+           (long)(GetTimeMillis() - load_block_index_start_time).count());
+}
+
+// hzx 内存报告(-debug=memory): 区块索引相关的全局结构, leveldb 与映射文件的估算值, 以及各子系统分配器记账的当前值与峰值
+// pvBlocks 非空时加上这些反序列化区块的估算值
+static void LogMemoryReport(const char *stage, const std::vector<CBlock> *pvBlocks = nullptr)
+{
+    if (!LogAcceptCategory(BCLog::MEMORY, BCLog::Level::Debug))
+        return;
+    CMemoryReport report;
+    const size_t nArena = m_block_index.GetArena().MemoryUsage();
+    report.Add("CBlockIndex", m_block_index.size(), nArena);
+    report.Add("m_block_index", m_block_index.size(), m_block_index.MemoryUsage() - nArena);
+    report.Add("setBlockIndexCandidates", setBlockIndexCandidates.size(), memusage::DynamicUsage(setBlockIndexCandidates));
+    report.Add("m_blocks_unlinked", m_blocks_unlinked.size(), memusage::DynamicUsage(m_blocks_unlinked));
+    report.Add("setDirtyBlockIndex", setDirtyBlockIndex.size(), memusage::DynamicUsage(setDirtyBlockIndex));
+    report.Add("chainActive", chainActive.Height() + 1, memusage::MallocUsage((chainActive.Height() + 1) * sizeof(CBlockIndex *)));
+    if (pblocktree)
+        report.Add("leveldb", 0, pblocktree->DynamicMemoryUsage());
+    if (pblockman)
+        report.Add("blk/rev mmap", 0, pblockman->MappedBytes());
+    if (pvBlocks)
+    {
+        size_t nBytes = memusage::DynamicUsage(*pvBlocks);
+        for (const CBlock &block : *pvBlocks)
+            nBytes += RecursiveDynamicUsage(block);
+        report.Add("CBlock", pvBlocks->size(), nBytes);
+    }
+    LogDebug(BCLog::MEMORY, "%s 内存:\n%s", stage, report.ToString().data());
+}
+
 // 载入区块索引
-bool loadBlock(const string &index_path)
+// snapshot_path 非空时, 优先从该快照载入已计算好的索引, 快照不存在或已过期时重新计算并写入快照
+bool loadBlock(const string &index_path, const string &snapshot_path)
 {
-    printf("%s: Loading block index...\n", __func__);
+    LogInfo("%s: Loading block index...\n", __func__);
+    TRACE_SPAN("loadBlock");
     std::chrono::milliseconds load_block_index_start_time = GetTimeMillis();
     unsigned long nTotalCache = nDefaultDbCache << 20;
     unsigned long nBlockTreeDBCache = std::min(nTotalCache / 8, 2UL << 20);
@@ -116,182 +188,349 @@ bool loadBlock(const string &index_path)
     // 打开leveldb 数据库
     pblocktree.reset(new CBlockTreeDB(index_path, nBlockTreeDBCache, false, false));
     const CChainParams &chainparams = Params();
-    pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex);
-    // 对m_block中所有的区块按照高度排序
-    std::vector<std::pair<int, CBlockIndex *>> vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
-    for (const std::pair<const uint256, CBlockIndex *> &item : m_block_index)
+    bool fReindexing = false;
+    pblocktree->ReadReindexing(fReindexing);
+    if (fReindexing)
     {
-        CBlockIndex *pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        LogError("%s: 上次重建索引没有完成, 请使用 -reindex 重新建立\n", __func__);
+        return false;
+    }
+
+    CIndexSnapshotFingerprint fingerprint;
+    const bool fHaveFingerprint = !snapshot_path.empty() && GetIndexSnapshotFingerprint(*pblocktree, fingerprint);
+    std::vector<CBlockIndex *> vSnapshot;
+    if (fHaveFingerprint && LoadIndexSnapshot(snapshot_path, fingerprint, m_block_index, vSnapshot))
+    {
+        // 快照中已包含 nChainWork, nTimeMax, nChainTx 与 pskip, 只需重建内存中的集合
+        for (CBlockIndex *pindex : vSnapshot)
+        {
+            if (pindex->nTx > 0 && pindex->pprev && !pindex->pprev->HaveTxsDownloaded())
+                m_blocks_unlinked.insert(std::make_pair(pindex->pprev, pindex));
+            UpdateBlockIndexSets(pindex);
+        }
+        PrintLoadedBlockIndex(load_block_index_start_time);
+        return true;
     }
 
-    // hzx 根据高度排序,从0~当前块
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<const uint256, CBlockIndex *> &item : m_block_index)
+    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex))
     {
-        CBlockIndex *pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        LogError("%s: 读取区块索引数据库 %s 失败\n", __func__, index_path.data());
+        return false;
     }
-    // hzx 根据高度排序,从0~当前块
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    printf("%s 成功载入 %lu 个区块: \n", __func__, vSortedByHeight.size());
-    for (const std::pair<int, CBlockIndex *> &item : vSortedByHeight)
+    const std::chrono::milliseconds guts_time = GetTimeMillis();
+    // 对m_block中所有的区块按照高度排序(计数排序), 从0~当前块
+    std::vector<CBlockIndex *> vSortedByHeight;
+    SortBlockIndexByHeight(m_block_index, vSortedByHeight);
+    const std::chrono::milliseconds sort_time = GetTimeMillis();
+    LogInfo("%s 成功载入 %lu 个区块: \n", __func__, vSortedByHeight.size());
+    // hzx 并行计算工作量, nTimeMax, nChainTx 与 pskip
+    // 如果前一个区块存在,求解Skipi,
+    // 96->64, 95->89,
+    // 580000->579968, 10001->99841, 10000->99968
+    LinkBlockIndex(MakeSpan(vSortedByHeight));
+    LogDebug(BCLog::BENCH, "%s: LoadBlockIndexGuts %ld ms, 排序 %ld ms, 链接 %ld ms\n", __func__, (long)(guts_time - load_block_index_start_time).count(),
+             (long)(sort_time - guts_time).count(), (long)(GetTimeMillis() - sort_time).count());
+    TRACE_SPAN("UpdateBlockIndexSets");
+    for (CBlockIndex *pindex : vSortedByHeight)
     {
         if (ShutdownRequested())
             return false;
-        CBlockIndex *pindex = item.second;
-        // 计算工作量
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
-        // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0)
-        {
-            if (pindex->pprev)
-            {
-                if (pindex->pprev->HaveTxsDownloaded())
-                {
-                    pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
-                }
-                else
-                {
-                    pindex->nChainTx = 0;
-                    m_blocks_unlinked.insert(std::make_pair(pindex->pprev, pindex));
-                }
-            }
-            else
-            {
-                pindex->nChainTx = pindex->nTx;
-            }
-        }
+        if (pindex->nTx > 0 && pindex->pprev && !pindex->pprev->HaveTxsDownloaded())
+            m_blocks_unlinked.insert(std::make_pair(pindex->pprev, pindex));
         // hzx 该区块合法,但是该区块的父区块不合法,则将该区块插入脏区块集合中
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK))
         {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
-        // 如果该区块合法,并且所有父区块到该区块的交易都已经被下载,放入candidate区块中
-        // pindex中nStatus状态字段, 对应于BlockStatus字段,根据字段选择
-        // 第一次时,只有创世块会被放入block_index_candidates 中,因为创世块的pprev为nullptr
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->HaveTxsDownloaded() || pindex->pprev == nullptr))
-        {
-            setBlockIndexCandidates.insert(pindex);
-        }
-        //
-        if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
-            pindexBestInvalid = pindex;
-        // 如果前一个区块存在,求解Skipi,
-        // 96->64, 95->89,
-        // 580000->579968, 10001->99841, 10000->99968
-        if (pindex->pprev)
-            pindex->BuildSkip();
-        // 记录目前为止最长的合法的blockHeader的CBlockIndex索引
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
-            pindexBestHeader = pindex;
+        UpdateBlockIndexSets(pindex);
     }
-    for (const CBlockIndex *e : setBlockIndexCandidates)
-        printf("%s\n", (e->ToString()).data());
+    // hzx 保存计算结果, 下次启动时索引数据库没有变化则直接载入快照
+    if (fHaveFingerprint)
+        WriteIndexSnapshot(snapshot_path, m_block_index, fingerprint);
+    PrintLoadedBlockIndex(load_block_index_start_time);
     return true;
 }
 
-// 从本地磁盘读取区块
-bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const string &path, const CBlockIndex *blkIndex, const Consensus::Params &consensusParams)
+// 由归档目录的 archive.idx 载入区块索引, 不需要 leveldb 与 LoadBlockIndexGuts
+bool loadArchive(const string &archive_path)
 {
-    string file_num = std::to_string(blkIndex->nFile);
-    while (file_num.size() < 5)
-        file_num.insert(file_num.begin(), '0');
-    string file_dir = path + "/blk" + file_num + ".dat";
-    fstream fs(file_dir, std::ios::binary | std::ios::in);
-    unsigned int blk_size = 0;
-    char blk_start[4] = {'\0'};
-    if (!fs.is_open())
-    {
-        printf("%s 打开失败!\n", file_num.data());
+    std::chrono::milliseconds load_block_index_start_time = GetTimeMillis();
+    std::vector<CBlockIndex *> vSortedByHeight;
+    if (!LoadArchiveIndex(archive_path, Params(), m_block_index, vSortedByHeight))
         return false;
-    }
-    try
-    {
-        fs.seekp(blkIndex->nDataPos - 8);
-        fs.read(blk_start, sizeof(blk_start));
-        if (memcmp(blk_start, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-        {
-            printf("%s: 区块起始为止不匹配, 文件: %d, 偏移位置:%d, %s versus expected %s", __func__, blkIndex->nFile, blkIndex->nDataPos,
-                   HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE).data(),
-                   HexStr(Params().MessageStart(), Params().MessageStart() + CMessageHeader::MESSAGE_START_SIZE).data());
-            return false;
-        }
+    for (CBlockIndex *pindex : vSortedByHeight)
+        UpdateBlockIndexSets(pindex);
+    PrintLoadedBlockIndex(load_block_index_start_time);
+    return true;
+}
 
-        fs.read(reinterpret_cast<char *>(&blk_size), sizeof(blk_size));
-        if (blk_size > MAX_SIZE)
-        {
-            printf("%s : 区块大小超过范围, 文件位置: %d, 偏移位置: %d \n", __func__, blkIndex->nFile, blkIndex->nDataPos);
-            throw std::runtime_error("");
-        }
-        block.resize(blk_size);
-        fs.read(reinterpret_cast<char *>(block.data()), blk_size);
-    }
-    catch (const std::exception &e)
-    {
-        printf("%s : 读取原始区块数据出错: %s, 文件:%d, 位置: %d\n", __func__, e.what(), blkIndex->nFile, blkIndex->nDataPos);
-        fs.close();
+// 从本地磁盘读取区块, 并以十六进制打印(含 magic 与区块大小)
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const CBlockIndex *blkIndex, const Consensus::Params &consensusParams)
+{
+    if (!pblockman->ReadRawBlockFromDisk(block, blkIndex))
         return false;
-    }
-    if (fs.is_open())
-        fs.close();
+    unsigned int blk_size = block.size();
     std::string header = HexStr(Params().MessageStart(), Params().MessageStart() + CMessageHeader::MESSAGE_START_SIZE);
     char *s = reinterpret_cast<char *>(&blk_size);
     std::string sz = HexStr(s, s + 4);
     std::string data = HexStr(block);
     std::string blk = header + sz + data;
-    printf("%s\n", blk.data());
+    LogDebug(BCLog::IO, "%s\n", blk.data());
     return true;
 }
 
-// 从本地磁盘读取区块
-bool ReadBlockFromDisk(CBlock &block, const string &path, const CBlockIndex *blkIndex, const Consensus::Params &consensusParams)
+// 从本地磁盘读取区块, 并打印区块内容
+bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *blkIndex, const Consensus::Params &consensusParams)
 {
-    string file_num = std::to_string(blkIndex->nFile);
-    while (file_num.size() < 5)
-        file_num.insert(file_num.begin(), '0');
-    string file_dir = path + "/blk" + file_num + ".dat";
-    CAutoFile filein(file_dir, SER_DISK, CLIENT_VERSION, blkIndex->nDataPos);
-    if (filein.IsNull()){
-        printf("%s: 文件打开失败 %s \n", __func__, file_dir.data());
-        return false;
-    }
-    // Read block
-    try{
-        filein >> block;
-    }
-    catch (const std::exception &e){
-        printf("%s: Deserialize or I/O error - %s at %u", __func__, e.what(), blkIndex->nDataPos);
-        return false;
-    }
-    // Check the header
-    printf("%s \n", block.ToString().data());
-    if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams)){
-        printf("%s 读取区块出错.\n", __func__);
+    if (!pblockman->ReadBlockFromDisk(block, blkIndex, consensusParams))
+    {
+        LogError("%s 读取区块出错.\n", __func__);
         return false;
     }
-
+    LogDebug(BCLog::IO, "%s \n", block.ToString().data());
     return true;
 }
 
-int main()
+// 由 blk?????.dat 重建 index_path 处的区块索引数据库, 旧的索引与快照都会被删除
+bool Reindex(const string &blk_path, const string &index_path, const string &snapshot_path)
 {
-    AppInit("main");
-    const string root_path = "/home/hzx/Documents/github/cpp/blockchain/Bitcoin";
+    remove(snapshot_path.c_str());
+    CBlockTreeDB blocktree(index_path, std::min((unsigned long)(nDefaultDbCache << 20) / 8, 2UL << 20), false, true);
+    return ReindexBlockFiles(Params(), blk_path, blocktree);
+}
+
+// 参数: -chain=<main|regtest> (默认 main), -datadir=<目录> (例如 generate.out 生成的目录, 索引位于 blocks/index)
+// 不指定 -datadir 时使用本机的比特币数据目录
+// -reindex: 由区块文件重建索引; 索引目录不存在而区块文件存在时也会自动重建
+// -verify: 多线程校验主链上每个区块(默克尔根, 见证承诺, undo 校验和), 输出失败区块的 (文件, 偏移位置, 高度) 后退出
+// -scan: 并行扫描全链, 统计区块数与交易数
+// -undostats: 读取 undo 数据(rev 文件), 统计全链输入数, 输入金额与手续费
+// -pipeline: 用三段预读流水线按高度顺序读取全链, 输出各阶段的等待时间与队列深度
+// -readrange: 按磁盘位置排序, 批量读取主链最后 1000 个区块
+// -readrandom: 用冻结哈希索引查找 1000 个随机区块, 一次提交给 io_uring (或 pread 线程池) 读取
+// -export=<目录>: 把主链区块按高度顺序写入归档目录(blk/rev 文件与 archive.idx)后退出
+// -archive=<目录>: 只读取归档目录, 不打开索引数据库
+// -metrics=<文件>: 每秒把指标以 Prometheus 文本格式写入文件; -metricsport=<端口>: 在 127.0.0.1 上提供 GET /metrics
+// -trace=<文件>: 把载入与扫描各阶段的耗时区间写成 Chrome trace-event JSON, 可在 Perfetto 中查看
+// -par=<n>: 任务调度器的线程数(含等待任务的线程, 默认每个核一个); -pincores: 把调度器的工作线程绑定到各个核
+int main(int argc, char *argv[])
+{
+    string chain = CBaseChainParams::MAIN;
+    string root_path = "/home/hzx/Documents/github/cpp/blockchain/Bitcoin";
+    string index_name = "index_hzxpc";
+    string export_path, archive_path, trace_path;
+    bool fReindex = false, fVerify = false, fScan = false, fUndoStats = false, fPipeline = false, fReadRange = false, fReadRandom = false;
+    MetricsExportOptions metrics_options;
+    SchedulerOptions scheduler_options;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        if (arg.compare(0, 7, "-chain=") == 0)
+            chain = arg.substr(7);
+        else if (arg.compare(0, 9, "-datadir=") == 0)
+        {
+            root_path = arg.substr(9);
+            index_name = "index";
+        }
+        else if (arg == "-reindex")
+            fReindex = true;
+        else if (arg == "-verify")
+            fVerify = true;
+        else if (arg == "-scan")
+            fScan = true;
+        else if (arg == "-undostats")
+            fUndoStats = true;
+        else if (arg == "-pipeline")
+            fPipeline = true;
+        else if (arg == "-readrange")
+            fReadRange = true;
+        else if (arg == "-readrandom")
+            fReadRandom = true;
+        else if (arg.compare(0, 8, "-export=") == 0)
+            export_path = arg.substr(8);
+        else if (arg.compare(0, 9, "-archive=") == 0)
+            archive_path = arg.substr(9);
+        else if (arg.compare(0, 7, "-debug=") == 0 && BCLog::EnableCategories(arg.substr(7)))
+            continue;
+        else if (arg.compare(0, 7, "-trace=") == 0)
+            trace_path = arg.substr(7);
+        else if (arg.compare(0, 5, "-par=") == 0 && atoi(arg.c_str() + 5) > 0)
+            scheduler_options.nThreads = atoi(arg.c_str() + 5);
+        else if (arg == "-pincores")
+            scheduler_options.fPinThreads = true;
+        else if (arg.compare(0, 9, "-metrics=") == 0)
+            metrics_options.strPath = arg.substr(9);
+        else if (arg.compare(0, 13, "-metricsport=") == 0 && atoi(arg.c_str() + 13) > 0)
+            metrics_options.nPort = atoi(arg.c_str() + 13);
+        else
+        {
+            fprintf(stderr, "usage: %s [-chain=<main|regtest>] [-datadir=<dir>] [-reindex] [-verify] [-scan] [-undostats] [-pipeline] [-readrange] [-readrandom] [-export=<dir>] [-archive=<dir>] [-debug=<index|leveldb|io|bench|validation|memory|all>[,...]] [-metrics=<file>] [-metricsport=<port>] [-trace=<file>] [-par=<n>] [-pincores]\n", argv[0]);
+            return 1;
+        }
+    }
+    AppInit(chain);
+    InitScheduler(scheduler_options);
+    if (!trace_path.empty() && !StartTrace(trace_path))
+        return 1;
+    CMetricsExporter metrics_exporter;
+    if ((!metrics_options.strPath.empty() || metrics_options.nPort) && !metrics_exporter.Start(metrics_options))
+        return 1;
     const string blk_path = root_path + "/blocks";
-    const string index_path = root_path + "/blocks/index_hzxpc";
-    loadBlock(index_path);
-    const CBlockIndex *blk_index = *(setBlockIndexCandidates.begin());
+    const string index_path = root_path + "/blocks/" + index_name;
+    const string snapshot_path = root_path + "/blocks/index_snapshot.dat";
+    if (!archive_path.empty())
+    {
+        // hzx 归档文件与区块文件格式相同, BlockManager 直接读取归档目录
+        if (!loadArchive(archive_path))
+            return 1;
+        pblockman.reset(new BlockManager(archive_path));
+    }
+    else
+    {
+        struct stat index_stat;
+        if (!fReindex && stat(index_path.c_str(), &index_stat) != 0 && stat(GetBlockFilePath(blk_path, "blk", 0).c_str(), &index_stat) == 0)
+        {
+            LogWarning("区块索引 %s 不存在, 由区块文件重建\n", index_path.data());
+            fReindex = true;
+        }
+        if (fReindex && !Reindex(blk_path, index_path, snapshot_path))
+            return 1;
+        if (!loadBlock(index_path, snapshot_path))
+            return 1;
+        pblockman.reset(new BlockManager(blk_path));
+        if (!pblockman->LoadBlockFileInfo(*pblocktree))
+        {
+            LogError("%s: 无法载入区块文件信息, 索引数据库 %s 可能已损坏, 请使用 -reindex 重建\n", __func__, index_path.data());
+            return 1;
+        }
+    }
+    if (setBlockIndexCandidates.empty())
+        return 1;
+    // hzx 工作量最大的候选区块作为主链链尾
+    chainActive.SetTip(*setBlockIndexCandidates.rbegin());
+    LogInfo("主链高度: %d, 链尾: %s\n", chainActive.Height(), chainActive.Tip()->GetBlockHash().ToString().data());
+    LogMemoryReport("载入索引后");
+
+    if (!export_path.empty())
+        return ExportArchive(*pblockman, chainActive, export_path) ? 0 : 1;
+
+    if (fVerify)
+    {
+        std::vector<BlockVerifyFailure> vFailures;
+        std::chrono::milliseconds verify_start_time = GetTimeMillis();
+        bool ok = VerifyBlocks(*pblockman, Params().GetConsensus(), chainActive, BlockVerifyOptions(), vFailures);
+        for (const BlockVerifyFailure &failure : vFailures)
+            LogError("校验失败: 文件 %d, 偏移位置 %u, 高度 %d, 区块 %s: %s\n", failure.nFile, failure.nDataPos, failure.nHeight,
+                   failure.hash.ToString().data(), failure.strReason.data());
+        LogInfo("校验%s: %d 个区块, %lu 个失败, 耗时 %ld ms\n", ok ? "完成" : "中断", chainActive.Height() + 1, (unsigned long)vFailures.size(),
+               (long)(GetTimeMillis() - verify_start_time).count());
+        return ok && vFailures.empty() ? 0 : 2;
+    }
+
+    bool ok = true;
+    std::chrono::milliseconds scan_start_time;
+    CBlockScanner scanner(*pblockman, Params().GetConsensus());
+    if (fScan)
+    {
+        std::atomic<uint64_t> nBlocks(0), nTx(0);
+        scan_start_time = GetTimeMillis();
+        ok = scanner.ScanViews(chainActive, [&](const CBlockIndex *pindex, const CBlockView &block) {
+            nBlocks++;
+            nTx += block.GetTxCount();
+            return true;
+        });
+        LogInfo("扫描%s: %lu 个区块, %lu 笔交易, 耗时 %ld ms\n", ok ? "完成" : "失败", (unsigned long)nBlocks, (unsigned long)nTx,
+               (long)(GetTimeMillis() - scan_start_time).count());
+        LogMemoryReport("扫描后");
+    }
+
+    // 三段流水线按高度顺序读取全链: I/O 线程预读, 解析线程解析, 本线程消费
+    if (fPipeline)
+    {
+        std::vector<const CBlockIndex *> vChain;
+        for (int nHeight = 0; nHeight <= chainActive.Height(); nHeight++)
+            vChain.push_back(chainActive[nHeight]);
+        uint64_t nPipelineTx = 0;
+        CBlockPipeline pipeline(*pblockman, Params().GetConsensus());
+        bool fRead = pipeline.RunViews(MakeSpan(vChain), [&](const CBlockIndex *pindex, const CBlockView &block) {
+            nPipelineTx += block.GetTxCount();
+            return true;
+        });
+        const BlockPipelineStats stats = pipeline.GetStats();
+        LogInfo("流水线读取%s: %lu 个区块, %lu 笔交易, %lu MiB, 耗时 %ld ms; 等待(ms) 读取 %ld, 解析 %ld, 消费 %ld; 队列深度 读取 %.1f/%lu, 解析 %.1f/%lu\n",
+               fRead ? "完成" : "失败", (unsigned long)stats.nBlocks, (unsigned long)nPipelineTx, (unsigned long)(stats.nBytes >> 20),
+               (long)(stats.nElapsedMicros / 1000), (long)(stats.nReadStallMicros / 1000), (long)(stats.nParseStallMicros / 1000),
+               (long)(stats.nConsumerStallMicros / 1000), stats.dAvgReadQueue, (unsigned long)stats.nMaxReadQueue, stats.dAvgParseQueue,
+               (unsigned long)stats.nMaxParseQueue);
+        LogMemoryReport("流水线读取后");
+    }
+
+    // 按高度区间批量读取(例如最后 1000 个区块), 读取按磁盘位置排序并合并
+    if (fReadRange)
+    {
+        std::vector<const CBlockIndex *> vRange;
+        for (int nHeight = std::max(0, chainActive.Height() - 999); nHeight <= chainActive.Height(); nHeight++)
+            vRange.push_back(chainActive[nHeight]);
+        std::vector<CBlock> vBlocks;
+        scan_start_time = GetTimeMillis();
+        bool fRead = pblockman->ReadBlocks(MakeSpan(vRange), vBlocks, Params().GetConsensus());
+        LogInfo("批量读取%s: 高度 %d - %d, %lu 个区块, 耗时 %ld ms\n", fRead ? "完成" : "失败", vRange.front()->nHeight, vRange.back()->nHeight,
+               (unsigned long)vBlocks.size(), (long)(GetTimeMillis() - scan_start_time).count());
+        LogMemoryReport("批量读取后", &vBlocks);
+    }
+
+    // 按哈希随机查找区块: 全部读取一次提交给 io_uring (或 pread 线程池), 冷缓存下磁盘队列保持满载
+    if (fReadRandom)
+    {
+        // 载入后索引只读, 用紧凑的冻结哈希表查找
+        const CFrozenBlockIndex frozen_index(m_block_index);
+        std::mt19937 rng(42);
+        std::vector<const CBlockIndex *> vLookup;
+        for (int i = 0; i < 1000; i++)
+        {
+            const uint256 hash = chainActive[rng() % (chainActive.Height() + 1)]->GetBlockHash();
+            if (const CBlockIndex *pindex = frozen_index.Find(hash))
+                vLookup.push_back(pindex);
+        }
+        std::vector<CBlock> vBlocks;
+        scan_start_time = GetTimeMillis();
+        bool fRead = pblockman->ReadBlocksDirect(MakeSpan(vLookup), vBlocks, Params().GetConsensus());
+        LogInfo("随机读取%s(%s): %lu 个区块, 耗时 %ld ms\n", fRead ? "完成" : "失败", pblockman->GetIOBackend().GetName(), (unsigned long)vBlocks.size(),
+               (long)(GetTimeMillis() - scan_start_time).count());
+    }
+
+    // hzx 有 undo 数据(rev 文件)时, 不需要 UTXO 集合就能得到每个输入花费的金额, 统计全链手续费
+    if (fUndoStats && ok && (chainActive.Tip()->nStatus & BLOCK_HAVE_UNDO))
+    {
+        std::atomic<int64_t> nValueIn(0), nFees(0);
+        std::atomic<uint64_t> nInputs(0);
+        scan_start_time = GetTimeMillis();
+        ok = scanner.ScanWithUndo(chainActive, [&](const CBlockIndex *pindex, const CBlockView &block, const CBlockUndo &blockundo) {
+            int64_t nBlockIn = 0, nBlockOut = 0;
+            for (size_t i = 1; i < block.GetTxCount(); i++)
+            {
+                for (const Coin &coin : blockundo.vtxundo[i - 1].vprevout)
+                    nBlockIn += coin.out.nValue;
+                const CTransactionView tx = block.GetTx(i);
+                for (size_t j = 0; j < tx.GetOutputCount(); j++)
+                    nBlockOut += tx.GetOutput(j).GetValue();
+                nInputs += tx.GetInputCount();
+            }
+            nValueIn += nBlockIn;
+            nFees += nBlockIn - nBlockOut;
+            return true;
+        });
+        LogInfo("undo 扫描%s: %lu 个输入, 输入金额 %ld, 手续费 %ld, 耗时 %ld ms\n", ok ? "完成" : "失败", (unsigned long)nInputs,
+               (long)nValueIn, (long)nFees, (long)(GetTimeMillis() - scan_start_time).count());
+        LogMemoryReport("undo 扫描后");
+    }
+    else if (fUndoStats && ok)
+        LogWarning("主链链尾没有 undo 数据, 跳过 undo 统计\n");
     // std::vector<uint8_t> blockraw;
-    // ReadRawBlockFromDisk(blockraw, blk_path, blk_index, Params().GetConsensus());
-    CBlock block;
-    ReadBlockFromDisk(block, blk_path, blk_index, Params().GetConsensus());
-    // CBlockHeaderAndShortTxIDs cmpctBlock(block,true);
-    // int cmplock_sz = GetSerializeSize(block, PROTOCOL_VERSION);
-    // printf("压缩区块大小为: %d \n", cmplock_sz);
+    // ReadRawBlockFromDisk(blockraw, chainActive.Tip(), Params().GetConsensus());
+    // CBlock block;
+    // ReadBlockFromDisk(block, chainActive.Tip(), Params().GetConsensus());
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "memAccount.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace
+{
+const char* const MEMORY_TAG_NAMES[MEMORY_TAG_COUNT] = {
+    "block_index",
+    "block_index_sets",
+    "block_view",
+    "block_io",
+    "scan",
+};
+
+std::string FormatBytes(int64_t nBytes)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f MiB", nBytes / 1048576.0);
+    return buf;
+}
+} // namespace
+
+const char* GetMemoryTagName(MemoryTag tag)
+{
+    return MEMORY_TAG_NAMES[(size_t)tag];
+}
+
+CMemoryAccount& MemoryAccount(MemoryTag tag)
+{
+    // hzx 与 Metrics() 相同, 有意不释放: 全局容器在静态析构时仍会释放内存并记账
+    static std::vector<CMemoryAccount>* const g_accounts = [] {
+        std::vector<CMemoryAccount>* accounts = new std::vector<CMemoryAccount>();
+        accounts->reserve(MEMORY_TAG_COUNT);
+        for (const char* name : MEMORY_TAG_NAMES)
+        {
+            const std::string labels = std::string("subsystem=\"") + name + "\"";
+            accounts->emplace_back(Metrics().Gauge("blockchain_memory_live_bytes", "Heap bytes currently allocated per subsystem", labels),
+                                   Metrics().Gauge("blockchain_memory_peak_bytes", "Most heap bytes allocated at once per subsystem", labels));
+        }
+        return accounts;
+    }();
+    return (*g_accounts)[(size_t)tag];
+}
+
+void CMemoryReport::Add(const std::string& name, size_t nCount, size_t nBytes)
+{
+    m_entries.push_back(MemoryUsageEntry{name, nCount, nBytes});
+    Metrics().Gauge("blockchain_memory_usage_bytes", "Estimated memory used by a structure at the last memory report", "structure=\"" + name + "\"").Set(nBytes);
+}
+
+size_t CMemoryReport::GetTotal() const
+{
+    size_t nTotal = 0;
+    for (const MemoryUsageEntry& entry : m_entries)
+        nTotal += entry.nBytes;
+    return nTotal;
+}
+
+std::string CMemoryReport::ToString() const
+{
+    std::vector<MemoryUsageEntry> vEntries = m_entries;
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const MemoryUsageEntry& a, const MemoryUsageEntry& b) { return a.nBytes > b.nBytes; });
+    std::string str;
+    char line[256];
+    for (const MemoryUsageEntry& entry : vEntries)
+    {
+        if (entry.nCount)
+            snprintf(line, sizeof(line), "  %-28s %12s  %10lu 项, 平均 %.1f 字节\n", entry.strName.data(), FormatBytes(entry.nBytes).data(), (unsigned long)entry.nCount,
+                     (double)entry.nBytes / entry.nCount);
+        else
+            snprintf(line, sizeof(line), "  %-28s %12s\n", entry.strName.data(), FormatBytes(entry.nBytes).data());
+        str += line;
+    }
+    snprintf(line, sizeof(line), "  %-28s %12s, 进程常驻 %s\n", "合计", FormatBytes(GetTotal()).data(), FormatBytes(GetResidentMemory()).data());
+    str += line;
+    for (size_t i = 0; i < MEMORY_TAG_COUNT; i++)
+    {
+        const CMemoryAccount& account = MemoryAccount((MemoryTag)i);
+        snprintf(line, sizeof(line), "  [%s] 当前 %s, 峰值 %s\n", MEMORY_TAG_NAMES[i], FormatBytes(account.GetLive()).data(), FormatBytes(account.GetPeak()).data());
+        str += line;
+    }
+    return str;
+}
+
+size_t GetResidentMemory()
+{
+    // hzx /proc/self/statm 的第二项是常驻页数
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long nSize = 0, nResident = 0;
+    const bool ok = fscanf(file, "%lu %lu", &nSize, &nResident) == 2;
+    fclose(file);
+    return ok ? nResident * sysconf(_SC_PAGESIZE) : 0;
+}
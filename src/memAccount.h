@@ -0,0 +1,134 @@
+#ifndef BLOCKCHAIN_MEMACCOUNT_H
+#define BLOCKCHAIN_MEMACCOUNT_H
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "metrics.h"
+
+/** Subsystems whose heap allocations go through CTrackingAllocator. */
+enum class MemoryTag
+{
+    //! CBlockIndex arena chunks, the block hash map buckets and frozen indexes
+    BLOCK_INDEX,
+    //! setBlockIndexCandidates, m_blocks_unlinked and setDirtyBlockIndex
+    BLOCK_INDEX_SETS,
+    //! offset tables of CBlockView, one set per block being scanned
+    BLOCK_VIEW,
+    //! read buffers of batched direct block reads
+    BLOCK_IO,
+    //! reorder buffer and per file task lists of the block scanner
+    SCAN,
+};
+static const size_t MEMORY_TAG_COUNT = 5;
+
+const char* GetMemoryTagName(MemoryTag tag);
+
+/**
+ * Live and peak bytes allocated for one subsystem, kept in the gauges
+ * blockchain_memory_live_bytes and blockchain_memory_peak_bytes of Metrics().
+ */
+class CMemoryAccount
+{
+private:
+    CMetricGauge& m_live;
+    CMetricGauge& m_peak;
+
+public:
+    CMemoryAccount(CMetricGauge& live, CMetricGauge& peak) : m_live(live), m_peak(peak) {}
+
+    void Allocated(size_t n) { m_peak.SetMax(m_live.Add(n)); }
+    void Freed(size_t n) { m_live.Add(-(int64_t)n); }
+
+    int64_t GetLive() const { return m_live.Value(); }
+    int64_t GetPeak() const { return m_peak.Value(); }
+};
+
+CMemoryAccount& MemoryAccount(MemoryTag tag);
+
+/**
+ * std::allocator that counts the bytes of every allocation in the account of TAG, for
+ * containers whose size we want to watch while it changes (a full scan that runs out of
+ * memory leaves no report behind, the metrics exported up to then do). Counting is one
+ * relaxed add per allocation and free; containers that grow geometrically allocate rarely.
+ */
+template <typename T, MemoryTag TAG>
+class CTrackingAllocator
+{
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef CTrackingAllocator<U, TAG> other;
+    };
+
+    CTrackingAllocator() noexcept {}
+    template <typename U>
+    CTrackingAllocator(const CTrackingAllocator<U, TAG>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        T* p = std::allocator<T>().allocate(n);
+        MemoryAccount(TAG).Allocated(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        MemoryAccount(TAG).Freed(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CTrackingAllocator<U, TAG>&) const noexcept
+    {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const CTrackingAllocator<U, TAG>&) const noexcept
+    {
+        return false;
+    }
+};
+
+//! std::vector counted in the account of TAG
+template <typename T, MemoryTag TAG>
+using TrackedVector = std::vector<T, CTrackingAllocator<T, TAG>>;
+
+struct MemoryUsageEntry
+{
+    std::string strName;
+    //! elements, or 0 when the structure has no meaningful count
+    size_t nCount;
+    size_t nBytes;
+};
+
+/**
+ * Memory used by named structures, estimated with the memusage functions, next to the
+ * live and peak bytes of every MemoryTag and the resident size of the process. Add()
+ * also sets the gauge blockchain_memory_usage_bytes{structure=name}, so the last report
+ * is visible in the exported metrics.
+ */
+class CMemoryReport
+{
+private:
+    std::vector<MemoryUsageEntry> m_entries;
+
+public:
+    void Add(const std::string& name, size_t nCount, size_t nBytes);
+
+    const std::vector<MemoryUsageEntry>& GetEntries() const { return m_entries; }
+    size_t GetTotal() const;
+
+    //! one line per structure, largest first, then one per MemoryTag
+    std::string ToString() const;
+};
+
+/** Resident set size of the process in bytes, 0 if it cannot be read. */
+size_t GetResidentMemory();
+
+#endif
@@ -0,0 +1,383 @@
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <cstdio>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "logging.h"
+
+namespace
+{
+//! how long the exporter waits in poll() before checking whether it should stop or write the file
+const std::chrono::milliseconds EXPORTER_POLL_INTERVAL{100};
+//! largest scrape request read; the path is all that is looked at
+const size_t MAX_REQUEST_SIZE = 4096;
+
+const double EXPORT_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+std::string FormatValue(double value)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+// name{labels} 或 name{labels,extra}, 两者都为空时不带花括号
+std::string FormatSeries(const std::string& name, const std::string& labels, const std::string& extra = "")
+{
+    if (labels.empty() && extra.empty())
+        return name;
+    return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+} // namespace
+
+size_t NextMetricShard()
+{
+    static std::atomic<size_t> nNextShard{0};
+    return nNextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_COUNTER_SHARDS;
+}
+
+uint64_t CMetricCounter::Value() const
+{
+    uint64_t nSum = 0;
+    for (const Shard& shard : m_shards)
+        nSum += shard.n.load(std::memory_order_relaxed);
+    return nSum;
+}
+
+CMetricCounterArray::CMetricCounterArray()
+{
+    for (std::atomic<Chunk*>& chunk : m_chunks)
+        chunk.store(nullptr, std::memory_order_relaxed);
+}
+
+CMetricCounterArray::~CMetricCounterArray()
+{
+    for (std::atomic<Chunk*>& chunk : m_chunks)
+        delete chunk.load();
+}
+
+CMetricCounterArray::Chunk& CMetricCounterArray::GetChunk(size_t nChunk)
+{
+    Chunk* chunk = new Chunk;
+    for (std::atomic<uint64_t>& n : chunk->n)
+        n.store(0, std::memory_order_relaxed);
+    // hzx 两个线程同时分配同一块时, 后到的释放自己的, 用先装上的那块
+    Chunk* expected = nullptr;
+    if (!m_chunks[nChunk].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel))
+    {
+        delete chunk;
+        return *expected;
+    }
+    return *chunk;
+}
+
+std::vector<std::pair<size_t, uint64_t>> CMetricCounterArray::Values() const
+{
+    std::vector<std::pair<size_t, uint64_t>> vValues;
+    for (size_t c = 0; c < CHUNKS; c++)
+    {
+        const Chunk* chunk = m_chunks[c].load(std::memory_order_acquire);
+        if (!chunk)
+            continue;
+        for (size_t i = 0; i < CHUNK_SIZE; i++)
+        {
+            const uint64_t n = chunk->n[i].load(std::memory_order_relaxed);
+            if (n)
+                vValues.emplace_back(c * CHUNK_SIZE + i, n);
+        }
+    }
+    return vValues;
+}
+
+CMetricHistogram::CMetricHistogram()
+{
+    for (std::atomic<uint64_t>& count : m_counts)
+        count.store(0, std::memory_order_relaxed);
+}
+
+uint64_t CMetricHistogram::BucketLowerBound(int i)
+{
+    if (i < (2 << SUB_BITS))
+        return i;
+    const int nExp = (i >> SUB_BITS) + SUB_BITS - 1;
+    return (uint64_t)((1 << SUB_BITS) + (i & ((1 << SUB_BITS) - 1))) << (nExp - SUB_BITS);
+}
+
+void CMetricHistogram::Read(std::vector<uint64_t>& vCounts, uint64_t& nCount, uint64_t& nSum) const
+{
+    vCounts.resize(BUCKETS);
+    nCount = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        vCounts[i] = m_counts[i].load(std::memory_order_relaxed);
+        nCount += vCounts[i];
+    }
+    nSum = m_sum.load(std::memory_order_relaxed);
+}
+
+double CMetricHistogram::Quantile(const std::vector<uint64_t>& vCounts, uint64_t nCount, double q)
+{
+    if (nCount == 0)
+        return 0;
+    // 第 nRank 个(从 1 开始)记录值所在的桶
+    const uint64_t nRank = std::max<uint64_t>(1, (uint64_t)(q * nCount + 0.5));
+    uint64_t nSeen = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        nSeen += vCounts[i];
+        if (nSeen >= nRank)
+        {
+            const uint64_t nLow = BucketLowerBound(i);
+            const uint64_t nHigh = i + 1 < BUCKETS ? BucketLowerBound(i + 1) - 1 : UINT64_MAX;
+            return nLow + (double)(nHigh - nLow) / 2;
+        }
+    }
+    return BucketLowerBound(BUCKETS - 1);
+}
+
+CMetricsRegistry::Metric& CMetricsRegistry::Register(const std::string& name, Type type, const std::string& help, const std::string& labels, double scale)
+{
+    Family& family = m_families[name];
+    if (family.vMetrics.empty())
+    {
+        family.type = type;
+        family.strHelp = help;
+    }
+    assert(family.type == type);
+    for (Metric& metric : family.vMetrics)
+        if (metric.strLabels == labels)
+            return metric;
+    family.vMetrics.emplace_back();
+    Metric& metric = family.vMetrics.back();
+    metric.strLabels = labels;
+    metric.dScale = scale;
+    return metric;
+}
+
+CMetricCounter& CMetricsRegistry::Counter(const std::string& name, const std::string& help, const std::string& labels, double scale)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = Register(name, Type::Counter, help, labels, scale);
+    if (!metric.counter)
+        metric.counter.reset(new CMetricCounter());
+    return *metric.counter;
+}
+
+CMetricGauge& CMetricsRegistry::Gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = Register(name, Type::Gauge, help, labels, 1);
+    if (!metric.gauge)
+        metric.gauge.reset(new CMetricGauge());
+    return *metric.gauge;
+}
+
+CMetricCounterArray& CMetricsRegistry::CounterArray(const std::string& name, const std::string& help, const std::string& index_label)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = Register(name, Type::CounterArray, help, "", 1);
+    m_families[name].strIndexLabel = index_label;
+    if (!metric.array)
+        metric.array.reset(new CMetricCounterArray());
+    return *metric.array;
+}
+
+CMetricHistogram& CMetricsRegistry::Histogram(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = Register(name, Type::Histogram, help, labels, 1e-9);
+    if (!metric.histogram)
+        metric.histogram.reset(new CMetricHistogram());
+    return *metric.histogram;
+}
+
+std::string CMetricsRegistry::ExportPrometheus() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string out;
+    std::vector<uint64_t> vCounts;
+    for (const auto& item : m_families)
+    {
+        const std::string& name = item.first;
+        const Family& family = item.second;
+        static const char* const TYPE_NAMES[] = {"counter", "gauge", "counter", "summary"};
+        out += "# HELP " + name + " " + family.strHelp + "\n";
+        out += "# TYPE " + name + " " + TYPE_NAMES[(int)family.type] + "\n";
+        for (const Metric& metric : family.vMetrics)
+        {
+            switch (family.type)
+            {
+            case Type::Counter:
+                out += FormatSeries(name, metric.strLabels) + " " + (metric.dScale == 1 ? std::to_string(metric.counter->Value()) : FormatValue(metric.counter->Value() * metric.dScale)) + "\n";
+                break;
+            case Type::Gauge:
+                out += FormatSeries(name, metric.strLabels) + " " + std::to_string(metric.gauge->Value()) + "\n";
+                break;
+            case Type::CounterArray:
+                for (const std::pair<size_t, uint64_t>& value : metric.array->Values())
+                    out += FormatSeries(name, family.strIndexLabel + "=\"" + std::to_string(value.first) + "\"") + " " + std::to_string(value.second) + "\n";
+                break;
+            case Type::Histogram:
+            {
+                uint64_t nCount, nSum;
+                metric.histogram->Read(vCounts, nCount, nSum);
+                for (double q : EXPORT_QUANTILES)
+                    out += FormatSeries(name, metric.strLabels, "quantile=\"" + FormatValue(q) + "\"") + " " +
+                           FormatValue(CMetricHistogram::Quantile(vCounts, nCount, q) * metric.dScale) + "\n";
+                out += FormatSeries(name + "_sum", metric.strLabels) + " " + FormatValue(nSum * metric.dScale) + "\n";
+                out += FormatSeries(name + "_count", metric.strLabels) + " " + std::to_string(nCount) + "\n";
+                break;
+            }
+            }
+        }
+    }
+    return out;
+}
+
+CMetricsRegistry& Metrics()
+{
+    // hzx 与 LogInstance 相同, 有意不释放: 其它静态对象析构时仍可能计数
+    static CMetricsRegistry* g_metrics = new CMetricsRegistry();
+    return *g_metrics;
+}
+
+CMetricsExporter::~CMetricsExporter()
+{
+    Stop();
+}
+
+bool CMetricsExporter::WriteFile() const
+{
+    const std::string tmp_path = m_options.strPath + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "w");
+    if (!file)
+    {
+        LogError("%s: 无法写入 %s\n", __func__, tmp_path.data());
+        return false;
+    }
+    const std::string text = Metrics().ExportPrometheus();
+    const bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (fclose(file) != 0 || !ok || rename(tmp_path.c_str(), m_options.strPath.c_str()) != 0)
+    {
+        LogError("%s: 无法写入 %s\n", __func__, m_options.strPath.data());
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void CMetricsExporter::Serve(int fd) const
+{
+    // hzx 一次只服务一个连接, 客户端迟迟不发请求时最多等一个轮询间隔
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE)
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, EXPORTER_POLL_INTERVAL.count()) <= 0)
+            break;
+        const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        request.append(buf, n);
+    }
+    std::string status = "200 OK", body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0)
+        body = Metrics().ExportPrometheus();
+    else
+    {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+    const std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) +
+                                 "\r\nConnection: close\r\n\r\n" + body;
+    for (size_t nSent = 0; nSent < response.size();)
+    {
+        const ssize_t n = send(fd, response.data() + nSent, response.size() - nSent, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        nSent += n;
+    }
+}
+
+void CMetricsExporter::ThreadMain()
+{
+    auto next_write = std::chrono::steady_clock::now() + m_options.interval;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        if (m_listen_fd >= 0)
+        {
+            lock.unlock();
+            pollfd pfd{m_listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, EXPORTER_POLL_INTERVAL.count()) > 0)
+            {
+                const int fd = accept(m_listen_fd, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    Serve(fd);
+                    close(fd);
+                }
+            }
+            lock.lock();
+        }
+        else
+            m_cond.wait_until(lock, next_write, [&] { return m_stop; });
+        if (!m_options.strPath.empty() && std::chrono::steady_clock::now() >= next_write)
+        {
+            lock.unlock();
+            WriteFile();
+            lock.lock();
+        }
+        if (std::chrono::steady_clock::now() >= next_write)
+            next_write = std::chrono::steady_clock::now() + m_options.interval;
+    }
+}
+
+bool CMetricsExporter::Start(const MetricsExportOptions& options)
+{
+    Stop();
+    m_options = options;
+    if (m_options.nPort > 0)
+    {
+        m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const int one = 1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_options.nPort);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (m_listen_fd < 0 || setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            bind(m_listen_fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listen_fd, 16) != 0)
+        {
+            LogError("%s: 无法监听 127.0.0.1:%d\n", __func__, m_options.nPort);
+            if (m_listen_fd >= 0)
+                close(m_listen_fd);
+            m_listen_fd = -1;
+            return false;
+        }
+    }
+    m_stop = false;
+    m_thread = std::thread(&CMetricsExporter::ThreadMain, this);
+    return true;
+}
+
+void CMetricsExporter::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+    if (m_listen_fd >= 0)
+        close(m_listen_fd);
+    m_listen_fd = -1;
+    if (!m_options.strPath.empty())
+        WriteFile();
+}
@@ -0,0 +1,254 @@
+#ifndef BLOCKCHAIN_METRICS_H
+#define BLOCKCHAIN_METRICS_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Shards of a CMetricCounter; threads are spread over them round robin
+static const size_t METRIC_COUNTER_SHARDS = 16;
+
+/** Shard for a thread that counts for the first time. */
+size_t NextMetricShard();
+
+/** Index of the calling thread's counter shard, fixed for the life of the thread. */
+inline size_t MetricShardIndex()
+{
+    thread_local const size_t nShard = NextMetricShard();
+    return nShard;
+}
+
+/**
+ * Monotonic counter. Adds go to one of METRIC_COUNTER_SHARDS cache lines chosen by the calling
+ * thread, so threads counting the same event do not bounce a line between cores; Value() sums
+ * the shards. The exported value is the sum times the scale given at registration (e.g. 1e-6
+ * for a counter of microseconds exported in seconds).
+ */
+class CMetricCounter
+{
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> n{0};
+    };
+    Shard m_shards[METRIC_COUNTER_SHARDS];
+
+public:
+    void Add(uint64_t n = 1) { m_shards[MetricShardIndex()].n.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const;
+};
+
+/** Value that goes up and down, e.g. a queue depth. */
+class CMetricGauge
+{
+private:
+    std::atomic<int64_t> m_value{0};
+
+public:
+    void Set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+    //! returns the new value
+    int64_t Add(int64_t n) { return m_value.fetch_add(n, std::memory_order_relaxed) + n; }
+    //! raise the gauge to value if it is lower, e.g. to keep a high-water mark
+    void SetMax(int64_t value)
+    {
+        int64_t cur = m_value.load(std::memory_order_relaxed);
+        while (value > cur && !m_value.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            ;
+    }
+    int64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * Counters indexed by a small integer label, e.g. bytes read per blk file. Counters are
+ * allocated in chunks of CHUNK_SIZE on first use of the chunk and never freed, so Add is a
+ * load of the chunk pointer and one relaxed add; there is no lock and no resize to race with.
+ * Indexes at or beyond CHUNKS * CHUNK_SIZE are counted in the last counter.
+ */
+class CMetricCounterArray
+{
+public:
+    static const size_t CHUNK_SIZE = 256;
+    static const size_t CHUNKS = 256;
+
+private:
+    struct Chunk
+    {
+        std::atomic<uint64_t> n[CHUNK_SIZE];
+    };
+    std::atomic<Chunk*> m_chunks[CHUNKS];
+
+    Chunk& GetChunk(size_t nChunk);
+
+public:
+    CMetricCounterArray();
+    ~CMetricCounterArray();
+
+    void Add(size_t nIndex, uint64_t n)
+    {
+        nIndex = std::min(nIndex, CHUNKS * CHUNK_SIZE - 1);
+        Chunk* chunk = m_chunks[nIndex / CHUNK_SIZE].load(std::memory_order_acquire);
+        if (!chunk)
+            chunk = &GetChunk(nIndex / CHUNK_SIZE);
+        chunk->n[nIndex % CHUNK_SIZE].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    //! (index, value) of every counter that is not zero, by index
+    std::vector<std::pair<size_t, uint64_t>> Values() const;
+};
+
+/**
+ * Log-linear histogram in the style of HdrHistogram: every power of two is split into
+ * 2^SUB_BITS equal buckets, so a recorded value lands in a bucket at most 1/2^SUB_BITS wider
+ * than itself (values below 2^(SUB_BITS+1) are exact) and the whole uint64_t range needs
+ * BUCKETS counters. Recording is an index computation and two relaxed adds; quantiles are
+ * computed from the bucket counts when exported.
+ */
+class CMetricHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    std::atomic<uint64_t> m_counts[BUCKETS];
+    std::atomic<uint64_t> m_sum{0};
+
+public:
+    CMetricHistogram();
+
+    static int BucketIndex(uint64_t value)
+    {
+        if (value < (2u << SUB_BITS))
+            return value;
+        const int nExp = 63 - __builtin_clzll(value);
+        return ((nExp - SUB_BITS + 1) << SUB_BITS) + (int)((value >> (nExp - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+    }
+    //! smallest value counted in bucket i
+    static uint64_t BucketLowerBound(int i);
+
+    void Observe(uint64_t value)
+    {
+        m_counts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** Snapshot of the bucket counts, their total and the sum of the recorded values. */
+    void Read(std::vector<uint64_t>& vCounts, uint64_t& nCount, uint64_t& nSum) const;
+
+    /** Value at quantile q (0..1) of vCounts, the middle of the bucket it falls in. */
+    static double Quantile(const std::vector<uint64_t>& vCounts, uint64_t nCount, double q);
+};
+
+/** Records the nanoseconds from construction to destruction into a histogram. */
+class CMetricTimer
+{
+private:
+    CMetricHistogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+    explicit CMetricTimer(CMetricHistogram& histogram) : m_histogram(histogram), m_start(std::chrono::steady_clock::now()) {}
+    ~CMetricTimer()
+    {
+        m_histogram.Observe(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+    }
+};
+
+/**
+ * Named metrics of the process. Registering looks the metric up by name and labels under a
+ * lock and creates it the first time; the returned reference stays valid for the life of the
+ * process, so hot paths register once (usually into a function local static) and then only
+ * touch the metric itself. labels is the inside of the Prometheus label set, e.g.
+ * impl="shani", or empty.
+ */
+class CMetricsRegistry
+{
+private:
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        CounterArray,
+        Histogram,
+    };
+
+    struct Metric
+    {
+        std::string strLabels;
+        double dScale;
+        std::unique_ptr<CMetricCounter> counter;
+        std::unique_ptr<CMetricGauge> gauge;
+        std::unique_ptr<CMetricCounterArray> array;
+        std::unique_ptr<CMetricHistogram> histogram;
+    };
+
+    struct Family
+    {
+        Type type;
+        std::string strHelp;
+        //! label name of a counter array, e.g. file
+        std::string strIndexLabel;
+        std::vector<Metric> vMetrics;
+    };
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Family> m_families;
+
+    Metric& Register(const std::string& name, Type type, const std::string& help, const std::string& labels, double scale);
+
+public:
+    CMetricCounter& Counter(const std::string& name, const std::string& help, const std::string& labels = "", double scale = 1);
+    CMetricGauge& Gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    CMetricCounterArray& CounterArray(const std::string& name, const std::string& help, const std::string& index_label);
+    //! a histogram of nanoseconds, exported in seconds
+    CMetricHistogram& Histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /** All metrics in the Prometheus text format (version 0.0.4); histograms are exported as summaries. */
+    std::string ExportPrometheus() const;
+};
+
+CMetricsRegistry& Metrics();
+
+struct MetricsExportOptions
+{
+    //! file rewritten with every export (through a temporary file and a rename), empty for none
+    std::string strPath;
+    //! serve GET /metrics on 127.0.0.1:nPort, 0 for none
+    int nPort = 0;
+    std::chrono::milliseconds interval{1000};
+};
+
+/**
+ * Background thread exporting Metrics(): it rewrites the file every interval and answers
+ * scrapes on the local port in between. Stop() writes the file one last time.
+ */
+class CMetricsExporter
+{
+private:
+    MetricsExportOptions m_options;
+    int m_listen_fd = -1;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop = false;
+
+    bool WriteFile() const;
+    void Serve(int fd) const;
+    void ThreadMain();
+
+public:
+    ~CMetricsExporter();
+
+    /** Open the port and start the thread; false if the port cannot be bound. */
+    bool Start(const MetricsExportOptions& options);
+    void Stop();
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "arith_uint256.h"
 #include "chain.h"
 #include "block.h"
+#include "logging.h"
 #include "uint256.h"
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
@@ -73,7 +74,7 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
-    printf("%s : 检查区块合法性: %s\n", __func__, hash.ToString().data());
+    LogDebug(BCLog::VALIDATION, "%s : 检查区块合法性: %s\n", __func__, hash.ToString().data());
     bool fNegative;
     bool fOverflow;
     arith_uint256 bnTarget;
@@ -0,0 +1,349 @@
+#include "reindex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <sys/stat.h>
+#include "blkMmap.h"
+#include "blockIndexMap.h"
+#include "blockView.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "logging.h"
+#include "merkle.h"
+#include "pow.h"
+#include "scheduler.h"
+#include "shutdown.h"
+#include "streams.h"
+#include "time.h"
+#include "txdb.h"
+
+namespace
+{
+//! hzx 本仓库没有 consensus.h, 与 bitcoind 的 MAX_BLOCK_SERIALIZED_SIZE 相同
+static const unsigned int MAX_BLOCK_SERIALIZED_SIZE = 4000000;
+
+/** A block record found in a blk file. */
+struct CFoundBlock
+{
+    CBlockHeader header;
+    uint256 hash;
+    unsigned int nDataPos;
+    unsigned int nTx;
+    //! position of the matching undo record in the rev file, 0 if none was found
+    unsigned int nUndoPos;
+};
+
+/** What a worker found in blk?????.dat and rev?????.dat with the same number. */
+struct CScannedFile
+{
+    std::vector<CFoundBlock> vBlocks;
+    //! end of the last valid record, i.e. CBlockFileInfo::nSize / nUndoSize
+    unsigned int nSize = 0;
+    unsigned int nUndoSize = 0;
+    unsigned int nBadRecords = 0;
+};
+
+bool FileExists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * Call fn(nPos, record) for every record (magic, size, data) of the file at path, where nPos is
+ * the offset of the data. Garbage between records is skipped by searching for the next magic,
+ * as in bitcoind's LoadExternalBlockFile. nTrailer bytes following each record (the checksum
+ * of undo records) are appended to record.
+ */
+template <typename Fn>
+bool ForEachRecord(const std::string& path, const CMessageHeader::MessageStartChars& message_start, size_t nTrailer, Fn fn)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    CBufferedFile blkdat(file, 2 * MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> record;
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof())
+    {
+        if (ShutdownRequested())
+            return false;
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try
+        {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(message_start[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> buf;
+            if (memcmp(buf, message_start, CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 1 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        }
+        catch (const std::exception&)
+        {
+            // no valid record header found; don't complain
+            break;
+        }
+        try
+        {
+            const uint64_t nPos = blkdat.GetPos();
+            blkdat.SetLimit(nPos + nSize + nTrailer);
+            record.resize(nSize + nTrailer);
+            blkdat.read((char*)record.data(), record.size());
+            if (fn(nPos, record))
+                nRewind = blkdat.GetPos();
+        }
+        catch (const std::exception& e)
+        {
+            // 文件末尾不完整的记录
+            LogError("%s: Deserialize or I/O error - %s, 文件: %s\n", __func__, e.what(), path.data());
+        }
+    }
+    return true;
+}
+
+/** Collect the valid blocks of blk file nFile: parseable, merkle root matching, header hash meeting nBits. */
+bool ScanBlockFile(const std::string& blocks_dir, int nFile, const CChainParams& chainparams, CScannedFile& scanned)
+{
+    CBlockView view;
+    std::vector<uint256> vTxHash;
+    const std::string path = GetBlockFilePath(blocks_dir, "blk", nFile);
+    bool ok = ForEachRecord(path, chainparams.MessageStart(), 0, [&](uint64_t nPos, const std::vector<unsigned char>& record) {
+        bool fMutated = false;
+        if (!view.Parse(Span<const unsigned char>(record.data(), record.size())) ||
+            (view.GetTxHashes(vTxHash), ComputeMerkleRoot(vTxHash, &fMutated) != view.GetHashMerkleRoot()) || fMutated)
+        {
+            scanned.nBadRecords++;
+            return false;
+        }
+        scanned.vBlocks.push_back({view.GetBlockHeader(), uint256(), (unsigned int)nPos, (unsigned int)view.GetTxCount(), 0});
+        scanned.nSize = std::max<uint64_t>(scanned.nSize, nPos + record.size());
+        return true;
+    });
+    if (!ok)
+        return false;
+
+    // 整个文件的区块头一次批量计算哈希
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.reserve(scanned.vBlocks.size());
+    for (const CFoundBlock& found : scanned.vBlocks)
+        vHeaders.push_back(found.header);
+    std::vector<uint256> vHashes;
+    GetBlockHeaderHashes(vHeaders, vHashes);
+    size_t nValid = 0;
+    for (size_t i = 0; i < scanned.vBlocks.size(); i++)
+    {
+        CFoundBlock& found = scanned.vBlocks[i];
+        found.hash = vHashes[i];
+        if (!CheckProofOfWork(found.hash, found.header.nBits, chainparams.GetConsensus()))
+        {
+            scanned.nBadRecords++;
+            continue;
+        }
+        scanned.vBlocks[nValid++] = found;
+    }
+    scanned.vBlocks.resize(nValid);
+    return true;
+}
+
+/**
+ * Attribute the records of rev file nFile to the blocks of scanned. Undo data is written in
+ * the order blocks are connected, which is close to the order they are stored in, so the
+ * search starts after the previously matched block; the input count at the start of the
+ * record rules out most candidates before any hashing.
+ */
+void ScanUndoFile(const std::string& blocks_dir, int nFile, const CChainParams& chainparams, CScannedFile& scanned)
+{
+    const std::string path = GetBlockFilePath(blocks_dir, "rev", nFile);
+    if (!FileExists(path))
+        return;
+    const uint256& hashGenesis = chainparams.GetConsensus().hashGenesisBlock;
+    std::vector<CFoundBlock>& vBlocks = scanned.vBlocks;
+    size_t nCursor = 0;
+    ForEachRecord(path, chainparams.MessageStart(), CHash256::OUTPUT_SIZE, [&](uint64_t nPos, const std::vector<unsigned char>& record) {
+        const size_t nSize = record.size() - CHash256::OUTPUT_SIZE;
+        SpanReader reader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(record.data(), nSize));
+        const uint64_t nTxUndo = ReadCompactSize(reader);
+        for (size_t k = 0; k < vBlocks.size(); k++)
+        {
+            CFoundBlock& found = vBlocks[(nCursor + k) % vBlocks.size()];
+            if (found.nUndoPos || found.nTx != nTxUndo + 1 || found.hash == hashGenesis)
+                continue;
+            uint256 hashChecksum;
+            CHash256().Write(found.header.hashPrevBlock.begin(), found.header.hashPrevBlock.size()).Write(record.data(), nSize).Finalize(hashChecksum.begin());
+            if (memcmp(hashChecksum.begin(), record.data() + nSize, CHash256::OUTPUT_SIZE) == 0)
+            {
+                found.nUndoPos = nPos;
+                nCursor = (nCursor + k + 1) % vBlocks.size();
+                scanned.nUndoSize = std::max<uint64_t>(scanned.nUndoSize, nPos + record.size());
+                return true;
+            }
+        }
+        // 找不到对应区块的记录(例如属于已删除的分叉区块)直接跳过
+        scanned.nBadRecords++;
+        return true;
+    });
+}
+} // namespace
+
+bool ReindexBlockFiles(const CChainParams& chainparams, const std::string& blocks_dir, CBlockTreeDB& blocktree, const ReindexOptions& options)
+{
+    const int64_t nStart = GetTimeMillis().count();
+    int nFiles = 0;
+    while (FileExists(GetBlockFilePath(blocks_dir, "blk", nFiles)))
+        nFiles++;
+    if (nFiles == 0)
+    {
+        LogError("%s: %s 中没有区块文件\n", __func__, blocks_dir.data());
+        return false;
+    }
+    if (!blocktree.WriteReindexing(true))
+        return false;
+
+    // hzx 每个任务一次处理一个 blk 文件及同编号的 rev 文件, 文件之间互不依赖
+    std::vector<CScannedFile> vScanned(nFiles);
+    std::atomic<bool> fFailed(false);
+    ParallelFor(nFiles, options.nThreads, [&](size_t nFile) {
+        if (fFailed)
+            return;
+        if (!ScanBlockFile(blocks_dir, nFile, chainparams, vScanned[nFile]))
+        {
+            fFailed = true;
+            return;
+        }
+        ScanUndoFile(blocks_dir, nFile, chainparams, vScanned[nFile]);
+    });
+    if (fFailed)
+    {
+        LogError("%s: 扫描区块文件失败\n", __func__);
+        return false;
+    }
+    const int64_t nScanned = GetTimeMillis().count();
+
+    // 按 hashPrevBlock 连接; 同一区块存了两份时保留编号较小的文件中的那份
+    size_t nFound = 0, nBadRecords = 0;
+    for (const CScannedFile& scanned : vScanned)
+    {
+        nFound += scanned.vBlocks.size();
+        nBadRecords += scanned.nBadRecords;
+    }
+    CBlockIndexMap mapBlockIndex;
+    mapBlockIndex.Reserve(nFound);
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<uint256> vHashPrev; // CBlockIndex 不保存 hashPrevBlock, 连接前单独保存
+    vIndex.reserve(nFound);
+    vHashPrev.reserve(nFound);
+    for (int nFile = 0; nFile < nFiles; nFile++)
+    {
+        for (const CFoundBlock& found : vScanned[nFile].vBlocks)
+        {
+            bool fInserted = false;
+            CBlockIndex* pindex = mapBlockIndex.Insert(found.hash, &fInserted);
+            if (!fInserted)
+                continue;
+            pindex->nVersion = found.header.nVersion;
+            pindex->hashMerkleRoot = found.header.hashMerkleRoot;
+            pindex->nTime = found.header.nTime;
+            pindex->nBits = found.header.nBits;
+            pindex->nNonce = found.header.nNonce;
+            pindex->nFile = nFile;
+            pindex->nDataPos = found.nDataPos;
+            pindex->nTx = found.nTx;
+            pindex->nHeight = -1;
+            pindex->nStatus |= BLOCK_HAVE_DATA;
+            pindex->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
+            if (found.nUndoPos || found.hash == chainparams.GetConsensus().hashGenesisBlock)
+            {
+                // 有 undo 数据说明该区块曾被连接到主链上; 创世块没有 undo 数据, 但总是已连接的
+                if (found.nUndoPos)
+                {
+                    pindex->nUndoPos = found.nUndoPos;
+                    pindex->nStatus |= BLOCK_HAVE_UNDO;
+                }
+                pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            }
+            vIndex.push_back(pindex);
+            vHashPrev.push_back(found.header.hashPrevBlock);
+        }
+        std::vector<CFoundBlock>().swap(vScanned[nFile].vBlocks);
+    }
+
+    const uint256& hashGenesis = chainparams.GetConsensus().hashGenesisBlock;
+    for (size_t i = 0; i < vIndex.size(); i++)
+    {
+        if (*vIndex[i]->phashBlock != hashGenesis)
+            vIndex[i]->pprev = mapBlockIndex.Find(vHashPrev[i]);
+    }
+    // 计算高度: 沿 pprev 向上找到已知高度的祖先后再向下赋值; 追溯不到创世块的区块高度记为 -2 并丢弃
+    std::vector<CBlockIndex*> vPath;
+    for (CBlockIndex* pindex : vIndex)
+    {
+        CBlockIndex* pwalk = pindex;
+        while (pwalk->nHeight == -1 && pwalk->pprev)
+        {
+            vPath.push_back(pwalk);
+            pwalk = pwalk->pprev;
+        }
+        if (pwalk->nHeight == -1)
+            pwalk->nHeight = *pwalk->phashBlock == hashGenesis ? 0 : -2;
+        for (auto it = vPath.rbegin(); it != vPath.rend(); ++it)
+            (*it)->nHeight = (*it)->pprev->nHeight < 0 ? -2 : (*it)->pprev->nHeight + 1;
+        vPath.clear();
+    }
+
+    std::vector<CBlockFileInfo> vInfo(nFiles);
+    std::vector<const CBlockIndex*> vLinked;
+    vLinked.reserve(vIndex.size());
+    for (const CBlockIndex* pindex : vIndex)
+    {
+        if (pindex->nHeight < 0)
+            continue;
+        vInfo[pindex->nFile].AddBlock(pindex->nHeight, pindex->nTime);
+        vLinked.push_back(pindex);
+    }
+    for (int nFile = 0; nFile < nFiles; nFile++)
+    {
+        vInfo[nFile].nSize = vScanned[nFile].nSize;
+        vInfo[nFile].nUndoSize = vScanned[nFile].nUndoSize;
+    }
+
+    // 分批写入; 文件信息放在最后一批, 中途中断时 DB_REINDEX_FLAG 仍然存在
+    const size_t nBatchSize = std::max(options.nBatchSize, 1);
+    std::vector<std::pair<int, const CBlockFileInfo*>> vFiles;
+    for (int nFile = 0; nFile < nFiles; nFile++)
+        vFiles.emplace_back(nFile, &vInfo[nFile]);
+    for (size_t nPos = 0; nPos == 0 || nPos < vLinked.size(); nPos += nBatchSize)
+    {
+        if (ShutdownRequested())
+            return false;
+        const size_t nEnd = std::min(nPos + nBatchSize, vLinked.size());
+        const bool fLast = nEnd == vLinked.size();
+        const std::vector<const CBlockIndex*> vBatch(vLinked.begin() + nPos, vLinked.begin() + nEnd);
+        if (!blocktree.WriteBatchSync(fLast ? vFiles : std::vector<std::pair<int, const CBlockFileInfo*>>(), nFiles - 1, vBatch))
+        {
+            LogError("%s: 写入区块索引失败\n", __func__);
+            return false;
+        }
+    }
+    if (!blocktree.WriteReindexing(false))
+        return false;
+
+    size_t nUndo = 0;
+    for (const CBlockIndex* pindex : vLinked)
+        nUndo += (pindex->nStatus & BLOCK_HAVE_UNDO) != 0;
+    LogInfo("%s: %d 个区块文件, %lu 个区块(%lu 个有 undo 数据), 丢弃 %lu 个无法连接到创世块的区块和 %lu 条无效记录, 扫描 %ld ms, 共 %ld ms\n",
+           __func__, nFiles, (unsigned long)vLinked.size(), (unsigned long)nUndo, (unsigned long)(vIndex.size() - vLinked.size()),
+           (unsigned long)nBadRecords, (long)(nScanned - nStart), (long)(GetTimeMillis().count() - nStart));
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef BLOCKCHAIN_REINDEX_H
+#define BLOCKCHAIN_REINDEX_H
+#include <string>
+#include "chainparams.h"
+
+class CBlockTreeDB;
+
+//! Block index entries written per CDBBatch while reindexing
+static const int DEFAULT_REINDEX_BATCH_SIZE = 50000;
+
+struct ReindexOptions
+{
+    //! files scanned at once on GetScheduler(), 0 = the scheduler's concurrency
+    int nThreads = 0;
+    //! see DEFAULT_REINDEX_BATCH_SIZE
+    int nBatchSize = DEFAULT_REINDEX_BATCH_SIZE;
+};
+
+/**
+ * Rebuild the block index database from the blk?????.dat files in blocks_dir, for when
+ * blocks/index is missing or corrupt. blocktree should have been opened with fWipe.
+ *
+ * Every file is scanned by one worker with a CBufferedFile, resynchronizing on
+ * MessageStart() like bitcoind's LoadExternalBlockFile. Each block is parsed in place
+ * (CBlockView) and its merkle root checked; the headers of a file are then hashed in one
+ * batch and checked against their nBits. The matching rev?????.dat file is scanned too, and an
+ * undo record is attributed to a block of that file when its checksum (which covers the
+ * previous block hash) matches, so blocks that had been connected keep BLOCK_HAVE_UNDO.
+ *
+ * Afterwards the blocks are linked by hashPrevBlock on one thread; blocks that do not lead
+ * back to the genesis block are dropped. The entries and CBlockFileInfo records are written
+ * in CDBBatch batches of options.nBatchSize. The DB_REINDEX_FLAG is set until the last batch
+ * has been written.
+ */
+bool ReindexBlockFiles(const CChainParams& chainparams, const std::string& blocks_dir, CBlockTreeDB& blocktree, const ReindexOptions& options = ReindexOptions());
+
+#endif
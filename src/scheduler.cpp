@@ -0,0 +1,237 @@
+#include "scheduler.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include "logging.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace
+{
+//! how long a waiting thread with nothing to run sleeps before looking for queued tasks again
+const std::chrono::milliseconds GROUP_WAIT_INTERVAL{1};
+
+//! the scheduler whose worker the calling thread is, and the worker's index
+thread_local const CTaskScheduler* t_scheduler = nullptr;
+thread_local size_t t_worker = 0;
+//! group of the task the calling thread is running, the parent of groups it creates
+thread_local const CTaskGroup* t_group = nullptr;
+
+CMetricCounter& TasksMetric()
+{
+    static CMetricCounter& counter = Metrics().Counter("blockchain_scheduler_tasks_total", "Tasks run by the task scheduler");
+    return counter;
+}
+
+CMetricCounter& StealsMetric()
+{
+    static CMetricCounter& counter = Metrics().Counter("blockchain_scheduler_steals_total", "Tasks taken from another worker's deque");
+    return counter;
+}
+
+std::mutex g_scheduler_mutex;
+SchedulerOptions g_scheduler_options;
+CTaskScheduler* g_scheduler = nullptr;
+} // namespace
+
+CTaskScheduler::CTaskScheduler(const SchedulerOptions& options)
+    : m_concurrency(options.nThreads > 0 ? options.nThreads : std::max(1u, std::thread::hardware_concurrency()))
+{
+    const size_t nThreads = m_concurrency - 1;
+    for (size_t i = 0; i < std::max<size_t>(nThreads, 1); i++)
+        m_workers.emplace_back(new Worker());
+    for (size_t i = 0; i < nThreads; i++)
+        m_threads.emplace_back(&CTaskScheduler::WorkerMain, this, i, options.fPinThreads);
+}
+
+CTaskScheduler::~CTaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}
+
+void CTaskScheduler::Submit(std::function<void()> fn, CTaskGroup* group)
+{
+    // hzx 工作线程提交到自己的队列尾部, 其他线程轮流提交到各个队列
+    const size_t nWorker = t_scheduler == this ? t_worker : m_next_worker++ % m_workers.size();
+    {
+        Worker& worker = *m_workers[nWorker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(Task{std::move(fn), group});
+    }
+    m_queued++;
+    // 先取得 m_sleep_mutex: 正在检查 m_queued 准备睡眠的线程不会错过这次通知
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+    m_cond.notify_one();
+}
+
+bool CTaskScheduler::Pop(size_t nWorker, bool fOwn, const CTaskGroup* pgroup, Task& task)
+{
+    Worker& worker = *m_workers[nWorker];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    // 自己的队列从尾部取(最近提交, 数据还在缓存中), 窃取从头部取
+    // 指定了 pgroup 时跳过不属于它(及其子孙组)的任务
+    std::deque<Task>::iterator it = worker.tasks.end();
+    if (fOwn)
+    {
+        for (auto rit = worker.tasks.rbegin(); rit != worker.tasks.rend(); ++rit)
+        {
+            if (!pgroup || rit->group->IsWithin(pgroup))
+            {
+                it = std::prev(rit.base());
+                break;
+            }
+        }
+    }
+    else
+    {
+        it = pgroup ? std::find_if(worker.tasks.begin(), worker.tasks.end(), [&](const Task& t) { return t.group->IsWithin(pgroup); }) : worker.tasks.begin();
+    }
+    if (it == worker.tasks.end())
+        return false;
+    task = std::move(*it);
+    worker.tasks.erase(it);
+    m_queued--;
+    return true;
+}
+
+bool CTaskScheduler::RunOne(const CTaskGroup* pgroup)
+{
+    if (m_queued.load(std::memory_order_relaxed) <= 0)
+        return false;
+    const bool fWorker = t_scheduler == this;
+    const size_t nSelf = fWorker ? t_worker : m_next_worker.load(std::memory_order_relaxed) % m_workers.size();
+    Task task;
+    bool fFound = fWorker && Pop(nSelf, true, pgroup, task);
+    for (size_t i = fWorker ? 1 : 0; !fFound && i < m_workers.size(); i++)
+    {
+        fFound = Pop((nSelf + i) % m_workers.size(), false, pgroup, task);
+        if (fFound && fWorker)
+            StealsMetric().Add();
+    }
+    if (!fFound)
+        return false;
+    TasksMetric().Add();
+    // 任务抛出的异常交给所属的组, 由等待该组的线程重新抛出; 不能让它离开工作线程
+    std::exception_ptr exception;
+    const CTaskGroup* const pouter = t_group;
+    t_group = task.group;
+    try
+    {
+        task.fn();
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+    t_group = pouter;
+    task.group->Done(std::move(exception));
+    return true;
+}
+
+void CTaskScheduler::WorkerMain(size_t nWorker, bool fPin)
+{
+    t_scheduler = this;
+    t_worker = nWorker;
+    if (fPin)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET((nWorker + 1) % std::max(1u, std::thread::hardware_concurrency()), &cpuset);
+        const int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (ret != 0)
+            LogWarning("%s: 工作线程 %lu 无法绑定 CPU: %s\n", __func__, (unsigned long)nWorker, strerror(ret));
+    }
+    TraceThreadName("worker");
+    while (true)
+    {
+        if (RunOne())
+            continue;
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_cond.wait(lock, [&] { return m_stop || m_queued.load() > 0; });
+        if (m_stop)
+            return;
+    }
+}
+
+CTaskScheduler& GetScheduler()
+{
+    std::lock_guard<std::mutex> lock(g_scheduler_mutex);
+    // hzx 与 Metrics() 相同, 有意不释放: 工作线程在退出时仍在等待任务
+    if (!g_scheduler)
+        g_scheduler = new CTaskScheduler(g_scheduler_options);
+    return *g_scheduler;
+}
+
+bool InitScheduler(const SchedulerOptions& options)
+{
+    std::lock_guard<std::mutex> lock(g_scheduler_mutex);
+    if (g_scheduler)
+        return false;
+    g_scheduler_options = options;
+    return true;
+}
+
+CTaskGroup::CTaskGroup(CTaskScheduler& scheduler) : m_scheduler(scheduler), m_parent(t_group)
+{
+}
+
+bool CTaskGroup::IsWithin(const CTaskGroup* pgroup) const
+{
+    for (const CTaskGroup* p = this; p; p = p->m_parent)
+    {
+        if (p == pgroup)
+            return true;
+    }
+    return false;
+}
+
+void CTaskGroup::Run(std::function<void()> fn)
+{
+    m_pending++;
+    m_scheduler.Submit(std::move(fn), this);
+}
+
+void CTaskGroup::Done(std::exception_ptr exception)
+{
+    // 在锁内减少计数并通知: Wait 返回(随后可能销毁本对象)之前必须先取得这把锁
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (exception && !m_exception)
+        m_exception = std::move(exception);
+    if (--m_pending == 0)
+        m_cond.notify_all();
+}
+
+void CTaskGroup::Wait()
+{
+    while (true)
+    {
+        if (m_pending.load() == 0)
+        {
+            std::exception_ptr exception;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::swap(exception, m_exception);
+            }
+            if (exception)
+                std::rethrow_exception(exception);
+            return;
+        }
+        // hzx 只运行本组及其子孙组的任务: 其他组的任务可能等待本线程栈上的调用者(例如有序扫描的交付), 形成死锁
+        if (m_scheduler.RunOne(this))
+            continue;
+        // 没有可运行的任务: 本组剩下的任务正在其他线程上运行, 或刚刚提交
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, GROUP_WAIT_INTERVAL, [&] { return m_pending.load() == 0; });
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef BLOCKCHAIN_SCHEDULER_H
+#define BLOCKCHAIN_SCHEDULER_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CTaskGroup;
+
+struct SchedulerOptions
+{
+    //! threads running tasks, counting the thread that waits for them; 0 for one per core
+    int nThreads = 0;
+    //! pin worker i to core i + 1 (the waiting thread usually runs on core 0); Linux only
+    bool fPinThreads = false;
+};
+
+/**
+ * Work-stealing thread pool shared by everything that runs in parallel (loading the block
+ * index, linking it, scanning and verifying blocks, reindexing), so that one parallel stage
+ * running inside another does not start a second set of threads per core.
+ *
+ * Every worker owns a deque: tasks it submits go to the back of its own deque and it takes
+ * work from the back (the most recent, still in cache), while idle workers steal from the
+ * front of the others. Tasks submitted from other threads are spread over the deques round
+ * robin. A thread waiting for a CTaskGroup runs queued tasks of that group (or of groups
+ * started by its tasks) instead of sleeping, which is why the pool starts one worker less
+ * than its concurrency, and why a task may itself start and wait for a group. Tasks may
+ * block (e.g. on a lock or the ordered scan's window) as long as what they wait for is
+ * already running, never for a task that is still queued.
+ */
+class CTaskScheduler
+{
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        CTaskGroup* group;
+    };
+
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    const int m_concurrency;
+    //! one deque per worker thread, and one even if there is no worker thread
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_next_worker{0};
+
+    //! tasks in all deques; idle workers sleep while it is 0
+    std::atomic<int64_t> m_queued{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_cond;
+    bool m_stop = false;
+
+    bool Pop(size_t nWorker, bool fOwn, const CTaskGroup* pgroup, Task& task);
+    void WorkerMain(size_t nWorker, bool fPin);
+
+    friend class CTaskGroup;
+    void Submit(std::function<void()> fn, CTaskGroup* group);
+
+public:
+    explicit CTaskScheduler(const SchedulerOptions& options = SchedulerOptions());
+    ~CTaskScheduler();
+
+    CTaskScheduler(const CTaskScheduler&) = delete;
+    CTaskScheduler& operator=(const CTaskScheduler&) = delete;
+
+    //! worker threads plus one waiting thread
+    int GetConcurrency() const { return m_concurrency; }
+
+    /**
+     * Run one queued task on the calling thread; false if there was none. With pgroup, only
+     * a task of pgroup or of a group started inside one of its tasks is run.
+     */
+    bool RunOne(const CTaskGroup* pgroup = nullptr);
+};
+
+/**
+ * The process-wide scheduler. It is created on first use with the options given to
+ * InitScheduler, or the defaults, and deliberately never destroyed.
+ */
+CTaskScheduler& GetScheduler();
+
+/** Set the options of GetScheduler(); false if it has already been created. */
+bool InitScheduler(const SchedulerOptions& options);
+
+/**
+ * Tasks that are waited for together. Run() queues a task on the scheduler and Wait()
+ * returns once every task run through the group has finished, running queued tasks of the
+ * group on the calling thread meanwhile. A group created inside a task is a child of that
+ * task's group, and waiting for a group also runs the tasks of its descendants, but never
+ * those of unrelated groups: the waiting thread still has its caller's frames on the stack,
+ * and a foreign task (e.g. another file of an ordered scan whose visitor is waiting here)
+ * could block on exactly those frames. Groups must therefore not outlive the task that
+ * created them. An exception thrown by a task does not leave the
+ * thread that ran it: the first one is kept and Wait() rethrows it once every task has
+ * finished. The destructor waits as well, but drops the exception instead of throwing.
+ */
+class CTaskGroup
+{
+private:
+    CTaskScheduler& m_scheduler;
+    //! group of the task that was running on the creating thread, if any
+    const CTaskGroup* const m_parent;
+    std::atomic<size_t> m_pending{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! first exception thrown by a task, guarded by m_mutex
+    std::exception_ptr m_exception;
+
+    friend class CTaskScheduler;
+    void Done(std::exception_ptr exception);
+    //! whether this group is pgroup or one of its descendants
+    bool IsWithin(const CTaskGroup* pgroup) const;
+
+public:
+    explicit CTaskGroup(CTaskScheduler& scheduler = GetScheduler());
+    ~CTaskGroup()
+    {
+        // hzx 析构时只等待: 异常已由调用者的 Wait 取走, 或者调用者正因另一个异常退出
+        try
+        {
+            Wait();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    CTaskGroup(const CTaskGroup&) = delete;
+    CTaskGroup& operator=(const CTaskGroup&) = delete;
+
+    void Run(std::function<void()> fn);
+    void Wait();
+};
+
+/**
+ * Call fn(i) for every i in [0, nCount), on at most nMaxThreads threads at once (0 for the
+ * scheduler's concurrency) including the calling thread. Indexes are handed out one at a
+ * time from a shared counter, so items of uneven cost balance themselves. If fn throws, the
+ * indexes not yet handed out are skipped and the exception is rethrown once every call that
+ * had started has returned.
+ */
+template <typename F>
+void ParallelFor(size_t nCount, int nMaxThreads, const F& fn)
+{
+    CTaskScheduler& scheduler = GetScheduler();
+    if (nMaxThreads <= 0)
+        nMaxThreads = scheduler.GetConcurrency();
+    std::atomic<size_t> nNext{0};
+    auto worker = [&] {
+        try
+        {
+            for (size_t i = nNext++; i < nCount; i = nNext++)
+                fn(i);
+        }
+        catch (...)
+        {
+            nNext = nCount;
+            throw;
+        }
+    };
+    CTaskGroup group(scheduler);
+    for (size_t i = 1; i < std::min((size_t)nMaxThreads, nCount); i++)
+        group.Run(worker);
+    worker();
+    group.Wait();
+}
+
+#endif
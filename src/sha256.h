@@ -21,10 +21,23 @@ public:
     CSHA256& Reset();
 };
 
-/** Autodetect the best available SHA256 implementation.
+namespace sha256_implementation {
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SSE4 = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_SHANI = 1 << 2,
+    USE_SSE4_AND_AVX2 = USE_SSE4 | USE_AVX2,
+    USE_SSE4_AND_SHANI = USE_SSE4 | USE_SHANI,
+    USE_ALL = USE_SSE4 | USE_AVX2 | USE_SHANI,
+};
+}
+
+/** Autodetect the best available SHA256 implementation, restricted to use_implementation.
+ *  May be called again to switch implementations (e.g. from the benchmarks).
  *  Returns the name of the implementation.
  */
-std::string SHA256AutoDetect();
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation = sha256_implementation::USE_ALL);
 
 /** Compute multiple double-SHA256's of 64-byte blobs.
  *  output:  pointer to a blocks*32 byte output buffer
@@ -33,4 +46,13 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute the double-SHA256 of many messages of arbitrary length at once.
+ *  The messages are hashed side by side in the lanes of the selected multi-lane
+ *  transform; messages of similar length are grouped so the lanes stay busy.
+ *  output:  pointer to a count*32 byte output buffer, hash i at output + 32*i
+ *  inputs:  the count message pointers
+ *  lengths: the count message lengths in bytes
+ */
+void SHA256DBatch(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 8-way SHA256 on AVX2: every 256-bit register holds the same word of 8 independent messages.
+
+#include "bitcoin-config.h"
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+namespace sha256d64_avx2
+{
+namespace
+{
+
+AVX2_TARGET __m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+AVX2_TARGET __m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+AVX2_TARGET __m256i inline Inc(__m256i& x, __m256i y) { x = Add(x, y); return x; }
+AVX2_TARGET __m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+AVX2_TARGET __m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+AVX2_TARGET __m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+AVX2_TARGET __m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+AVX2_TARGET __m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+AVX2_TARGET __m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+
+AVX2_TARGET __m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+AVX2_TARGET __m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+AVX2_TARGET __m256i inline Sigma0(__m256i x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+AVX2_TARGET __m256i inline Sigma1(__m256i x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+AVX2_TARGET __m256i inline sigma0(__m256i x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+AVX2_TARGET __m256i inline sigma1(__m256i x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+};
+
+/** One round; the caller rotates the roles of a..h instead of moving the values. */
+AVX2_TARGET void inline Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i k)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Eight rounds starting at round j, with message words w[j & 15 ..]. */
+AVX2_TARGET void inline Round8(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i& e, __m256i& f, __m256i& g, __m256i& h, const __m256i* w, int j)
+{
+    Round(a, b, c, d, e, f, g, h, Add(K(ROUND_K[j + 0]), w[(j + 0) & 15]));
+    Round(h, a, b, c, d, e, f, g, Add(K(ROUND_K[j + 1]), w[(j + 1) & 15]));
+    Round(g, h, a, b, c, d, e, f, Add(K(ROUND_K[j + 2]), w[(j + 2) & 15]));
+    Round(f, g, h, a, b, c, d, e, Add(K(ROUND_K[j + 3]), w[(j + 3) & 15]));
+    Round(e, f, g, h, a, b, c, d, Add(K(ROUND_K[j + 4]), w[(j + 4) & 15]));
+    Round(d, e, f, g, h, a, b, c, Add(K(ROUND_K[j + 5]), w[(j + 5) & 15]));
+    Round(c, d, e, f, g, h, a, b, Add(K(ROUND_K[j + 6]), w[(j + 6) & 15]));
+    Round(b, c, d, e, f, g, h, a, Add(K(ROUND_K[j + 7]), w[(j + 7) & 15]));
+}
+
+/** Run the 64 rounds over the message words w (which are overwritten by the schedule), adding the result into s. */
+AVX2_TARGET void inline Rounds(__m256i* s, __m256i* w)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    Round8(a, b, c, d, e, f, g, h, w, 0);
+    Round8(a, b, c, d, e, f, g, h, w, 8);
+    for (int j = 16; j < 64; j += 16) {
+        for (int i = 0; i < 16; ++i)
+            Inc(w[i], Add(sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15])));
+        Round8(a, b, c, d, e, f, g, h, w, j);
+        Round8(a, b, c, d, e, f, g, h, w, j + 8);
+    }
+    Inc(s[0], a);
+    Inc(s[1], b);
+    Inc(s[2], c);
+    Inc(s[3], d);
+    Inc(s[4], e);
+    Inc(s[5], f);
+    Inc(s[6], g);
+    Inc(s[7], h);
+}
+
+AVX2_TARGET uint32_t inline BSwap(uint32_t x) { return __builtin_bswap32(x); }
+
+/** Load big-endian word j of the eight 64-byte chunks. */
+AVX2_TARGET __m256i inline Read8(const unsigned char* const* chunks, int j)
+{
+    uint32_t v[8];
+    for (int l = 0; l < 8; ++l) {
+        uint32_t x;
+        __builtin_memcpy(&x, chunks[l] + 4 * j, 4);
+        v[l] = BSwap(x);
+    }
+    return _mm256_set_epi32(v[7], v[6], v[5], v[4], v[3], v[2], v[1], v[0]);
+}
+
+AVX2_TARGET void inline Write8(unsigned char* out, int offset, __m256i v)
+{
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    v = _mm256_shuffle_epi8(v, bswap);
+    uint32_t w[8];
+    _mm256_storeu_si256((__m256i*)w, v);
+    for (int l = 0; l < 8; ++l)
+        __builtin_memcpy(out + 32 * l + offset, &w[l], 4);
+}
+
+AVX2_TARGET void inline Initialize(__m256i* s)
+{
+    for (int i = 0; i < 8; ++i)
+        s[i] = K(INIT[i]);
+}
+
+} // namespace
+
+AVX2_TARGET void TransformLanes_8way(uint32_t* state, const unsigned char* const* chunks)
+{
+    __m256i s[8], w[16];
+    for (int i = 0; i < 8; ++i)
+        s[i] = _mm256_loadu_si256((const __m256i*)(state + 8 * i));
+    for (int j = 0; j < 16; ++j)
+        w[j] = Read8(chunks, j);
+    Rounds(s, w);
+    for (int i = 0; i < 8; ++i)
+        _mm256_storeu_si256((__m256i*)(state + 8 * i), s[i]);
+}
+
+AVX2_TARGET void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], t[8], w[16];
+    const unsigned char* chunks[8] = {in, in + 64, in + 128, in + 192, in + 256, in + 320, in + 384, in + 448};
+
+    // Transform 1: the 64-byte messages
+    Initialize(s);
+    for (int j = 0; j < 16; ++j)
+        w[j] = Read8(chunks, j);
+    Rounds(s, w);
+
+    // Transform 2: padding of a 64-byte message
+    w[0] = K(0x80000000ul);
+    for (int j = 1; j < 15; ++j)
+        w[j] = K(0);
+    w[15] = K(0x200ul);
+    Rounds(s, w);
+
+    // Transform 3: the 32-byte first hashes, padded
+    for (int j = 0; j < 8; ++j)
+        w[j] = s[j];
+    w[8] = K(0x80000000ul);
+    for (int j = 9; j < 15; ++j)
+        w[j] = K(0);
+    w[15] = K(0x100ul);
+    Initialize(t);
+    Rounds(t, w);
+
+    for (int i = 0; i < 8; ++i)
+        Write8(out, 4 * i, t[i]);
+}
+
+} // namespace sha256d64_avx2
+
+#endif
@@ -0,0 +1,228 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA256 using the Intel SHA extensions. The state is kept as ABEF/CDGH, the layout sha256rnds2 works on.
+
+#include "bitcoin-config.h"
+
+#if defined(ENABLE_SHANI) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define SHANI_TARGET __attribute__((target("sse4.1,sha")))
+
+namespace
+{
+
+alignas(__m128i) const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+alignas(__m128i) const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+};
+
+SHANI_TARGET __m128i inline ByteSwapMask() { return _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3); }
+
+/** Four rounds with message words m (k is the index of the first round). */
+SHANI_TARGET void inline QuadRound(__m128i& state0, __m128i& state1, __m128i m, int k)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(ROUND_K + k)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** m0 += sigma0 part of the schedule for the vector 4 positions ahead. */
+SHANI_TARGET void inline ShiftMessageA(__m128i& m0, __m128i m1) { m0 = _mm_sha256msg1_epu32(m0, m1); }
+
+/** Finish the next message vector in m2 from m0, m1 and the partial value already in m2. */
+SHANI_TARGET void inline ShiftMessageC(__m128i m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+SHANI_TARGET void inline ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/** DCBA/HGFE -> ABEF/CDGH */
+SHANI_TARGET void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** ABEF/CDGH -> DCBA/HGFE */
+SHANI_TARGET void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+SHANI_TARGET __m128i inline Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), ByteSwapMask());
+}
+
+SHANI_TARGET void inline Save(unsigned char* out, __m128i s)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, ByteSwapMask()));
+}
+
+/** All 64 rounds over the 16 message words in m0..m3 (which are clobbered). */
+SHANI_TARGET void inline Rounds(__m128i& s0, __m128i& s1, __m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    QuadRound(s0, s1, m0, 0);
+    QuadRound(s0, s1, m1, 4);
+    ShiftMessageA(m0, m1);
+    QuadRound(s0, s1, m2, 8);
+    ShiftMessageA(m1, m2);
+    QuadRound(s0, s1, m3, 12);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 16);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 20);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 24);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 28);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 32);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 36);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 40);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 44);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 48);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 52);
+    ShiftMessageC(m0, m1, m2);
+    QuadRound(s0, s1, m2, 56);
+    ShiftMessageC(m1, m2, m3);
+    QuadRound(s0, s1, m3, 60);
+}
+
+/** Rounds() for two independent states, interleaved so both dependency chains are in flight. */
+SHANI_TARGET void inline Rounds2(__m128i* s0, __m128i* s1, __m128i* m0, __m128i* m1, __m128i* m2, __m128i* m3)
+{
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m0[i], 0); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m1[i], 4); ShiftMessageA(m0[i], m1[i]); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m2[i], 8); ShiftMessageA(m1[i], m2[i]); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m3[i], 12); ShiftMessageB(m2[i], m3[i], m0[i]); }
+    for (int r = 16; r < 48; r += 16) {
+        for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m0[i], r); ShiftMessageB(m3[i], m0[i], m1[i]); }
+        for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m1[i], r + 4); ShiftMessageB(m0[i], m1[i], m2[i]); }
+        for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m2[i], r + 8); ShiftMessageB(m1[i], m2[i], m3[i]); }
+        for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m3[i], r + 12); ShiftMessageB(m2[i], m3[i], m0[i]); }
+    }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m0[i], 48); ShiftMessageB(m3[i], m0[i], m1[i]); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m1[i], 52); ShiftMessageC(m0[i], m1[i], m2[i]); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m2[i], 56); ShiftMessageC(m1[i], m2[i], m3[i]); }
+    for (int i = 0; i < 2; ++i) { QuadRound(s0[i], s1[i], m3[i], 60); }
+}
+
+SHANI_TARGET void inline InitState(__m128i& s0, __m128i& s1)
+{
+    s0 = _mm_load_si128((const __m128i*)INIT);
+    s1 = _mm_load_si128((const __m128i*)(INIT + 4));
+    Shuffle(s0, s1);
+}
+
+} // namespace
+
+namespace sha256_shani
+{
+SHANI_TARGET void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        const __m128i so0 = s0, so1 = s1;
+        Rounds(s0, s1, Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48));
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani
+{
+SHANI_TARGET void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s0[2], s1[2], so0[2], so1[2], m0[2], m1[2], m2[2], m3[2];
+
+    // Transform 1: the two 64-byte messages
+    for (int i = 0; i < 2; ++i) {
+        InitState(s0[i], s1[i]);
+        so0[i] = s0[i];
+        so1[i] = s1[i];
+        m0[i] = Load(in + 64 * i);
+        m1[i] = Load(in + 64 * i + 16);
+        m2[i] = Load(in + 64 * i + 32);
+        m3[i] = Load(in + 64 * i + 48);
+    }
+    Rounds2(s0, s1, m0, m1, m2, m3);
+
+    // Transform 2: padding of a 64-byte message
+    for (int i = 0; i < 2; ++i) {
+        s0[i] = _mm_add_epi32(s0[i], so0[i]);
+        s1[i] = _mm_add_epi32(s1[i], so1[i]);
+        so0[i] = s0[i];
+        so1[i] = s1[i];
+        m0[i] = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+        m1[i] = _mm_setzero_si128();
+        m2[i] = _mm_setzero_si128();
+        m3[i] = _mm_set_epi32(0x200ul, 0, 0, 0);
+    }
+    Rounds2(s0, s1, m0, m1, m2, m3);
+
+    // Transform 3: the 32-byte first hashes, padded
+    for (int i = 0; i < 2; ++i) {
+        s0[i] = _mm_add_epi32(s0[i], so0[i]);
+        s1[i] = _mm_add_epi32(s1[i], so1[i]);
+        Unshuffle(s0[i], s1[i]);
+        m0[i] = s0[i];
+        m1[i] = s1[i];
+        m2[i] = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+        m3[i] = _mm_set_epi32(0x100ul, 0, 0, 0);
+        InitState(s0[i], s1[i]);
+        so0[i] = s0[i];
+        so1[i] = s1[i];
+    }
+    Rounds2(s0, s1, m0, m1, m2, m3);
+
+    for (int i = 0; i < 2; ++i) {
+        s0[i] = _mm_add_epi32(s0[i], so0[i]);
+        s1[i] = _mm_add_epi32(s1[i], so1[i]);
+        Unshuffle(s0[i], s1[i]);
+        Save(out + 32 * i, s0[i]);
+        Save(out + 32 * i + 16, s1[i]);
+    }
+}
+} // namespace sha256d64_shani
+
+#endif
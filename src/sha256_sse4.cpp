@@ -0,0 +1,107 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Single-message SHA256 for SSE4 CPUs: the message schedule is computed four words at a time
+// in SSE registers (as in Intel's sha256_sse4 code), the rounds run on scalar registers.
+
+#include "bitcoin-config.h"
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+#define SSE4_TARGET __attribute__((target("sse4.1")))
+
+namespace
+{
+
+alignas(__m128i) const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+SSE4_TARGET __m128i inline RotR(__m128i x, int n) { return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+SSE4_TARGET __m128i inline sigma0(__m128i x) { return _mm_xor_si128(_mm_xor_si128(RotR(x, 7), RotR(x, 18)), _mm_srli_epi32(x, 3)); }
+SSE4_TARGET __m128i inline sigma1(__m128i x) { return _mm_xor_si128(_mm_xor_si128(RotR(x, 17), RotR(x, 19)), _mm_srli_epi32(x, 10)); }
+
+/** Given W[t-16..t-1] in w0..w3, return W[t..t+3]. */
+SSE4_TARGET __m128i inline NextWords(__m128i w0, __m128i w1, __m128i w2, __m128i w3)
+{
+    const __m128i w15 = _mm_alignr_epi8(w1, w0, 4); // W[t-15..t-12]
+    const __m128i w7 = _mm_alignr_epi8(w3, w2, 4);  // W[t-7..t-4]
+    __m128i x = _mm_add_epi32(_mm_add_epi32(w0, sigma0(w15)), w7);
+    // W[t] and W[t+1] need sigma1 of W[t-2] and W[t-1], W[t+2] and W[t+3] of the two words just computed
+    x = _mm_add_epi32(x, _mm_move_epi64(sigma1(_mm_shuffle_epi32(w3, 0xFE))));
+    x = _mm_add_epi32(x, _mm_slli_si128(_mm_move_epi64(sigma1(x)), 8));
+    return x;
+}
+
+uint32_t inline Ch(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+uint32_t inline Maj(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); }
+uint32_t inline Sigma0(uint32_t x) { return (x >> 2 | x << 30) ^ (x >> 13 | x << 19) ^ (x >> 22 | x << 10); }
+uint32_t inline Sigma1(uint32_t x) { return (x >> 6 | x << 26) ^ (x >> 11 | x << 21) ^ (x >> 25 | x << 7); }
+
+} // namespace
+
+namespace sha256_sse4
+{
+SSE4_TARGET void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    alignas(__m128i) uint32_t wk[64];
+
+    while (blocks--) {
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)chunk), bswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), bswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), bswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), bswap);
+        // hzx 预先算好 W[t] + K[t], 轮函数只剩标量部分
+        _mm_store_si128((__m128i*)wk, _mm_add_epi32(w0, _mm_load_si128((const __m128i*)ROUND_K)));
+        _mm_store_si128((__m128i*)(wk + 4), _mm_add_epi32(w1, _mm_load_si128((const __m128i*)(ROUND_K + 4))));
+        _mm_store_si128((__m128i*)(wk + 8), _mm_add_epi32(w2, _mm_load_si128((const __m128i*)(ROUND_K + 8))));
+        _mm_store_si128((__m128i*)(wk + 12), _mm_add_epi32(w3, _mm_load_si128((const __m128i*)(ROUND_K + 12))));
+        for (int t = 16; t < 64; t += 4) {
+            const __m128i x = NextWords(w0, w1, w2, w3);
+            _mm_store_si128((__m128i*)(wk + t), _mm_add_epi32(x, _mm_load_si128((const __m128i*)(ROUND_K + t))));
+            w0 = w1;
+            w1 = w2;
+            w2 = w3;
+            w3 = x;
+        }
+
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; ++t) {
+            const uint32_t t1 = h + Sigma1(e) + Ch(e, f, g) + wk[t];
+            const uint32_t t2 = Sigma0(a) + Maj(a, b, c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+        s[5] += f;
+        s[6] += g;
+        s[7] += h;
+        chunk += 64;
+    }
+}
+} // namespace sha256_sse4
+
+#endif
@@ -0,0 +1,166 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way SHA256 on SSE4.1: every 128-bit register holds the same word of 4 independent messages.
+
+#include "bitcoin-config.h"
+
+#if defined(ENABLE_SSE41) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+
+namespace sha256d64_sse41
+{
+namespace
+{
+
+SSE41_TARGET __m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+
+SSE41_TARGET __m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+SSE41_TARGET __m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+SSE41_TARGET __m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+SSE41_TARGET __m128i inline Inc(__m128i& x, __m128i y) { x = Add(x, y); return x; }
+SSE41_TARGET __m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+SSE41_TARGET __m128i inline Xor(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+SSE41_TARGET __m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+SSE41_TARGET __m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+SSE41_TARGET __m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+SSE41_TARGET __m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+
+SSE41_TARGET __m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+SSE41_TARGET __m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+SSE41_TARGET __m128i inline Sigma0(__m128i x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+SSE41_TARGET __m128i inline Sigma1(__m128i x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+SSE41_TARGET __m128i inline sigma0(__m128i x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+SSE41_TARGET __m128i inline sigma1(__m128i x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+const uint32_t ROUND_K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+};
+
+/** One round; the caller rotates the roles of a..h instead of moving the values. */
+SSE41_TARGET void inline Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Eight rounds starting at round j, with message words w[j & 15 ..]. */
+SSE41_TARGET void inline Round8(__m128i& a, __m128i& b, __m128i& c, __m128i& d, __m128i& e, __m128i& f, __m128i& g, __m128i& h, const __m128i* w, int j)
+{
+    Round(a, b, c, d, e, f, g, h, Add(K(ROUND_K[j + 0]), w[(j + 0) & 15]));
+    Round(h, a, b, c, d, e, f, g, Add(K(ROUND_K[j + 1]), w[(j + 1) & 15]));
+    Round(g, h, a, b, c, d, e, f, Add(K(ROUND_K[j + 2]), w[(j + 2) & 15]));
+    Round(f, g, h, a, b, c, d, e, Add(K(ROUND_K[j + 3]), w[(j + 3) & 15]));
+    Round(e, f, g, h, a, b, c, d, Add(K(ROUND_K[j + 4]), w[(j + 4) & 15]));
+    Round(d, e, f, g, h, a, b, c, Add(K(ROUND_K[j + 5]), w[(j + 5) & 15]));
+    Round(c, d, e, f, g, h, a, b, Add(K(ROUND_K[j + 6]), w[(j + 6) & 15]));
+    Round(b, c, d, e, f, g, h, a, Add(K(ROUND_K[j + 7]), w[(j + 7) & 15]));
+}
+
+/** Run the 64 rounds over the message words w (which are overwritten by the schedule), adding the result into s. */
+SSE41_TARGET void inline Rounds(__m128i* s, __m128i* w)
+{
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    Round8(a, b, c, d, e, f, g, h, w, 0);
+    Round8(a, b, c, d, e, f, g, h, w, 8);
+    for (int j = 16; j < 64; j += 16) {
+        for (int i = 0; i < 16; ++i)
+            Inc(w[i], Add(sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15])));
+        Round8(a, b, c, d, e, f, g, h, w, j);
+        Round8(a, b, c, d, e, f, g, h, w, j + 8);
+    }
+    Inc(s[0], a);
+    Inc(s[1], b);
+    Inc(s[2], c);
+    Inc(s[3], d);
+    Inc(s[4], e);
+    Inc(s[5], f);
+    Inc(s[6], g);
+    Inc(s[7], h);
+}
+
+SSE41_TARGET uint32_t inline BSwap(uint32_t x) { return __builtin_bswap32(x); }
+
+/** Load big-endian word j of the four 64-byte chunks. */
+SSE41_TARGET __m128i inline Read4(const unsigned char* const* chunks, int j)
+{
+    uint32_t v[4];
+    for (int l = 0; l < 4; ++l) {
+        uint32_t x;
+        __builtin_memcpy(&x, chunks[l] + 4 * j, 4);
+        v[l] = BSwap(x);
+    }
+    return _mm_set_epi32(v[3], v[2], v[1], v[0]);
+}
+
+SSE41_TARGET void inline Write4(unsigned char* out, int offset, __m128i v)
+{
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    v = _mm_shuffle_epi8(v, bswap);
+    uint32_t w[4];
+    _mm_storeu_si128((__m128i*)w, v);
+    for (int l = 0; l < 4; ++l)
+        __builtin_memcpy(out + 32 * l + offset, &w[l], 4);
+}
+
+SSE41_TARGET void inline Initialize(__m128i* s)
+{
+    for (int i = 0; i < 8; ++i)
+        s[i] = K(INIT[i]);
+}
+
+} // namespace
+
+SSE41_TARGET void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], t[8], w[16];
+    const unsigned char* chunks[4] = {in, in + 64, in + 128, in + 192};
+
+    // Transform 1: the 64-byte messages
+    Initialize(s);
+    for (int j = 0; j < 16; ++j)
+        w[j] = Read4(chunks, j);
+    Rounds(s, w);
+
+    // Transform 2: padding of a 64-byte message
+    w[0] = K(0x80000000ul);
+    for (int j = 1; j < 15; ++j)
+        w[j] = K(0);
+    w[15] = K(0x200ul);
+    Rounds(s, w);
+
+    // Transform 3: the 32-byte first hashes, padded
+    for (int j = 0; j < 8; ++j)
+        w[j] = s[j];
+    w[8] = K(0x80000000ul);
+    for (int j = 9; j < 15; ++j)
+        w[j] = K(0);
+    w[15] = K(0x100ul);
+    Initialize(t);
+    Rounds(t, w);
+
+    for (int i = 0; i < 8; ++i)
+        Write4(out, 4 * i, t[i]);
+}
+
+} // namespace sha256d64_sse41
+
+#endif
@@ -0,0 +1,207 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "logging.h"
+
+std::atomic<bool> g_trace_enabled{false};
+
+namespace
+{
+struct TraceEvent
+{
+    const char* name;
+    int64_t nStartNanos;
+    int64_t nDurationNanos;
+    int nHeight;
+    int nFile;
+};
+
+/** Spans of one thread not yet written; its mutex is only contended while the trace stops. */
+struct TraceBuffer
+{
+    std::mutex mutex;
+    uint32_t nTid;
+    std::vector<TraceEvent> vEvents;
+};
+
+/** The trace file and the buffers of every thread that recorded a span. */
+struct TraceWriter
+{
+    std::mutex mutex;
+    FILE* file = nullptr;
+    bool fFirstEvent = true;
+    std::chrono::steady_clock::time_point start;
+    uint32_t nNextTid = 1;
+    std::vector<std::shared_ptr<TraceBuffer>> vBuffers;
+
+    void WriteRecord(const char* record)
+    {
+        if (!file)
+            return;
+        if (!fFirstEvent)
+            fputs(",\n", file);
+        fFirstEvent = false;
+        fputs(record, file);
+    }
+
+    // 调用方持有 mutex
+    void WriteEvents(uint32_t nTid, const std::vector<TraceEvent>& vEvents)
+    {
+        char buf[256];
+        for (const TraceEvent& event : vEvents)
+        {
+            int n = snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"cat\":\"blockchain\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u", event.name,
+                             event.nStartNanos / 1000.0, event.nDurationNanos / 1000.0, nTid);
+            if (event.nHeight >= 0 || event.nFile >= 0)
+            {
+                n += snprintf(buf + n, sizeof(buf) - n, ",\"args\":{");
+                if (event.nHeight >= 0)
+                    n += snprintf(buf + n, sizeof(buf) - n, "\"height\":%d%s", event.nHeight, event.nFile >= 0 ? "," : "");
+                if (event.nFile >= 0)
+                    n += snprintf(buf + n, sizeof(buf) - n, "\"file\":%d", event.nFile);
+                n += snprintf(buf + n, sizeof(buf) - n, "}");
+            }
+            snprintf(buf + n, sizeof(buf) - n, "}");
+            WriteRecord(buf);
+        }
+    }
+};
+
+TraceWriter& GetTraceWriter()
+{
+    // hzx 与 LogInstance 相同, 有意不释放: 线程退出时的析构函数仍要写入
+    static TraceWriter* g_writer = new TraceWriter();
+    return *g_writer;
+}
+
+/** Holds the calling thread's buffer and writes what is left of it when the thread exits. */
+struct CLocalTraceBuffer
+{
+    std::shared_ptr<TraceBuffer> buffer;
+    ~CLocalTraceBuffer();
+};
+thread_local CLocalTraceBuffer t_buffer;
+
+TraceBuffer& LocalTraceBuffer()
+{
+    if (!t_buffer.buffer)
+    {
+        std::shared_ptr<TraceBuffer> buffer = std::make_shared<TraceBuffer>();
+        buffer->vEvents.reserve(TRACE_BUFFER_EVENTS);
+        TraceWriter& writer = GetTraceWriter();
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        buffer->nTid = writer.nNextTid++;
+        writer.vBuffers.push_back(buffer);
+        t_buffer.buffer = std::move(buffer);
+    }
+    return *t_buffer.buffer;
+}
+
+// 取走 buffer 中的事件写入文件; 写文件时不持有 buffer 的锁, 所属线程可以继续记录
+void FlushBuffer(TraceBuffer& buffer)
+{
+    std::vector<TraceEvent> vEvents;
+    vEvents.reserve(TRACE_BUFFER_EVENTS);
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        vEvents.swap(buffer.vEvents);
+    }
+    TraceWriter& writer = GetTraceWriter();
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.WriteEvents(buffer.nTid, vEvents);
+}
+
+CLocalTraceBuffer::~CLocalTraceBuffer()
+{
+    if (!buffer)
+        return;
+    FlushBuffer(*buffer);
+    TraceWriter& writer = GetTraceWriter();
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.vBuffers.erase(std::remove(writer.vBuffers.begin(), writer.vBuffers.end(), buffer), writer.vBuffers.end());
+}
+} // namespace
+
+void CTraceSpan::Record() const
+{
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    // 跨过 StopTrace 的区间不记录, 否则会留到下一次 trace 中
+    if (!g_trace_enabled.load(std::memory_order_relaxed))
+        return;
+    TraceBuffer& buffer = LocalTraceBuffer();
+    const std::chrono::steady_clock::time_point start = GetTraceWriter().start;
+    bool fFull;
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.vEvents.push_back(TraceEvent{m_name, std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - start).count(),
+                                            std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count(), m_nHeight, m_nFile});
+        fFull = buffer.vEvents.size() >= TRACE_BUFFER_EVENTS;
+    }
+    if (fFull)
+        FlushBuffer(buffer);
+}
+
+bool StartTrace(const std::string& path)
+{
+    StopTrace();
+    TraceWriter& writer = GetTraceWriter();
+    static bool fRegistered = false;
+    if (!fRegistered)
+    {
+        // 各线程(包括主线程)退出时写出自己的缓冲区, 之后在 exit 中结束文件
+        std::atexit(StopTrace);
+        fRegistered = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.file = fopen(path.c_str(), "w");
+        if (!writer.file)
+        {
+            LogError("%s: 无法创建 %s\n", __func__, path.data());
+            return false;
+        }
+        fputs("[\n", writer.file);
+        writer.fFirstEvent = true;
+        writer.start = std::chrono::steady_clock::now();
+    }
+    g_trace_enabled.store(true, std::memory_order_release);
+    TraceThreadName("main");
+    return true;
+}
+
+void StopTrace()
+{
+    g_trace_enabled.store(false, std::memory_order_release);
+    TraceWriter& writer = GetTraceWriter();
+    std::vector<std::shared_ptr<TraceBuffer>> vBuffers;
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        if (!writer.file)
+            return;
+        vBuffers = writer.vBuffers;
+    }
+    // hzx 关闭之后仍在进行中的区间不再记录; 已记录的全部写出
+    for (const std::shared_ptr<TraceBuffer>& buffer : vBuffers)
+        FlushBuffer(*buffer);
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    fputs("\n]\n", writer.file);
+    fclose(writer.file);
+    writer.file = nullptr;
+}
+
+void TraceThreadName(const char* name)
+{
+    if (!g_trace_enabled.load(std::memory_order_relaxed))
+        return;
+    const uint32_t nTid = LocalTraceBuffer().nTid;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", nTid, name);
+    TraceWriter& writer = GetTraceWriter();
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.WriteRecord(buf);
+}
@@ -0,0 +1,73 @@
+#ifndef BLOCKCHAIN_TRACE_H
+#define BLOCKCHAIN_TRACE_H
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+//! Events a thread collects before writing them to the trace file in one go
+static const size_t TRACE_BUFFER_EVENTS = 4096;
+
+//! Whether spans are recorded; read by every span, so kept outside the writer
+extern std::atomic<bool> g_trace_enabled;
+
+/**
+ * Start writing spans to path as Chrome trace-event JSON (load it in Perfetto or
+ * chrome://tracing). Every thread collects its spans in its own buffer and appends them to the
+ * file when the buffer is full or the thread exits, so a multi-hour trace does not grow in
+ * memory. False if the file cannot be created.
+ */
+bool StartTrace(const std::string& path);
+
+/** Write every buffered span, finish the JSON and close the file. */
+void StopTrace();
+
+/** Name the calling thread in the trace (a Perfetto track title); ignored when tracing is off. */
+void TraceThreadName(const char* name);
+
+/**
+ * Records the time from construction to destruction as a complete ("X") event on the calling
+ * thread's track, tagged with a block height and a file number when they are not negative.
+ * name must be a string literal (only the pointer is kept). When tracing is off a span is one
+ * relaxed load and a branch.
+ */
+class CTraceSpan
+{
+private:
+    const char* m_name;
+    int m_nHeight;
+    int m_nFile;
+    std::chrono::steady_clock::time_point m_start;
+
+    void Record() const;
+
+public:
+    explicit CTraceSpan(const char* name, int nHeight = -1, int nFile = -1)
+    {
+        if (__builtin_expect(g_trace_enabled.load(std::memory_order_relaxed), 0))
+        {
+            m_name = name;
+            m_nHeight = nHeight;
+            m_nFile = nFile;
+            m_start = std::chrono::steady_clock::now();
+        }
+        else
+            m_name = nullptr;
+    }
+
+    ~CTraceSpan()
+    {
+        if (m_name)
+            Record();
+    }
+
+    CTraceSpan(const CTraceSpan&) = delete;
+    CTraceSpan& operator=(const CTraceSpan&) = delete;
+};
+
+#define TRACE_SPAN_CONCAT_(a, b) a##b
+#define TRACE_SPAN_NAME_(line) TRACE_SPAN_CONCAT_(trace_span_, line)
+//! TRACE_SPAN("name"[, nHeight[, nFile]]) traces the rest of the enclosing scope
+#define TRACE_SPAN(...) CTraceSpan TRACE_SPAN_NAME_(__LINE__)(__VA_ARGS__)
+
+#endif
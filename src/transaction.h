@@ -1,5 +1,5 @@
 #ifndef BLOCKCHAIN_TRANSACTION_H
-#define BLOCKCHAIN_TRANSACION_H
+#define BLOCKCHAIN_TRANSACTION_H
 #include "amount.h"
 #include "script.h"
 #include "uint256.h"
@@ -306,6 +306,8 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     explicit CTransaction(const CMutableTransaction& tx);
     CTransaction(CMutableTransaction&& tx);
+    /** Take over tx with its txid and wtxid already computed, e.g. in a batch by UnserializeBlockBatchHash. */
+    CTransaction(CMutableTransaction&& tx, const uint256& hashIn, const uint256& witnessHashIn);
 
     template <typename Stream>
     inline void Serialize(Stream& s) const
@@ -1,7 +1,13 @@
 #include "txdb.h"
+#include "logging.h"
 #include "pow.h"
+#include "scheduler.h"
 #include "shutdown.h"
-#include <thread>
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include "system_hzx.h"
 
 
@@ -32,18 +38,18 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read(DB_LAST_BLOCK, nFile);
 }
 
-// bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo)
-// {
-//     CDBBatch batch(*this);
-//     for (std::vector<std::pair<int, const CBlockFileInfo*>>::const_iterator it = fileInfo.begin(); it != fileInfo.end(); it++) {
-//         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
-//     }
-//     batch.Write(DB_LAST_BLOCK, nLastFile);
-//     for (std::vector<const CBlockIndex*>::const_iterator it = blockinfo.begin(); it != blockinfo.end(); it++) {
-//         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
-//     }
-//     return WriteBatch(batch, true);
-// }
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo)
+{
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<int, const CBlockFileInfo*>>::const_iterator it = fileInfo.begin(); it != fileInfo.end(); it++) {
+        batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
+    }
+    batch.Write(DB_LAST_BLOCK, nLastFile);
+    for (std::vector<const CBlockIndex*>::const_iterator it = blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    }
+    return WriteBatch(batch, true);
+}
 
 // bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 // {
@@ -60,62 +66,127 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 // }
 
 
+namespace
+{
+//! entries a loader task collects before merging them into the block map
+static const size_t LOAD_BLOCK_INDEX_BATCH = 16384;
+
+/** A deserialized DB_BLOCK_INDEX record together with its (already computed) block hash. */
+struct CLoadedBlockIndex
+{
+    uint256 hash;
+    CDiskBlockIndex diskindex;
+};
+} // namespace
+
 // hzx 使用blocktree载入BlockIndex
-// hzx, 这个函数中并没有使用consensusParams
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params &consensusParams, std::function<CBlockIndex *(const uint256 &)> insertBlockIndex)
+// hzx DB_BLOCK_INDEX 的键按区块哈希第一个字节划分为 nThreads 段, 每段是调度器上的一个任务, 用自己的迭代器扫描,
+// 反序列化并校验工作量后, 分批合并到 m_block_index 中(合并由 merge 锁串行化)
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params &consensusParams, std::function<CBlockIndex *(const uint256 &)> insertBlockIndex, int nThreads)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    // hzx levelDB 迭代器使用前必须Seek
-    // uint256 中用0初始化一个uint8的数组,大小为32,
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
-
-    // Load m_block_index
-    while (pcursor->Valid())
-    {
-        // std::this_thread::interruption_point();          hzx 尽量不适用boost线程库
-        if (ShutdownRequested())
-            return false;
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX)
+    if (nThreads <= 0)
+        nThreads = GetScheduler().GetConcurrency();
+    nThreads = std::min(nThreads, 256);
+
+    std::mutex cs_merge;
+    std::atomic<bool> fFailed(false);
+
+    // 把一批记录插入区块索引, 调用方须持有 cs_merge
+    auto merge = [&](std::vector<CLoadedBlockIndex> &vLoaded) {
+        TRACE_SPAN("MergeBlockIndex");
+        for (const CLoadedBlockIndex &loaded : vLoaded)
         {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex))
-            {
-                // Construct block index object
-                // validation中m_block_index中插入CBlockIndex
-                CBlockIndex *pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus; // hzx block合法状态也保留在leveldb中
-                pindexNew->nTx = diskindex.nTx;
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                {
-                    printf("%s: CheckProofOfWork failed: %s \n", __func__, pindexNew->ToString().data());
-                    return false;
-                }
-
-                pcursor->Next();
-            }
-            else
+            const CDiskBlockIndex &diskindex = loaded.diskindex;
+            // Construct block index object
+            // validation中m_block_index中插入CBlockIndex
+            CBlockIndex *pindexNew = insertBlockIndex(loaded.hash);
+            pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus; // hzx block合法状态也保留在leveldb中
+            pindexNew->nTx = diskindex.nTx;
+        }
+        vLoaded.clear();
+    };
+
+    // 整批计算区块头哈希(多路并行 SHA256d)并检查工作量证明, 然后并入区块索引
+    auto flush = [&](std::vector<CLoadedBlockIndex> &vLoaded) {
+        TRACE_SPAN("HashBlockIndexBatch");
+        std::vector<CBlockHeader> vHeaders;
+        vHeaders.reserve(vLoaded.size());
+        for (const CLoadedBlockIndex &loaded : vLoaded)
+            vHeaders.push_back(loaded.diskindex.GetBlockHeader());
+        std::vector<uint256> vHashes;
+        GetBlockHeaderHashes(vHeaders, vHashes);
+        for (size_t i = 0; i < vLoaded.size(); i++)
+        {
+            vLoaded[i].hash = vHashes[i];
+            if (!CheckProofOfWork(vLoaded[i].hash, vLoaded[i].diskindex.nBits, consensusParams))
             {
-                // return error("%s: failed to read value", __func__);
-                printf("%s: failed to read value\n", __func__);
+                LogError("%s: CheckProofOfWork failed: %s \n", __func__, vLoaded[i].diskindex.ToString().data());
+                fFailed = true;
                 return false;
             }
         }
-        else
+        std::unique_lock<std::mutex> lock(cs_merge, std::defer_lock);
         {
-            break;
+            TRACE_SPAN("WaitMergeLock");
+            lock.lock();
         }
-    }
+        merge(vLoaded);
+        return true;
+    };
+
+    auto load_slice = [&](int nSlice) {
+        TRACE_SPAN("LoadBlockIndexGuts");
+        // 本线程负责哈希首字节位于 [nBegin, nEnd) 的区块
+        const int nBegin = 256 * nSlice / nThreads;
+        const int nEnd = 256 * (nSlice + 1) / nThreads;
+        uint256 hashStart;
+        *hashStart.begin() = nBegin;
 
-    return true;
-}
\ No newline at end of file
+        std::vector<CLoadedBlockIndex> vLoaded;
+        vLoaded.reserve(LOAD_BLOCK_INDEX_BATCH);
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        // hzx levelDB 迭代器使用前必须Seek
+        pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashStart));
+
+        // Load m_block_index
+        while (pcursor->Valid())
+        {
+            // std::this_thread::interruption_point();          hzx 尽量不适用boost线程库
+            if (fFailed || ShutdownRequested())
+            {
+                fFailed = true;
+                return;
+            }
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+                break;
+            vLoaded.emplace_back();
+            CLoadedBlockIndex &loaded = vLoaded.back();
+            if (!pcursor->GetValue(loaded.diskindex))
+            {
+                // return error("%s: failed to read value", __func__);
+                LogError("%s: failed to read value\n", __func__);
+                fFailed = true;
+                return;
+            }
+            if (vLoaded.size() >= LOAD_BLOCK_INDEX_BATCH && !flush(vLoaded))
+                return;
+            pcursor->Next();
+        }
+        flush(vLoaded);
+    };
+
+    ParallelFor(nThreads, nThreads, load_slice);
+
+    return !fFailed;
+}
@@ -30,7 +30,13 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Load every DB_BLOCK_INDEX entry through insertBlockIndex. The key space is split by the
+     * first byte of the block hash into nThreads ranges that are scanned, deserialized and
+     * PoW-checked concurrently as tasks on GetScheduler() (0 = the scheduler's concurrency); insertBlockIndex is only ever
+     * called from one thread at a time.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads = 0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKCHAIN_UNDO_H
+#define BLOCKCHAIN_UNDO_H
+
+#include <assert.h>
+#include "compressor.h"
+#include "serialize.h"
+#include "transaction.h"
+
+/**
+ * A spent transaction output as recorded in the undo data (rev?????.dat): the output
+ * itself, the height of the block that created it and whether it came from a coinbase.
+ *
+ * hzx 原版 Coin 在 coins.h 中, 这里不维护 UTXO 集合, 只用于读写 undo 数据
+ */
+class Coin
+{
+public:
+    //! unspent transaction output
+    CTxOut out;
+
+    //! whether containing transaction was a coinbase
+    unsigned int fCoinBase : 1;
+
+    //! at which height this containing transaction was included in the active block chain
+    uint32_t nHeight : 31;
+
+    Coin() : fCoinBase(false), nHeight(0) {}
+    Coin(CTxOut outIn, int nHeightIn, bool fCoinBaseIn) : out(std::move(outIn)), fCoinBase(fCoinBaseIn), nHeight(nHeightIn) {}
+
+    void Clear()
+    {
+        out.SetNull();
+        fCoinBase = false;
+        nHeight = 0;
+    }
+
+    bool IsCoinBase() const
+    {
+        return fCoinBase;
+    }
+};
+
+/** Formatter for undo information for a CTxIn
+ *
+ *  Contains the prevout's CTxOut being spent, and its metadata as well
+ *  (coinbase or not, height). The serialization contains a dummy value of
+ *  zero. This is compatible with older versions which expect to see
+ *  the transaction version there.
+ */
+class TxInUndoSerializer
+{
+    const Coin* txout;
+
+public:
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ::Serialize(s, VARINT(txout->nHeight * 2 + (txout->fCoinBase ? 1u : 0u)));
+        if (txout->nHeight > 0)
+        {
+            // Required to maintain compatibility with older undo format.
+            ::Serialize(s, (unsigned char)0);
+        }
+        ::Serialize(s, CTxOutCompressor(REF(txout->out)));
+    }
+
+    explicit TxInUndoSerializer(const Coin* coin) : txout(coin) {}
+};
+
+class TxInUndoDeserializer
+{
+    Coin* txout;
+
+public:
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        txout->nHeight = nCode / 2;
+        txout->fCoinBase = nCode & 1;
+        if (txout->nHeight > 0)
+        {
+            // Old versions stored the version number for the last spend of
+            // a transaction's outputs. Non-final spends were indicated with
+            // height = 0.
+            unsigned int nVersionDummy;
+            ::Unserialize(s, VARINT(nVersionDummy));
+        }
+        ::Unserialize(s, CTxOutCompressor(REF(txout->out)));
+    }
+
+    explicit TxInUndoDeserializer(Coin* coin) : txout(coin) {}
+};
+
+// hzx 本仓库没有 consensus/consensus.h, 直接写出数值: MAX_BLOCK_WEIGHT = 4000000, 最小输入 41 字节 * WITNESS_SCALE_FACTOR
+static const size_t MIN_TRANSACTION_INPUT_WEIGHT = 4 * 41;
+static const size_t MAX_INPUTS_PER_BLOCK = 4000000 / MIN_TRANSACTION_INPUT_WEIGHT;
+
+/** Undo information for a CTransaction */
+class CTxUndo
+{
+public:
+    // undo information for all txins
+    std::vector<Coin> vprevout;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        // TODO: avoid reimplementing vector serializer
+        uint64_t count = vprevout.size();
+        ::Serialize(s, COMPACTSIZE(REF(count)));
+        for (const auto& prevout : vprevout)
+        {
+            ::Serialize(s, TxInUndoSerializer(&prevout));
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        // TODO: avoid reimplementing vector deserializer
+        uint64_t count = 0;
+        ::Unserialize(s, COMPACTSIZE(count));
+        if (count > MAX_INPUTS_PER_BLOCK)
+        {
+            throw std::ios_base::failure("Too many input undo records");
+        }
+        vprevout.resize(count);
+        for (auto& prevout : vprevout)
+        {
+            ::Unserialize(s, TxInUndoDeserializer(&prevout));
+        }
+    }
+};
+
+/** Undo information for a CBlock */
+class CBlockUndo
+{
+public:
+    std::vector<CTxUndo> vtxundo; // for all but the coinbase
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(vtxundo);
+    }
+};
+
+#endif